@@ -0,0 +1,576 @@
+/**
+ * @file
+ * @brief Throughput benchmarks, one CSV row per structure, operation and
+ * parameter set
+ *
+ * Usage: bench [n]   (n values per array, 1 << 20 by default)
+ *        make -s bench ARGS=n > bench.csv
+ *
+ * Columns:
+ *   structure, op, param, dist, n  what was measured
+ *   ns_per_elem                    time per value read, written or encoded
+ *   gb_per_s                       32 bit values processed per second, in GB
+ *   bits_per_elem                  size of the structure per value
+ *
+ * Random reads use BENCH_QUERIES uniformly drawn indexes. Every
+ * measurement repeats its operation until BENCH_MIN_TIME seconds have
+ * passed and reports the mean.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../src/bitarr.h"
+#include "../src/bitarr_gather.h"
+#include "../src/bitarr_io.h"
+#include "../src/bitarr_logic.h"
+#include "../src/bitarr_scan.h"
+#include "../src/bitarr_vl.h"
+#include "../src/dac.h"
+#include "../src/elias_fano.h"
+#include "../src/parallel.h"
+#include "../src/pfor.h"
+#include "../src/roaring.h"
+
+#define BENCH_QUERIES (1 << 16)
+#define BENCH_MIN_TIME 0.05
+
+// Deterministic pseudo random values
+static uint32_t lcg_next(uint64_t *state)
+{
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t) (*state >> 32);
+}
+
+/**
+ * @struct Bench
+ *
+ * Everything an operation may touch, the fields used depend on the
+ * structure being measured.
+ */
+typedef struct {
+  size_t n;
+  uint32_t *values;     // Source values
+  uint32_t *uniform;    // Random 32 bit values, left unmodified
+  uint32_t *queries;    // Random indexes below n
+  size_t *positions;    // Same indexes as size_t, for gathers
+  uint32_t *out;        // Decoded values, n or BENCH_QUERIES long
+  uint8_t width;
+  unsigned int threads;
+  size_t k;
+  VL_CODEC codec;
+  BitArray *bitarr;
+  VLBitArray *vlb;
+  DACArray *dac;
+  EliasFano *ef;
+  PForArray *pfor;
+  RoaringBitmap *ra;
+  RoaringBitmap *rb;
+  FILE *fp;
+} Bench;
+
+// Keeps results alive so reads are not optimized away
+static volatile uint32_t sink;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+// Mean seconds per call of fn, after one warm up call
+static double bench_time(void (*fn)(Bench *), Bench *b)
+{
+    fn(b);
+    size_t reps = 0;
+    const double start = now();
+    double elapsed;
+    do {
+        fn(b);
+        reps++;
+    } while ((elapsed = now() - start) < BENCH_MIN_TIME);
+    return elapsed / (double) reps;
+}
+
+static void report(const char *structure, const char *op, const char *param,
+  const char *dist, size_t n, size_t elems, double seconds, size_t bytes)
+{
+    printf("%s,%s,%s,%s,%zu,%.3f,%.3f,%.3f\n", structure, op, param, dist, n,
+      seconds * 1e9 / (double) elems,
+      (double) elems * sizeof(uint32_t) / seconds * 1e-9,
+      (double) bytes * 8 / (double) n);
+}
+
+
+// -- BitArray ----------------------------------------------------------------
+static void bitarr_construct(Bench *b)
+{
+    BitArray_free(BitArray_init(b->values, (uint32_t) b->n, b->width, sizeof(uint32_t)));
+}
+
+static void bitarr_read_random(Bench *b)
+{
+    uint32_t acc = 0;
+    for (size_t q = 0; q < BENCH_QUERIES; ++q) acc += BitArray_read(b->bitarr, b->queries[q]);
+    sink = acc;
+}
+
+static void bitarr_read_seq(Bench *b)
+{
+    uint32_t acc = 0;
+    for (uint32_t i = 0; i < b->n; ++i) acc += BitArray_read(b->bitarr, i);
+    sink = acc;
+}
+
+static void bitarr_gather(Bench *b)
+{
+    BitArray_gather(b->bitarr, b->positions, BENCH_QUERIES, b->out, 0);
+    sink = b->out[0];
+}
+
+static void bitarr_gather_sorted(Bench *b)
+{
+    BitArray_gather(b->bitarr, b->positions, BENCH_QUERIES, b->out, GATHER_SORT);
+    sink = b->out[0];
+}
+
+static void bitarr_unpack(Bench *b)
+{
+    BitArray_unpack(b->bitarr, 0, b->n, b->out);
+    sink = b->out[b->n / 2];
+}
+
+static void bitarr_write_seq(Bench *b)
+{
+    for (uint32_t i = 0; i < b->n; ++i) BitArray_write(b->bitarr, i, b->values[i]);
+}
+
+static void bitarr_pack(Bench *b)
+{
+    BitArray_pack(b->bitarr, 0, b->n, b->values);
+}
+
+// Predicates on the middle of the value range
+static void bitarr_count(Bench *b)
+{
+    sink = (uint32_t) BitArray_count(b->bitarr, SCAN_LT, (0xFFFFFFFFu >> (32 - b->width)) >> 1, 0);
+}
+
+static void bitarr_filter(Bench *b)
+{
+    const uint32_t mask = 0xFFFFFFFFu >> (32 - b->width);
+    sink = (uint32_t) BitArray_filter(b->bitarr, SCAN_BETWEEN, mask / 4, mask / 4 * 3, b->out);
+}
+
+static void bitarr_sum(Bench *b)
+{
+    sink = (uint32_t) BitArray_sum(b->bitarr);
+}
+
+// Self and leaves the values unchanged between calls
+static void bitarr_and(Bench *b)
+{
+    BitArray_and_inplace(b->bitarr, b->bitarr);
+}
+
+static void bitarr_popcount(Bench *b)
+{
+    sink = (uint32_t) BitArray_popcount(b->bitarr);
+}
+
+static void bitarr_save(Bench *b)
+{
+    rewind(b->fp);
+    BitArray_save(b->bitarr, b->fp);
+}
+
+static void bitarr_open(Bench *b)
+{
+    rewind(b->fp);
+    BitArray_free(BitArray_open(b->fp));
+}
+
+static void bench_bitarr(Bench *b)
+{
+    char param[16];
+    for (uint8_t w = 1; w <= 32; ++w) {
+        const uint32_t mask = 0xFFFFFFFFu >> (32 - w);
+        for (size_t i = 0; i < b->n; ++i) b->values[i] = b->uniform[i] & mask;
+
+        b->width = w;
+        b->bitarr = BitArray_init(b->values, (uint32_t) b->n, w, sizeof(uint32_t));
+        const size_t bytes = sizeof(BitArray) + sizeof(uint32_t) * BitArray_n_words(b->bitarr);
+        snprintf(param, sizeof(param), "w=%u", w);
+
+        report("BitArray", "construct", param, "uniform", b->n, b->n, bench_time(bitarr_construct, b), bytes);
+        report("BitArray", "read_random", param, "uniform", b->n, BENCH_QUERIES, bench_time(bitarr_read_random, b), bytes);
+        report("BitArray", "gather", param, "uniform", b->n, BENCH_QUERIES, bench_time(bitarr_gather, b), bytes);
+        report("BitArray", "gather_sorted", param, "uniform", b->n, BENCH_QUERIES, bench_time(bitarr_gather_sorted, b), bytes);
+        report("BitArray", "read_seq", param, "uniform", b->n, b->n, bench_time(bitarr_read_seq, b), bytes);
+        report("BitArray", "unpack", param, "uniform", b->n, b->n, bench_time(bitarr_unpack, b), bytes);
+        report("BitArray", "count_lt", param, "uniform", b->n, b->n, bench_time(bitarr_count, b), bytes);
+        report("BitArray", "filter_between", param, "uniform", b->n, b->n, bench_time(bitarr_filter, b), bytes);
+        report("BitArray", "sum", param, "uniform", b->n, b->n, bench_time(bitarr_sum, b), bytes);
+        report("BitArray", "and_inplace", param, "uniform", b->n, b->n, bench_time(bitarr_and, b), bytes);
+        report("BitArray", "popcount", param, "uniform", b->n, b->n, bench_time(bitarr_popcount, b), bytes);
+        report("BitArray", "write_seq", param, "uniform", b->n, b->n, bench_time(bitarr_write_seq, b), bytes);
+        report("BitArray", "pack", param, "uniform", b->n, b->n, bench_time(bitarr_pack, b), bytes);
+        report("BitArray", "save", param, "uniform", b->n, b->n, bench_time(bitarr_save, b), bytes);
+        report("BitArray", "open", param, "uniform", b->n, b->n, bench_time(bitarr_open, b), bytes);
+        BitArray_free(b->bitarr);
+    }
+}
+
+
+// -- Atomic updates ----------------------------------------------------------
+/*
+ * Every thread updates BENCH_QUERIES random indexes of the same array, so
+ * ns_per_elem is wall time per update over all threads.
+ */
+static void atomic_add_task(void *ctx, size_t task)
+{
+    Bench *b = ctx;
+    for (size_t q = 0; q < BENCH_QUERIES; ++q) {
+        BitArray_fetch_add_atomic(b->bitarr, b->queries[(q + task * 4099) % BENCH_QUERIES], 1);
+    }
+}
+
+static void atomic_write_task(void *ctx, size_t task)
+{
+    Bench *b = ctx;
+    for (size_t q = 0; q < BENCH_QUERIES; ++q) {
+        BitArray_write_atomic(b->bitarr, b->queries[(q + task * 4099) % BENCH_QUERIES], (unsigned int) q);
+    }
+}
+
+static void bitarr_fetch_add(Bench *b)
+{
+    parallel_for(b->threads, b->threads, atomic_add_task, b);
+}
+
+static void bitarr_write_atomic(Bench *b)
+{
+    parallel_for(b->threads, b->threads, atomic_write_task, b);
+}
+
+static void bench_atomic(Bench *b)
+{
+    const unsigned int counts[] = { 1, 2, 4, 0 };
+    unsigned int last = 0;
+    char param[32];
+
+    b->width = 13;
+    b->bitarr = BitArray_calloc((uint32_t) b->n, b->width, sizeof(uint32_t));
+    const size_t bytes = sizeof(BitArray) + sizeof(uint32_t) * BitArray_n_words(b->bitarr);
+    for (size_t c = 0; c < sizeof(counts)/sizeof(counts[0]); ++c) {
+        // 0 is every online CPU, which may repeat a count already measured
+        b->threads = parallel_threads(counts[c]);
+        if (b->threads <= last) continue;
+        last = b->threads;
+
+        snprintf(param, sizeof(param), "w=13 threads=%u", b->threads);
+        const size_t elems = (size_t) b->threads * BENCH_QUERIES;
+        report("BitArray", "fetch_add_atomic", param, "uniform", b->n, elems, bench_time(bitarr_fetch_add, b), bytes);
+        report("BitArray", "write_atomic", param, "uniform", b->n, elems, bench_time(bitarr_write_atomic, b), bytes);
+    }
+    BitArray_free(b->bitarr);
+}
+
+
+// -- Variable length ---------------------------------------------------------
+static const char *codec_names[] = { "gamma", "delta", "rice", "varbyte" };
+
+static const char *dist_names[] = { "small", "geometric", "skewed" };
+
+// Values of distribution d, all below 2^32 - 1
+static void fill(Bench *b, int d, uint64_t *seed)
+{
+    for (size_t i = 0; i < b->n; ++i) {
+        uint32_t r = lcg_next(seed);
+        if (d == 0) b->values[i] = r % 16;
+        else if (d == 1) b->values[i] = (uint32_t) __builtin_ctz(r | 1u << 16) * 50 + r % 50;
+        else b->values[i] = r % 10 ? r % 256 : r >> (r % 32);
+    }
+}
+
+static void vl_construct(Bench *b)
+{
+    VLBitArray_free(VLBitArray_init_codec(b->values, b->n, b->k, sizeof(uint32_t),
+      b->codec, VL_RICE_AUTO));
+}
+
+static void vl_read_random(Bench *b)
+{
+    uint32_t acc = 0;
+    for (size_t q = 0; q < BENCH_QUERIES; ++q) acc += VLBitArray_read(b->vlb, b->queries[q]);
+    sink = acc;
+}
+
+static void vl_gather(Bench *b)
+{
+    VLBitArray_gather(b->vlb, b->positions, BENCH_QUERIES, b->out, 0);
+    sink = b->out[0];
+}
+
+static void vl_gather_sorted(Bench *b)
+{
+    VLBitArray_gather(b->vlb, b->positions, BENCH_QUERIES, b->out, GATHER_SORT);
+    sink = b->out[0];
+}
+
+static void vl_iter(Bench *b)
+{
+    VLBitArrayIter it;
+    uint32_t acc = 0;
+    VLBitArray_iter(&it, b->vlb, 0);
+    for (size_t i = 0; i < b->n; ++i) acc += VLBitArray_iter_next(&it);
+    sink = acc;
+}
+
+static void vl_decode(Bench *b)
+{
+    VLBitArray_decode(b->vlb, 0, b->n, b->out);
+    sink = b->out[b->n / 2];
+}
+
+static void dac_construct(Bench *b)
+{
+    DACArray_free(DACArray_init(b->values, (uint32_t) b->n, (uint8_t) b->k));
+}
+
+static void dac_read_random(Bench *b)
+{
+    uint32_t acc = 0;
+    for (size_t q = 0; q < BENCH_QUERIES; ++q) acc += DACArray_read(b->dac, b->queries[q]);
+    sink = acc;
+}
+
+static void dac_read_seq(Bench *b)
+{
+    uint32_t acc = 0;
+    for (size_t i = 0; i < b->n; ++i) acc += DACArray_read(b->dac, i);
+    sink = acc;
+}
+
+static void pfor_construct(Bench *b)
+{
+    PForArray_free(PForArray_init(b->values, b->n));
+}
+
+static void pfor_read_random(Bench *b)
+{
+    uint32_t acc = 0;
+    for (size_t q = 0; q < BENCH_QUERIES; ++q) acc += PForArray_read(b->pfor, b->queries[q]);
+    sink = acc;
+}
+
+static void pfor_decode(Bench *b)
+{
+    PForArray_decode(b->pfor, 0, b->n, b->out);
+    sink = b->out[b->n / 2];
+}
+
+static void bench_vl(Bench *b)
+{
+    const size_t ks[] = { 8, 32, 128 };
+    const uint8_t chunks[] = { 4, 8 };
+    char param[32];
+    uint64_t seed = 1;
+
+    for (int d = 0; d < 3; ++d) {
+        fill(b, d, &seed);
+
+        for (int c = VL_GAMMA; c <= VL_VARBYTE; ++c) {
+            for (size_t ki = 0; ki < sizeof(ks)/sizeof(ks[0]); ++ki) {
+                b->codec = (VL_CODEC) c;
+                b->k = ks[ki];
+                b->vlb = VLBitArray_init_codec(b->values, b->n, b->k, sizeof(uint32_t),
+                  b->codec, VL_RICE_AUTO);
+                const size_t bytes = sizeof(VLBitArray) +
+                  sizeof(size_t) * ((b->n + b->k - 1) / b->k) +
+                  sizeof(uint32_t) * b->vlb->physical_size;
+                snprintf(param, sizeof(param), "%s k=%zu", codec_names[c], b->k);
+
+                report("VLBitArray", "construct", param, dist_names[d], b->n, b->n, bench_time(vl_construct, b), bytes);
+                report("VLBitArray", "read_random", param, dist_names[d], b->n, BENCH_QUERIES, bench_time(vl_read_random, b), bytes);
+                report("VLBitArray", "gather", param, dist_names[d], b->n, BENCH_QUERIES, bench_time(vl_gather, b), bytes);
+                report("VLBitArray", "gather_sorted", param, dist_names[d], b->n, BENCH_QUERIES, bench_time(vl_gather_sorted, b), bytes);
+                report("VLBitArray", "iter", param, dist_names[d], b->n, b->n, bench_time(vl_iter, b), bytes);
+                report("VLBitArray", "decode", param, dist_names[d], b->n, b->n, bench_time(vl_decode, b), bytes);
+                VLBitArray_free(b->vlb);
+            }
+        }
+
+        for (size_t ci = 0; ci < sizeof(chunks)/sizeof(chunks[0]); ++ci) {
+            b->k = chunks[ci];
+            b->dac = DACArray_init(b->values, (uint32_t) b->n, chunks[ci]);
+            snprintf(param, sizeof(param), "chunk=%u", chunks[ci]);
+            const size_t bytes = DACArray_size(b->dac);
+            report("DACArray", "construct", param, dist_names[d], b->n, b->n, bench_time(dac_construct, b), bytes);
+            report("DACArray", "read_random", param, dist_names[d], b->n, BENCH_QUERIES, bench_time(dac_read_random, b), bytes);
+            report("DACArray", "read_seq", param, dist_names[d], b->n, b->n, bench_time(dac_read_seq, b), bytes);
+            DACArray_free(b->dac);
+        }
+
+        b->pfor = PForArray_init(b->values, b->n);
+        const size_t bytes = PForArray_size(b->pfor);
+        report("PForArray", "construct", "", dist_names[d], b->n, b->n, bench_time(pfor_construct, b), bytes);
+        report("PForArray", "read_random", "", dist_names[d], b->n, BENCH_QUERIES, bench_time(pfor_read_random, b), bytes);
+        report("PForArray", "decode", "", dist_names[d], b->n, b->n, bench_time(pfor_decode, b), bytes);
+        PForArray_free(b->pfor);
+    }
+}
+
+
+// -- Sorted sequences --------------------------------------------------------
+static void ef_access_random(Bench *b)
+{
+    uint32_t acc = 0;
+    for (size_t q = 0; q < BENCH_QUERIES; ++q) acc += EliasFano_access(b->ef, b->queries[q]);
+    sink = acc;
+}
+
+static void ef_next_geq(Bench *b)
+{
+    size_t acc = 0;
+    for (size_t q = 0; q < BENCH_QUERIES; ++q) {
+        acc += EliasFano_next_geq(b->ef, b->values[b->queries[q]] + 1);
+    }
+    sink = (uint32_t) acc;
+}
+
+static void ef_iter(Bench *b)
+{
+    EliasFanoIter it;
+    uint32_t acc = 0;
+    EliasFano_iter(&it, b->ef, 0);
+    for (size_t i = 0; i < b->n; ++i) acc += EliasFano_iter_next(&it);
+    sink = acc;
+}
+
+static void bench_sorted(Bench *b)
+{
+    const uint32_t gaps[] = { 4, 64, 1024 };
+    char param[32];
+    uint64_t seed = 2;
+
+    for (size_t g = 0; g < sizeof(gaps)/sizeof(gaps[0]); ++g) {
+        uint32_t x = 0;
+        for (size_t i = 0; i < b->n; ++i) b->values[i] = x += lcg_next(&seed) % gaps[g];
+
+        b->ef = EliasFano_init(b->values, (uint32_t) b->n);
+        const size_t bytes = EliasFano_size(b->ef);
+        snprintf(param, sizeof(param), "gap<%u", gaps[g]);
+        report("EliasFano", "access_random", param, "sorted", b->n, BENCH_QUERIES, bench_time(ef_access_random, b), bytes);
+        report("EliasFano", "next_geq", param, "sorted", b->n, BENCH_QUERIES, bench_time(ef_next_geq, b), bytes);
+        report("EliasFano", "iter", param, "sorted", b->n, b->n, bench_time(ef_iter, b), bytes);
+        EliasFano_free(b->ef);
+    }
+}
+
+
+// -- Compressed bitmaps ------------------------------------------------------
+static void roaring_add(Bench *b)
+{
+    RoaringBitmap *r = RoaringBitmap_init();
+    for (size_t i = 0; i < b->n; ++i) RoaringBitmap_add(r, b->values[i]);
+    sink = (uint32_t) RoaringBitmap_cardinality(r);
+    RoaringBitmap_free(r);
+}
+
+static void roaring_contains(Bench *b)
+{
+    uint32_t acc = 0;
+    for (size_t q = 0; q < BENCH_QUERIES; ++q) {
+        acc += (uint32_t) RoaringBitmap_contains(b->ra, b->values[b->queries[q]] + 1);
+    }
+    sink = acc;
+}
+
+static void roaring_and(Bench *b)
+{
+    RoaringBitmap *r = RoaringBitmap_and(b->ra, b->rb);
+    sink = (uint32_t) RoaringBitmap_cardinality(r);
+    RoaringBitmap_free(r);
+}
+
+static void roaring_or(Bench *b)
+{
+    RoaringBitmap *r = RoaringBitmap_or(b->ra, b->rb);
+    sink = (uint32_t) RoaringBitmap_cardinality(r);
+    RoaringBitmap_free(r);
+}
+
+static void bench_roaring(Bench *b)
+{
+    const uint32_t gaps[] = { 4, 64, 1024 };
+    char param[32];
+    uint64_t seed = 3;
+
+    for (size_t g = 0; g < sizeof(gaps)/sizeof(gaps[0]); ++g) {
+        uint32_t x = 0;
+        b->rb = RoaringBitmap_init();
+        for (size_t i = 0; i < b->n; ++i) RoaringBitmap_add(b->rb, x += lcg_next(&seed) % gaps[g] + 1);
+        x = 0;
+        for (size_t i = 0; i < b->n; ++i) b->values[i] = x += lcg_next(&seed) % gaps[g] + 1;
+        b->ra = RoaringBitmap_init();
+        for (size_t i = 0; i < b->n; ++i) RoaringBitmap_add(b->ra, b->values[i]);
+
+        const size_t bytes = RoaringBitmap_size(b->ra);
+        snprintf(param, sizeof(param), "gap<=%u", gaps[g]);
+        report("RoaringBitmap", "add", param, "sorted", b->n, b->n, bench_time(roaring_add, b), bytes);
+        report("RoaringBitmap", "contains", param, "sorted", b->n, BENCH_QUERIES, bench_time(roaring_contains, b), bytes);
+        report("RoaringBitmap", "and", param, "sorted", b->n, b->n, bench_time(roaring_and, b), bytes);
+        report("RoaringBitmap", "or", param, "sorted", b->n, b->n, bench_time(roaring_or, b), bytes);
+        RoaringBitmap_free(b->ra);
+        RoaringBitmap_free(b->rb);
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    Bench b = { 0 };
+    b.n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1 << 20;
+    if (b.n == 0 || b.n > UINT32_MAX / 2) {
+        fprintf(stderr, "usage: %s [n]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    b.values = malloc(sizeof(uint32_t) * b.n);
+    b.uniform = malloc(sizeof(uint32_t) * b.n);
+    b.out = malloc(sizeof(uint32_t) * (b.n > BENCH_QUERIES ? b.n : BENCH_QUERIES));
+    b.queries = malloc(sizeof(uint32_t) * BENCH_QUERIES);
+    b.positions = malloc(sizeof(size_t) * BENCH_QUERIES);
+    b.fp = tmpfile();
+    if (b.values == NULL || b.uniform == NULL || b.out == NULL || b.queries == NULL || b.positions == NULL || b.fp == NULL) {
+        fprintf(stderr, "Couldn't set up benchmark\n");
+        return EXIT_FAILURE;
+    }
+
+    uint64_t seed = 0;
+    for (size_t i = 0; i < b.n; ++i) b.uniform[i] = lcg_next(&seed);
+    for (size_t q = 0; q < BENCH_QUERIES; ++q) {
+        b.queries[q] = (uint32_t) (lcg_next(&seed) % b.n);
+        b.positions[q] = b.queries[q];
+    }
+
+    printf("structure,op,param,dist,n,ns_per_elem,gb_per_s,bits_per_elem\n");
+    bench_bitarr(&b);
+    bench_atomic(&b);
+    bench_vl(&b);
+    bench_sorted(&b);
+    bench_roaring(&b);
+
+    fclose(b.fp);
+    free(b.values);
+    free(b.uniform);
+    free(b.out);
+    free(b.queries);
+    free(b.positions);
+    return 0;
+}
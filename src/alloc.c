@@ -0,0 +1,82 @@
+/**
+ * @file
+ * @brief Allocators for the memory of arrays
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "alloc.h"
+
+// -- Heap --------------------------------------------------------------------
+static void* heap_alloc(void *ctx, size_t size, size_t align)
+{
+    (void) ctx;
+    // aligned_alloc wants a multiple of the alignment
+    return aligned_alloc(align, (size + align - 1) & ~(align - 1));
+}
+
+static void heap_free(void *ctx, void *ptr)
+{
+    (void) ctx;
+    free(ptr);
+}
+
+const BitAllocator bit_heap_allocator = { heap_alloc, heap_free, NULL };
+
+void* bit_alloc(const BitAllocator *allocator, size_t size)
+{
+    void *ptr = allocator->alloc(allocator->ctx, size ? size : 1, BIT_ALIGN);
+    if (ptr == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+void bit_free(const BitAllocator *allocator, void *ptr)
+{
+    allocator->free(allocator->ctx, ptr);
+}
+
+
+// -- Arena -------------------------------------------------------------------
+void BitArena_init(BitArena *arena, void *buffer, size_t size)
+{
+    arena->base = buffer;
+    arena->size = size;
+    arena->used = 0;
+}
+
+void* BitArena_alloc(BitArena *arena, size_t size, size_t align)
+{
+    // Align the address, the buffer itself may be unaligned
+    const uintptr_t at = (uintptr_t) (arena->base + arena->used),
+                    pad = (align - at % align) % align;
+    if (pad > arena->size - arena->used || size > arena->size - arena->used - pad) {
+        return NULL;
+    }
+    arena->used += pad + size;
+    return arena->base + (arena->used - size);
+}
+
+void BitArena_reset(BitArena *arena)
+{
+    arena->used = 0;
+}
+
+static void* arena_alloc(void *ctx, size_t size, size_t align)
+{
+    return BitArena_alloc(ctx, size, align);
+}
+
+static void arena_free(void *ctx, void *ptr)
+{
+    (void) ctx;
+    (void) ptr;
+}
+
+BitAllocator BitArena_allocator(BitArena *arena)
+{
+    BitAllocator allocator = { arena_alloc, arena_free, arena };
+    return allocator;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file
+ * @brief Allocators for the memory of arrays
+ *
+ * Constructors taking a BitAllocator place the struct and its payload in a
+ * single allocation, the payload starting BIT_ALIGN bytes aligned so SIMD
+ * loads and cache lines line up with the words. bit_heap_allocator backs the
+ * plain constructors with aligned_alloc.
+ *
+ * A BitArena hands out memory from a caller supplied buffer by bumping an
+ * offset. Freeing a single allocation does nothing, the whole arena is
+ * released at once with BitArena_reset, which suits many small arrays with
+ * a common lifetime. Constructors exit when the arena runs out, size the
+ * buffer with BitArray_alloc_size when that must not happen.
+ */
+
+#ifndef ALLOC_H_
+#define ALLOC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Alignment of every payload
+#define BIT_ALIGN 64
+// x rounded up to a multiple of BIT_ALIGN
+#define BIT_ALIGN_UP(x) (((x) + BIT_ALIGN - 1) & ~(size_t) (BIT_ALIGN - 1))
+
+/**
+ * @struct BitAllocator
+ *
+ * @var BitAllocator.alloc
+ *  Returns size bytes aligned to align (a power of two), or NULL
+ * @var BitAllocator.free
+ *  Releases memory returned by alloc, ptr may be NULL
+ * @var BitAllocator.ctx
+ *  Passed to both callbacks
+ */
+typedef struct {
+  void *(*alloc)(void *ctx, size_t size, size_t align);
+  void (*free)(void *ctx, void *ptr);
+  void *ctx;
+} BitAllocator;
+
+/**
+ * @struct BitArena
+ *
+ * @var BitArena.base
+ *  Buffer handed out, owned by the caller
+ * @var BitArena.size
+ *  Size of the buffer in bytes
+ * @var BitArena.used
+ *  Bytes handed out so far, including alignment padding
+ */
+typedef struct {
+  uint8_t *base;
+  size_t size;
+  size_t used;
+} BitArena;
+
+// aligned_alloc and free
+extern const BitAllocator bit_heap_allocator;
+
+/**
+ * @brief Allocate through an allocator, exiting when it fails
+ *
+ * @param allocator
+ * @param size      Bytes to allocate
+ * @return          Memory aligned to BIT_ALIGN
+ */
+void* bit_alloc(const BitAllocator *allocator, size_t size);
+
+/**
+ * @brief Release memory from bit_alloc
+ *
+ * @param allocator Allocator the memory came from
+ * @param ptr
+ */
+void bit_free(const BitAllocator *allocator, void *ptr);
+
+/**
+ * @brief Start an arena over a caller supplied buffer
+ *
+ * @param arena
+ * @param buffer    Memory to hand out, must outlive every allocation
+ * @param size      Size of buffer in bytes
+ */
+void BitArena_init(BitArena *arena, void *buffer, size_t size);
+
+/**
+ * @brief Take size bytes from the arena
+ *
+ * @param arena
+ * @param size      Bytes to allocate
+ * @param align     Alignment, a power of two
+ * @return          Pointer into the buffer, NULL when it is full
+ */
+void* BitArena_alloc(BitArena *arena, size_t size, size_t align);
+
+/**
+ * @brief Release every allocation of the arena at once
+ *
+ * @param arena
+ */
+void BitArena_reset(BitArena *arena);
+
+/**
+ * @brief Allocator drawing from an arena
+ *
+ * @param arena     Arena which must outlive the allocator
+ * @return          Allocator whose free does nothing
+ */
+BitAllocator BitArena_allocator(BitArena *arena);
+
+#endif // !ALLOC_H_
@@ -1,35 +1,138 @@
 #include "bitarr.h"
 #include "bitops.h"
+#include "bitpack.h"
+#include "parallel.h"
+#include <stdatomic.h>
 #include <stdint.h>
+#include <string.h>
 
-BitArray* BitArray_calloc(uint32_t n, uint8_t element_size, size_t word_size)
+size_t BitArray_alloc_size(uint32_t n, uint8_t element_size, size_t word_size)
 {
-    unsigned int n_entries = 1 + (((element_size * n) - 1) / 32);
-    // space for bitarray + space needed for n_entries of word_size
-    BitArray *bitarr = calloc(1, sizeof(BitArray) + (word_size * CHAR_BIT) * n_entries);
-    if (bitarr == NULL) {
-        printf("Couldn't allocate memory for vector.\n");
-        exit(EXIT_FAILURE);
-    }
+    size_t width = word_size * CHAR_BIT;
+    size_t n_entries = ((size_t) element_size * n + width - 1) / width;
+    // Struct, then the words on the next BIT_ALIGN boundary
+    return BIT_ALIGN_UP(sizeof(BitArray)) + BIT_ALIGN_UP(word_size * n_entries);
+}
+
+BitArray* BitArray_calloc_with(uint32_t n, uint8_t element_size,
+  size_t word_size, const BitAllocator *allocator)
+{
+    const size_t bytes = BitArray_alloc_size(n, element_size, word_size);
+    BitArray *bitarr = bit_alloc(allocator, bytes);
+    memset(bitarr, 0, bytes);
     // Set values
     bitarr->element_size = element_size;
-    bitarr->width = word_size * CHAR_BIT;
+    bitarr->width = (uint8_t) (word_size * CHAR_BIT);
     bitarr->n = n;
+    bitarr->v = (uint32_t *) ((char *) bitarr + BIT_ALIGN_UP(sizeof(BitArray)));
 
     return bitarr;
 }
 
+BitArray* BitArray_calloc(uint32_t n, uint8_t element_size, size_t word_size)
+{
+    return BitArray_calloc_with(n, element_size, word_size, &bit_heap_allocator);
+}
+
 void BitArray_free(BitArray *bitarr) {
-    free(bitarr);
+    bit_free(&bit_heap_allocator, bitarr);
+}
+
+void BitArray_free_with(BitArray *bitarr, const BitAllocator *allocator)
+{
+    bit_free(allocator, bitarr);
+}
+
+size_t BitArray_n_words(BitArray *bitarr)
+{
+    return ((size_t) bitarr->n * bitarr->element_size + bitarr->width - 1) /
+      bitarr->width;
 }
 
 BitArray* BitArray_init(unsigned int A[], uint32_t n, uint8_t element_size, size_t word_size)
 {
-    BitArray* bit_arr = BitArray_calloc(n, element_size, word_size);
+    return BitArray_init_with(A, n, element_size, word_size, &bit_heap_allocator);
+}
+
+// -- Building ----------------------------------------------------------------
+static void builder_start(BitArrayBuilder *builder, BitArray *arr)
+{
+    builder->arr = arr;
+    builder->acc = 0;
+    builder->acc_bits = 0;
+    builder->word = 0;
+    builder->count = 0;
+}
+
+BitArray* BitArray_init_with(const unsigned int A[], uint32_t n,
+  uint8_t element_size, size_t word_size, const BitAllocator *allocator)
+{
+    BitArrayBuilder builder;
+    builder_start(&builder, BitArray_calloc_with(n, element_size, word_size, allocator));
     // Compress values from A into BitArray
-    unsigned int i;
-    for (i = 0; i < n; ++i) BitArray_write(bit_arr, i, A[i]);
-    return bit_arr;
+    BitArrayBuilder_push_many(&builder, A, n);
+    return BitArrayBuilder_finish(&builder);
+}
+
+void BitArrayBuilder_begin(BitArrayBuilder *builder, uint32_t n,
+  uint8_t element_size, size_t word_size)
+{
+    builder_start(builder, BitArray_calloc(n, element_size, word_size));
+}
+
+void BitArrayBuilder_push(BitArrayBuilder *builder, unsigned int x)
+{
+    BitArray *arr = builder->arr;
+    if (builder->count >= arr->n) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    x &= 0xFFFFFFFFu >> (32 - arr->element_size);
+    builder->acc |= (uint64_t) x << builder->acc_bits;
+    builder->acc_bits += arr->element_size;
+    builder->count++;
+
+    // Store full word, keep the remaining bits pending
+    if (builder->acc_bits >= arr->width) {
+        arr->v[builder->word++] = (uint32_t) builder->acc;
+        builder->acc >>= arr->width;
+        builder->acc_bits -= arr->width;
+    }
+}
+
+void BitArrayBuilder_push_many(BitArrayBuilder *builder, const unsigned int A[],
+  size_t count)
+{
+    BitArray *arr = builder->arr;
+    if (count > arr->n - builder->count) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    size_t i = 0;
+    // The accumulator is empty on block boundaries
+    for (; i < count && builder->count % BITPACK_BLOCK; ++i) {
+        BitArrayBuilder_push(builder, A[i]);
+    }
+
+    size_t blocks = (count - i) / BITPACK_BLOCK * BITPACK_BLOCK;
+    if (blocks) {
+        bitpack_pack(arr->v, arr->element_size, builder->count, blocks, A + i);
+        builder->count += blocks;
+        builder->word = builder->count * arr->element_size / arr->width;
+        i += blocks;
+    }
+
+    for (; i < count; ++i) BitArrayBuilder_push(builder, A[i]);
+}
+
+BitArray* BitArrayBuilder_finish(BitArrayBuilder *builder)
+{
+    BitArray *arr = builder->arr;
+    if (builder->acc_bits) arr->v[builder->word] = (uint32_t) builder->acc;
+    builder->arr = NULL;
+    return arr;
 }
 
 
@@ -39,8 +142,15 @@ unsigned int BitArray_read(BitArray* bit_arr, unsigned int i)
     fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
     exit(OUT_OF_BOUNDS);
   }
-  return bit_read_range(bit_arr->v, bit_arr->width, i*bit_arr->element_size,
-    (i+1)*bit_arr->element_size-1);
+  return BitArray_read_unchecked(bit_arr, i);
+}
+
+BITARR_ERROR BitArray_read_checked(const BitArray* bit_arr, size_t i,
+  unsigned int *x)
+{
+  if (i >= bit_arr->n) return OUT_OF_BOUNDS;
+  *x = BitArray_read_unchecked(bit_arr, i);
+  return BITARR_SUCCESS;
 }
 
 // -- Writing -----------------------------------------------------------------
@@ -50,8 +160,192 @@ void BitArray_write(BitArray* bit_arr, unsigned int i, unsigned int x)
     fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
     exit(OUT_OF_BOUNDS);
   }
-  bit_write_range(bit_arr->v, bit_arr->width, i*bit_arr->element_size,
-    (i+1)*bit_arr->element_size-1, x);
+  BitArray_write_unchecked(bit_arr, i, x);
+}
+
+BITARR_ERROR BitArray_write_checked(BitArray* bit_arr, size_t i, unsigned int x)
+{
+  if (i >= bit_arr->n) return OUT_OF_BOUNDS;
+  BitArray_write_unchecked(bit_arr, i, x);
+  return BITARR_SUCCESS;
 }
 
+// -- Atomic ------------------------------------------------------------------
+// Locks of elements spanning two words, one cache line each
+#define STRADDLE_LOCKS 64
 
+static struct {
+  _Atomic int held;
+  char pad[64 - sizeof(_Atomic int)];
+} straddle_locks[STRADDLE_LOCKS];
+
+// Lock of the element starting in word w, striped by word
+static _Atomic int* straddle_lock(const uint32_t *w)
+{
+  _Atomic int *l = &straddle_locks[(uintptr_t) w / sizeof(uint32_t) % STRADDLE_LOCKS].held;
+  while (atomic_exchange_explicit(l, 1, memory_order_acquire)) {
+    while (atomic_load_explicit(l, memory_order_relaxed));
+  }
+  return l;
+}
+
+static void straddle_unlock(_Atomic int *l)
+{
+  atomic_store_explicit(l, 0, memory_order_release);
+}
+
+// Replace the bits [off, off + bits) of word w by x
+static void field_store(uint32_t *w, unsigned int off, unsigned int bits,
+  uint32_t x)
+{
+  _Atomic uint32_t *a = (_Atomic uint32_t *) w;
+  const uint32_t mask = (0xFFFFFFFFu >> (32 - bits)) << off,
+                 val = (x << off) & mask;
+  uint32_t old = atomic_load_explicit(a, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(a, &old, (old & ~mask) | val,
+      memory_order_acq_rel, memory_order_relaxed));
+}
+
+// Add x to the bits [off, off + bits) of word w, returning the old field
+// and the carry out of it
+static uint32_t field_add(uint32_t *w, unsigned int off, unsigned int bits,
+  uint64_t x, uint32_t *carry)
+{
+  _Atomic uint32_t *a = (_Atomic uint32_t *) w;
+  const uint32_t m = 0xFFFFFFFFu >> (32 - bits);
+  uint32_t old = atomic_load_explicit(a, memory_order_relaxed), field;
+  uint64_t sum;
+  do {
+    field = (old >> off) & m;
+    sum = field + x;
+  } while (!atomic_compare_exchange_weak_explicit(a, &old,
+      (old & ~(m << off)) | ((uint32_t) sum & m) << off,
+      memory_order_acq_rel, memory_order_relaxed));
+  *carry = (uint32_t) (sum >> bits);
+  return field;
+}
+
+void BitArray_write_atomic(BitArray* bit_arr, size_t i, unsigned int x)
+{
+  if (i >= bit_arr->n) {
+    fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+    exit(OUT_OF_BOUNDS);
+  }
+  const unsigned es = (unsigned) bit_arr->element_size;
+  const size_t bit = i * es, j = bit / 32;
+  const unsigned off = (unsigned) (bit % 32);
+
+  if (off + es <= 32) {
+    field_store(&bit_arr->v[j], off, es, x);
+  } else {
+    const unsigned lo = 32 - off;
+    _Atomic int *l = straddle_lock(&bit_arr->v[j]);
+    field_store(&bit_arr->v[j], off, lo, x);
+    field_store(&bit_arr->v[j + 1], 0, es - lo, x >> lo);
+    straddle_unlock(l);
+  }
+}
+
+unsigned int BitArray_fetch_add_atomic(BitArray* bit_arr, size_t i,
+  unsigned int x)
+{
+  if (i >= bit_arr->n) {
+    fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+    exit(OUT_OF_BOUNDS);
+  }
+  const unsigned es = (unsigned) bit_arr->element_size;
+  const size_t bit = i * es, j = bit / 32;
+  const unsigned off = (unsigned) (bit % 32);
+  const uint32_t m = 0xFFFFFFFFu >> (32 - es);
+  uint32_t carry;
+
+  if (off + es <= 32) return field_add(&bit_arr->v[j], off, es, x & m, &carry);
+
+  /*
+   * Low bits first, their carry goes into the high word. The lock keeps
+   * both halves from one update of the element, the compare and swap still
+   * guards the neighbours sharing the words.
+   */
+  const unsigned lo = 32 - off;
+  _Atomic int *l = straddle_lock(&bit_arr->v[j]);
+  const uint32_t low = field_add(&bit_arr->v[j], off, lo, x & (m >> (es - lo)), &carry),
+                 high = field_add(&bit_arr->v[j + 1], 0, es - lo,
+                   (uint64_t) ((x & m) >> lo) + carry, &carry);
+  straddle_unlock(l);
+  return low | high << lo;
+}
+
+
+
+// -- Bulk --------------------------------------------------------------------
+void BitArray_unpack(BitArray* bit_arr, size_t start, size_t count,
+  uint32_t out[])
+{
+  if (start > bit_arr->n || count > bit_arr->n - start) {
+    fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+    exit(OUT_OF_BOUNDS);
+  }
+  bitpack_unpack(bit_arr->v, BitArray_n_words(bit_arr), bit_arr->element_size,
+    start, count, out);
+}
+
+void BitArray_pack(BitArray* bit_arr, size_t start, size_t count,
+  const uint32_t in[])
+{
+  if (start > bit_arr->n || count > bit_arr->n - start) {
+    fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+    exit(OUT_OF_BOUNDS);
+  }
+  bitpack_pack(bit_arr->v, bit_arr->element_size, start, count, in);
+}
+
+
+// -- Parallel ----------------------------------------------------------------
+typedef struct {
+  BitArray *arr;
+  const uint32_t *in;
+  uint32_t *out;
+  size_t start;
+  size_t count;
+  size_t chunk;
+} BitArrayJob;
+
+static void BitArray_pack_task(void *ctx, size_t task)
+{
+    const BitArrayJob *job = ctx;
+    const size_t i = task * job->chunk,
+                 count = job->count - i < job->chunk ? job->count - i : job->chunk;
+    bitpack_pack(job->arr->v, job->arr->element_size, i, count, job->in + i);
+}
+
+static void BitArray_unpack_task(void *ctx, size_t task)
+{
+    const BitArrayJob *job = ctx;
+    const size_t i = task * job->chunk,
+                 count = job->count - i < job->chunk ? job->count - i : job->chunk;
+    bitpack_unpack(job->arr->v, BitArray_n_words(job->arr), job->arr->element_size,
+      job->start + i, count, job->out + i);
+}
+
+BitArray* BitArray_init_parallel(const unsigned int A[], uint32_t length,
+  uint8_t element_size, size_t word_size, unsigned int n_threads)
+{
+    BitArrayJob job = { BitArray_calloc(length, element_size, word_size), A,
+      NULL, 0, length, parallel_chunk(length, n_threads, BITPACK_BLOCK) };
+    parallel_for((length + job.chunk - 1) / job.chunk, n_threads,
+      BitArray_pack_task, &job);
+    return job.arr;
+}
+
+void BitArray_unpack_parallel(BitArray* bit_arr, size_t start, size_t count,
+  uint32_t out[], unsigned int n_threads)
+{
+  if (start > bit_arr->n || count > bit_arr->n - start) {
+    fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+    exit(OUT_OF_BOUNDS);
+  }
+  BitArrayJob job = { bit_arr, NULL, out, start, count,
+    parallel_chunk(count, n_threads, BITPACK_BLOCK) };
+  parallel_for((count + job.chunk - 1) / job.chunk, n_threads,
+    BitArray_unpack_task, &job);
+}
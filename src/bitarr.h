@@ -66,6 +66,7 @@
 #include <limits.h>
 #include "bitops.h"
 #include "common.h"
+#include "alloc.h"
 
 
 
@@ -81,17 +82,47 @@
  *  number of bits of each member in v (e.g. 32)
  * @var BitArray.n
  *  Length of original array
- * @var BitArray.v[]
- *  compressed version of A (v)
+ * @var BitArray.v
+ *  compressed version of A (v). Points BIT_ALIGN_UP(sizeof(BitArray)) bytes
+ *  past the struct for arrays allocated with BitArray_calloc, so it is
+ *  BIT_ALIGN aligned, or into a file mapping (see bitarr_io.h)
  */
 typedef struct {
   size_t element_size;
   uint8_t width;
   uint32_t n;
-  unsigned int v[];
+  uint32_t *v;
 } BitArray;
 
 
+/**
+ * @struct BitArrayBuilder
+ *
+ * Streaming construction of a BitArray. Values are shifted into a 64 bit
+ * accumulator and each word of the compact array is stored exactly once, when
+ * it is full. Values can be supplied in any number of chunks, so the original
+ * array never needs to be held in memory as a whole.
+ *
+ * @var BitArrayBuilder.arr
+ *  BitArray under construction
+ * @var BitArrayBuilder.acc
+ *  Bits pushed but not yet stored in arr->v
+ * @var BitArrayBuilder.acc_bits
+ *  Number of pending bits in acc
+ * @var BitArrayBuilder.word
+ *  Index of the next word of arr->v to store
+ * @var BitArrayBuilder.count
+ *  Number of values pushed so far
+ */
+typedef struct {
+  BitArray *arr;
+  uint64_t acc;
+  size_t acc_bits;
+  size_t word;
+  size_t count;
+} BitArrayBuilder;
+
+
 /**
  * @brief Allocate empty BitArray with values set to 0 on the heap
  *
@@ -108,6 +139,45 @@ BitArray* BitArray_calloc(uint32_t n, uint8_t element_size, size_t word_size);
  */
 void BitArray_free(BitArray *bitarr);
 
+/**
+ * @brief Bytes of the single allocation holding a BitArray and its values
+ *
+ * Used to size arenas (see alloc.h).
+ *
+ * @param n             Number of elements
+ * @param element_size  Size in bits of each element
+ * @param word_size     Size in bytes of each word
+ */
+size_t BitArray_alloc_size(uint32_t n, uint8_t element_size, size_t word_size);
+
+/**
+ * @brief BitArray_calloc drawing its memory from an allocator
+ *
+ * @param n             Number of elements
+ * @param element_size  Size in bits of each element
+ * @param word_size     Size in bytes of each word
+ * @param allocator     Allocator providing BitArray_alloc_size bytes
+ * @return              Pointer to BitArray, release with BitArray_free_with
+ */
+BitArray* BitArray_calloc_with(uint32_t n, uint8_t element_size,
+  size_t word_size, const BitAllocator *allocator);
+
+/**
+ * @brief Free BitArray allocated with BitArray_calloc_with
+ *
+ * @param bitarr
+ * @param allocator     Allocator bitarr came from
+ */
+void BitArray_free_with(BitArray *bitarr, const BitAllocator *allocator);
+
+/**
+ * @brief Number of words used by the compact array
+ *
+ * @param bitarr
+ * @return ceil((element_size * n) / width)
+ */
+size_t BitArray_n_words(BitArray *bitarr);
+
 /**
  * @brief Initialize and populate a BitArray on the heap from an array
  *
@@ -119,6 +189,64 @@ void BitArray_free(BitArray *bitarr);
 BitArray* BitArray_init(unsigned int A[], uint32_t length, uint8_t element_size,
   size_t word_size);
 
+/**
+ * @brief BitArray_init drawing its memory from an allocator
+ *
+ * @param A             1d array
+ * @param length        Number of elements in A
+ * @param element_size  Size in bits of each element
+ * @param word_size     Size in bytes of each word
+ * @param allocator     Allocator providing BitArray_alloc_size bytes
+ * @return              Pointer to BitArray, release with BitArray_free_with
+ */
+BitArray* BitArray_init_with(const unsigned int A[], uint32_t length,
+  uint8_t element_size, size_t word_size, const BitAllocator *allocator);
+
+
+/**
+ * @brief Start building a BitArray of n elements
+ *
+ * @param builder       Builder to initialize
+ * @param n             Number of elements in the final array
+ * @param element_size  Size in bits of each element
+ * @param word_size     Size in bytes of each word
+ */
+void BitArrayBuilder_begin(BitArrayBuilder *builder, uint32_t n,
+  uint8_t element_size, size_t word_size);
+
+/**
+ * @brief Append a single value
+ *
+ * Bits of x above element_size are ignored.
+ *
+ * @param builder   Builder started with BitArrayBuilder_begin
+ * @param x         Value to append
+ */
+void BitArrayBuilder_push(BitArrayBuilder *builder, unsigned int x);
+
+/**
+ * @brief Append a chunk of values
+ *
+ * Whole blocks of 32 values are packed directly into their words (see
+ * bitpack.h) without passing through the accumulator.
+ *
+ * @param builder   Builder started with BitArrayBuilder_begin
+ * @param A         Values to append
+ * @param count     Number of values in A
+ */
+void BitArrayBuilder_push_many(BitArrayBuilder *builder, const unsigned int A[],
+  size_t count);
+
+/**
+ * @brief Flush pending bits and return the finished BitArray
+ *
+ * Elements which were never pushed read as 0. The builder no longer owns the
+ * array afterwards.
+ *
+ * @param builder   Builder started with BitArrayBuilder_begin
+ * @return          Pointer to BitArray
+ */
+BitArray* BitArrayBuilder_finish(BitArrayBuilder *builder);
 
 
 /**
@@ -143,4 +271,168 @@ unsigned int BitArray_read(BitArray* bit_arr, unsigned int i);
  */
 void BitArray_write(BitArray* bit_arr, unsigned int i, unsigned int x);
 
+/**
+ * @brief BitArray_read returning an error instead of exiting
+ *
+ * @param bit_arr Pointer to BitArray
+ * @param i       Index in array to read
+ * @param x       Receives the value at A[i], untouched on error
+ * @return        OUT_OF_BOUNDS if i >= n, BITARR_SUCCESS otherwise
+ */
+BITARR_ERROR BitArray_read_checked(const BitArray* bit_arr, size_t i,
+  unsigned int *x);
+
+/**
+ * @brief BitArray_write returning an error instead of exiting
+ *
+ * @param bit_arr Pointer to BitArray
+ * @param i       Index in array to write
+ * @param x       Integer to write
+ * @return        OUT_OF_BOUNDS if i >= n, BITARR_SUCCESS otherwise
+ */
+BITARR_ERROR BitArray_write_checked(BitArray* bit_arr, size_t i, unsigned int x);
+
+
+// -- Atomic ------------------------------------------------------------------
+/*
+ * Neighbouring elements share words, so threads writing different indexes
+ * with BitArray_write can overwrite each other's bits. The atomic variants
+ * update only the bits of element i with a compare and swap on each word it
+ * touches, so concurrent updates of any indexes are never lost.
+ *
+ * An element spanning two words is updated one word at a time, under one
+ * of a few spin locks picked by its first word. Atomic updates of it are
+ * serialized, so fetch_add returns a value the element held, but a plain
+ * reader may observe the element between the two word updates.
+ */
+
+/**
+ * @brief BitArray_write, safe against concurrent updates of other indexes
+ *
+ * Bits of x above element_size are ignored.
+ *
+ * @param bit_arr Pointer to BitArray
+ * @param i       Index in array to write
+ * @param x       Integer to write
+ */
+void BitArray_write_atomic(BitArray* bit_arr, size_t i, unsigned int x);
+
+/**
+ * @brief Atomically add x to the value at index i, modulo 2^element_size
+ *
+ * @param bit_arr Pointer to BitArray
+ * @param i       Index in array to update
+ * @param x       Integer to add
+ * @return        Value at A[i] before the addition
+ */
+unsigned int BitArray_fetch_add_atomic(BitArray* bit_arr, size_t i,
+  unsigned int x);
+
+
+// -- Unchecked ---------------------------------------------------------------
+/*
+ * For loops which have validated their range already. The index is not
+ * checked, and an element spanning two words is handled without a branch:
+ * the word after it is always loaded, which is the same word again when the
+ * element fits (see bitarr_static.h for the compile time sized version).
+ */
+
+/**
+ * @brief Get value at index i, i < n is not checked
+ *
+ * @param bit_arr Pointer to BitArray
+ * @param i       Index in array to read
+ * @return        Value at A[i]
+ */
+static inline unsigned int BitArray_read_unchecked(const BitArray* bit_arr, size_t i)
+{
+    const unsigned es = (unsigned) bit_arr->element_size;
+    const size_t bit = i * es, j = bit / 32;
+    const unsigned off = (unsigned) (bit % 32);
+    const uint64_t pair = bit_arr->v[j] |
+      (uint64_t) bit_arr->v[j + (off + es > 32)] << 32;
+    return (unsigned int) (pair >> off) & (0xFFFFFFFFu >> (32 - es));
+}
+
+/**
+ * @brief Write value at index i, i < n is not checked
+ *
+ * Bits of x above element_size are ignored.
+ *
+ * @param bit_arr Pointer to BitArray
+ * @param i       Index in array to write
+ * @param x       Integer to write
+ */
+static inline void BitArray_write_unchecked(BitArray* bit_arr, size_t i, unsigned int x)
+{
+    const unsigned es = (unsigned) bit_arr->element_size;
+    const size_t bit = i * es, j = bit / 32;
+    const unsigned off = (unsigned) (bit % 32);
+    const uint64_t mask = (uint64_t) (0xFFFFFFFFu >> (32 - es)) << off,
+                   val = ((uint64_t) x << off) & mask;
+    bit_arr->v[j] = (bit_arr->v[j] & ~(uint32_t) mask) | (uint32_t) val;
+    uint32_t *hi = &bit_arr->v[j + (off + es > 32)];
+    *hi = (*hi & ~(uint32_t) (mask >> 32)) | (uint32_t) (val >> 32);
+}
+
+/**
+ * @brief Decode a range of values from the compact array
+ *
+ * Equivalent to calling BitArray_read for each index in
+ * [start, start + count), but bounds are checked once and whole words are
+ * decoded at a time (see bitpack.h).
+ *
+ * @param bit_arr Pointer to BitArray
+ * @param start   Index of first value to read
+ * @param count   Number of values to read
+ * @param out     Array of at least count values receiving A[start..]
+ */
+void BitArray_unpack(BitArray* bit_arr, size_t start, size_t count,
+  uint32_t out[]);
+
+/**
+ * @brief Encode a range of values into the compact array
+ *
+ * Equivalent to calling BitArray_write for each index in
+ * [start, start + count), but bounds are checked once and whole words are
+ * encoded at a time (see bitpack.h).
+ *
+ * @param bit_arr Pointer to BitArray
+ * @param start   Index of first value to write
+ * @param count   Number of values to write
+ * @param in      Values to write
+ */
+void BitArray_pack(BitArray* bit_arr, size_t start, size_t count,
+  const uint32_t in[]);
+
+
+/**
+ * @brief BitArray_init on several threads
+ *
+ * A is split at multiples of BITPACK_BLOCK elements, which always end on a
+ * word boundary, so threads never write the same word. The result is
+ * identical to BitArray_init.
+ *
+ * @param A             1d array
+ * @param length        Number of elements in A
+ * @param element_size  Size in bits of each element
+ * @param word_size     Size in bytes of each word
+ * @param n_threads     Number of threads, 0 for one per online CPU
+ * @return              pointer to BitArray
+ */
+BitArray* BitArray_init_parallel(const unsigned int A[], uint32_t length,
+  uint8_t element_size, size_t word_size, unsigned int n_threads);
+
+/**
+ * @brief BitArray_unpack on several threads
+ *
+ * @param bit_arr   Pointer to BitArray
+ * @param start     Index of first value to read
+ * @param count     Number of values to read
+ * @param out       Array of at least count values receiving A[start..]
+ * @param n_threads Number of threads, 0 for one per online CPU
+ */
+void BitArray_unpack_parallel(BitArray* bit_arr, size_t start, size_t count,
+  uint32_t out[], unsigned int n_threads);
+
 #endif // BITARR_H_
@@ -0,0 +1,71 @@
+#include "bitarr64.h"
+#include "bitops.h"
+#include <stdint.h>
+
+BitArray64* BitArray64_calloc(uint64_t n, uint8_t element_size)
+{
+    if (element_size == 0 || element_size > 64) {
+        fprintf(stderr, "%s:%d Element size must be 1-64 bits\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    uint64_t n_entries = (element_size * n + 63) / 64;
+    // space for bitarray + space needed for n_entries of 64 bit words
+    BitArray64 *bitarr = calloc(1, sizeof(BitArray64) + sizeof(uint64_t) * n_entries);
+    if (bitarr == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    // Set values
+    bitarr->element_size = element_size;
+    bitarr->width = 64;
+    bitarr->n = n;
+
+    return bitarr;
+}
+
+void BitArray64_free(BitArray64 *bitarr) {
+    free(bitarr);
+}
+
+uint64_t BitArray64_n_words(BitArray64 *bitarr)
+{
+    return (bitarr->element_size * bitarr->n + 63) / 64;
+}
+
+BitArray64* BitArray64_init(const uint64_t A[], uint64_t n, uint8_t element_size)
+{
+    BitArray64* bit_arr = BitArray64_calloc(n, element_size);
+    const uint64_t mask = ~(uint64_t) 0 >> (64 - element_size);
+
+    // Words start out zeroed, so values are OR'd in without clearing
+    uint64_t j = 0;
+    for (uint64_t i = 0; i < n; ++i, j += element_size) {
+        const uint64_t x = A[i] & mask, off = j % 64;
+        bit_arr->v[j/64] |= x << off;
+        if (off + element_size > 64) bit_arr->v[j/64 + 1] = x >> (64 - off);
+    }
+    return bit_arr;
+}
+
+
+uint64_t BitArray64_read(BitArray64* bit_arr, uint64_t i)
+{
+  if (i >= bit_arr->n) {
+    fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+    exit(OUT_OF_BOUNDS);
+  }
+  return bit_read_range64(bit_arr->v, i*bit_arr->element_size,
+    (i+1)*bit_arr->element_size-1);
+}
+
+// -- Writing -----------------------------------------------------------------
+void BitArray64_write(BitArray64* bit_arr, uint64_t i, uint64_t x)
+{
+  if (i >= bit_arr->n) {
+    fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+    exit(OUT_OF_BOUNDS);
+  }
+  bit_write_range64(bit_arr->v, i*bit_arr->element_size,
+    (i+1)*bit_arr->element_size-1, x);
+}
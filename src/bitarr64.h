@@ -0,0 +1,105 @@
+/**
+ * @file
+ * @brief Compact array representation on 64 bit words
+ *
+ * BitArray64 is the wide counterpart of BitArray (see bitarr.h). Elements are
+ * laid out exactly the same way, least significant bit first, but are stored
+ * in 64 bit words and indexed with 64 bit lengths. This allows:
+ *
+ *  - more than 2^32 elements per array
+ *  - elements up to 64 bits wide
+ *  - half as many elements crossing a word boundary for wide elements
+ *
+ * An element crossing a word boundary is still read with two loads.
+ *
+ * On little endian machines the byte representation of v is identical to
+ * the one of a BitArray holding the same values.
+ */
+
+#ifndef BITARR64_H_
+#define BITARR64_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "bitops.h"
+#include "common.h"
+
+
+/**
+ * @struct BitArray64
+ *
+ * @var BitArray64.element_size
+ *  number of bits to store each value in A (1-64)
+ * @var BitArray64.width
+ *  number of bits of each member in v (64)
+ * @var BitArray64.n
+ *  Length of original array
+ * @var BitArray64.v[]
+ *  compressed version of A (v)
+ */
+typedef struct {
+  uint8_t element_size;
+  uint8_t width;
+  uint64_t n;
+  uint64_t v[];
+} BitArray64;
+
+
+/**
+ * @brief Allocate empty BitArray64 with values set to 0 on the heap
+ *
+ * @param n             Number of elements
+ * @param element_size  Size in bits of each element (1-64)
+ * @return              Pointer to BitArray64
+ */
+BitArray64* BitArray64_calloc(uint64_t n, uint8_t element_size);
+
+/**
+ * @brief Free BitArray64 allocated on the heap
+ *
+ * @param bitarr
+ */
+void BitArray64_free(BitArray64 *bitarr);
+
+/**
+ * @brief Number of words used by the compact array
+ *
+ * @param bitarr
+ * @return ceil((element_size * n) / 64)
+ */
+uint64_t BitArray64_n_words(BitArray64 *bitarr);
+
+/**
+ * @brief Initialize and populate a BitArray64 on the heap from an array
+ *
+ * @param A             1d array
+ * @param n             Number of elements in A
+ * @param element_size  Maximum number of bits for each element in A
+ * @return              pointer to BitArray64
+ */
+BitArray64* BitArray64_init(const uint64_t A[], uint64_t n,
+  uint8_t element_size);
+
+/**
+ * @brief Get value from original array at index i
+ *
+ * @param bit_arr
+ * @param i
+ * @return Value at A[i]
+ */
+uint64_t BitArray64_read(BitArray64* bit_arr, uint64_t i);
+
+/**
+ * @brief Write value to compact bit representation of array
+ *
+ * Bits of x above element_size are ignored.
+ *
+ * @param bit_arr Pointer to BitArray64
+ * @param i       Index in array to write
+ * @param x       Integer to write
+ */
+void BitArray64_write(BitArray64* bit_arr, uint64_t i, uint64_t x);
+
+#endif // BITARR64_H_
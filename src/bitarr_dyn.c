@@ -0,0 +1,141 @@
+/**
+ * @file
+ * @brief Growable BitArray with automatic width promotion
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitarr_dyn.h"
+#include "bitops.h"
+#include "bitpack.h"
+
+// Mask of the lowest w bits, valid for w in [1, 32]
+#define MASK(w) (0xFFFFFFFFu >> (32 - (w)))
+
+// Words holding n values of w bits
+#define N_WORDS(n, w) (((size_t) (n) * (w) + 31) / 32)
+
+// Bits needed to store x
+static inline uint8_t dyn_bits(uint32_t x)
+{
+    return x ? (uint8_t) (msb64(x) + 1) : 1;
+}
+
+// Grow arr.v to at least words words, the new ones zeroed
+static void dyn_realloc(DynBitArray *dyn, size_t words)
+{
+    if (words <= dyn->n_words) return;
+    uint32_t *v = realloc(dyn->arr.v, sizeof(uint32_t) * words);
+    if (v == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(v + dyn->n_words, 0, sizeof(uint32_t) * (words - dyn->n_words));
+    dyn->arr.v = v;
+    dyn->n_words = words;
+}
+
+// Room for needed values, doubling the capacity
+static void dyn_grow(DynBitArray *dyn, size_t needed)
+{
+    if (needed <= dyn->capacity) return;
+    size_t capacity = dyn->capacity ? dyn->capacity * 2 : DYN_MIN_CAPACITY;
+    if (capacity < needed) capacity = needed;
+    if (capacity > UINT32_MAX && needed <= UINT32_MAX) capacity = UINT32_MAX;
+    DynBitArray_reserve(dyn, capacity);
+}
+
+DynBitArray* DynBitArray_init(uint8_t element_size)
+{
+    if (element_size < 1 || element_size > 32) {
+        fprintf(stderr, "%s:%d Element size out of range\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+    DynBitArray *dyn = malloc(sizeof(DynBitArray));
+    if (dyn == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    dyn->arr.element_size = element_size;
+    dyn->arr.width = 32;
+    dyn->arr.n = 0;
+    dyn->arr.v = NULL;
+    dyn->capacity = 0;
+    dyn->n_words = 0;
+    return dyn;
+}
+
+void DynBitArray_free(DynBitArray *dyn)
+{
+    free(dyn->arr.v);
+    free(dyn);
+}
+
+void DynBitArray_reserve(DynBitArray *dyn, size_t capacity)
+{
+    if (capacity > UINT32_MAX) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+    if (capacity <= dyn->capacity) return;
+    dyn_realloc(dyn, N_WORDS(capacity, dyn->arr.element_size));
+    dyn->capacity = capacity;
+}
+
+void DynBitArray_widen(DynBitArray *dyn, uint8_t element_size)
+{
+    const size_t w = dyn->arr.element_size, n = dyn->arr.n;
+    if (element_size > 32) {
+        fprintf(stderr, "%s:%d Element size out of range\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+    if (element_size <= w) return;
+
+    const size_t old_words = N_WORDS(n, w);
+    dyn_realloc(dyn, N_WORDS(dyn->capacity, element_size));
+
+    /*
+     * Block by block from the end. Values before a block end at or below
+     * its new start, so they are never overwritten before being read, and
+     * every bit up to n * element_size is rewritten.
+     */
+    uint32_t buf[BITPACK_BLOCK];
+    for (size_t end = n; end > 0;) {
+        const size_t start = (end - 1) / BITPACK_BLOCK * BITPACK_BLOCK;
+        bitpack_unpack(dyn->arr.v, old_words, w, start, end - start, buf);
+        bitpack_pack(dyn->arr.v, element_size, start, end - start, buf);
+        end = start;
+    }
+    dyn->arr.element_size = element_size;
+}
+
+void DynBitArray_push_back(DynBitArray *dyn, uint32_t x)
+{
+    if (x > MASK(dyn->arr.element_size)) DynBitArray_widen(dyn, dyn_bits(x));
+    dyn_grow(dyn, (size_t) dyn->arr.n + 1);
+    BitArray_write_unchecked(&dyn->arr, dyn->arr.n++, x);
+}
+
+void DynBitArray_append_many(DynBitArray *dyn, const uint32_t A[], size_t count)
+{
+    // The OR of the values has the same highest bit as their maximum
+    uint32_t any = 0;
+    for (size_t i = 0; i < count; ++i) any |= A[i];
+    if (any > MASK(dyn->arr.element_size)) DynBitArray_widen(dyn, dyn_bits(any));
+
+    dyn_grow(dyn, (size_t) dyn->arr.n + count);
+    bitpack_pack(dyn->arr.v, dyn->arr.element_size, dyn->arr.n, count, A);
+    dyn->arr.n += (uint32_t) count;
+}
+
+BitArray* DynBitArray_to_BitArray(const DynBitArray *dyn)
+{
+    BitArray *bitarr = BitArray_calloc(dyn->arr.n, (uint8_t) dyn->arr.element_size,
+      sizeof(uint32_t));
+    if (dyn->arr.n) {
+        memcpy(bitarr->v, dyn->arr.v,
+          sizeof(uint32_t) * N_WORDS(dyn->arr.n, dyn->arr.element_size));
+    }
+    return bitarr;
+}
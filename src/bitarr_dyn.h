@@ -0,0 +1,105 @@
+/**
+ * @file
+ * @brief Growable BitArray with automatic width promotion
+ *
+ * Values are appended one at a time or in chunks. Capacity grows
+ * geometrically, so appending is amortized O(1) per value. A value wider
+ * than the current element_size widens the whole array first: the values
+ * are repacked in place, from the last block of BITPACK_BLOCK values down
+ * to the first, since a value never moves below where it was read from.
+ * The width only ever grows to the bits of the largest value seen, and at
+ * most 31 times, so no pass to find the maximum is needed up front.
+ *
+ * The values live in an ordinary BitArray (arr), which every BitArray
+ * function reading or writing existing elements accepts. It must not be
+ * passed to BitArray_free.
+ */
+
+#ifndef BITARR_DYN_H_
+#define BITARR_DYN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bitarr.h"
+
+// Capacity allocated by the first append
+#define DYN_MIN_CAPACITY 64
+
+/**
+ * @struct DynBitArray
+ *
+ * @var DynBitArray.arr
+ *  Values appended so far, arr.n of them
+ * @var DynBitArray.capacity
+ *  Number of values arr.v has room for at the current width
+ * @var DynBitArray.n_words
+ *  Number of words allocated for arr.v, those past the values are zero
+ */
+typedef struct {
+  BitArray arr;
+  size_t capacity;
+  size_t n_words;
+} DynBitArray;
+
+/**
+ * @brief Create an empty array
+ *
+ * @param element_size  Initial size in bits of each element (1-32)
+ * @return              Pointer to DynBitArray
+ */
+DynBitArray* DynBitArray_init(uint8_t element_size);
+
+/**
+ * @brief Free the array and its values
+ *
+ * @param dyn
+ */
+void DynBitArray_free(DynBitArray *dyn);
+
+/**
+ * @brief Make room for capacity values at the current width
+ *
+ * @param dyn
+ * @param capacity  Number of values, at most UINT32_MAX
+ */
+void DynBitArray_reserve(DynBitArray *dyn, size_t capacity);
+
+/**
+ * @brief Repack every value to a larger element_size
+ *
+ * Does nothing if element_size is not larger than the current one.
+ *
+ * @param dyn
+ * @param element_size  New size in bits of each element (1-32)
+ */
+void DynBitArray_widen(DynBitArray *dyn, uint8_t element_size);
+
+/**
+ * @brief Append one value, widening the array if it does not fit
+ *
+ * @param dyn
+ * @param x     Value to append
+ */
+void DynBitArray_push_back(DynBitArray *dyn, uint32_t x);
+
+/**
+ * @brief Append count values
+ *
+ * The array is widened at most once, to fit the widest value of A, and the
+ * values are packed in bulk (see bitpack.h).
+ *
+ * @param dyn
+ * @param A         Values to append
+ * @param count     Number of values in A
+ */
+void DynBitArray_append_many(DynBitArray *dyn, const uint32_t A[], size_t count);
+
+/**
+ * @brief Copy the values into a BitArray of exactly their size
+ *
+ * @param dyn
+ * @return      Pointer to BitArray, released with BitArray_free
+ */
+BitArray* DynBitArray_to_BitArray(const DynBitArray *dyn);
+
+#endif // !BITARR_DYN_H_
@@ -0,0 +1,152 @@
+/**
+ * @file
+ * @brief Batched random reads with software prefetching
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bitarr_gather.h"
+
+// Bits of the index sorted per radix pass
+#define GATHER_RADIX 11
+
+#if defined(__GNUC__) || defined(__clang__)
+#define GATHER_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define GATHER_PREFETCH(p) ((void) (p))
+#endif
+
+// Index of the batch and where its value goes in out
+typedef struct {
+  size_t idx;
+  size_t pos;
+} GatherItem;
+
+/*
+ * LSD radix sort of the batch by index, over the bits the largest index
+ * uses. buf holds 2 * count items, the sorted half is returned.
+ */
+static GatherItem* gather_sort(const size_t idx[], size_t count, GatherItem *buf)
+{
+    GatherItem *a = buf, *b = buf + count;
+    const size_t mask = ((size_t) 1 << GATHER_RADIX) - 1;
+    size_t max = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        a[i].idx = idx[i];
+        a[i].pos = i;
+        max |= idx[i];
+    }
+    for (unsigned shift = 0; shift < 64 && max >> shift; shift += GATHER_RADIX) {
+        size_t offsets[1 << GATHER_RADIX] = {0};
+        for (size_t i = 0; i < count; ++i) offsets[a[i].idx >> shift & mask]++;
+        for (size_t d = 0, sum = 0; d <= mask; ++d) {
+            const size_t c = offsets[d];
+            offsets[d] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < count; ++i) b[offsets[a[i].idx >> shift & mask]++] = a[i];
+
+        GatherItem *t = a;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Visit order of the batch, NULL to read idx as given
+static const GatherItem* gather_plan(const size_t idx[], size_t count,
+  unsigned int flags, GatherItem **buf)
+{
+    *buf = NULL;
+    if (!(flags & GATHER_SORT) || count < 2) return NULL;
+    if ((*buf = malloc(sizeof(GatherItem) * 2 * count)) == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    return gather_sort(idx, count, *buf);
+}
+
+// Index read at step i
+static inline size_t gather_index(const size_t idx[], const GatherItem *items,
+  size_t i)
+{
+    return items ? items[i].idx : idx[i];
+}
+
+// Position in out of step i
+static inline size_t gather_pos(const GatherItem *items, size_t i)
+{
+    return items ? items[i].pos : i;
+}
+
+static void gather_out_of_bounds(GatherItem *buf)
+{
+    free(buf);
+    fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+    exit(OUT_OF_BOUNDS);
+}
+
+
+// -- Fixed width -------------------------------------------------------------
+void BitArray_gather(const BitArray *bitarr, const size_t idx[], size_t count,
+  uint32_t out[], unsigned int flags)
+{
+    GatherItem *buf;
+    const GatherItem *items = gather_plan(idx, count, flags, &buf);
+    const size_t n = bitarr->n, es = bitarr->element_size;
+
+    for (size_t i = 0; i < count; ++i) {
+        if (i + GATHER_DISTANCE < count) {
+            const size_t ahead = gather_index(idx, items, i + GATHER_DISTANCE);
+            if (ahead < n) GATHER_PREFETCH(&bitarr->v[ahead * es / 32]);
+        }
+        const size_t j = gather_index(idx, items, i);
+        if (j >= n) gather_out_of_bounds(buf);
+        out[gather_pos(items, i)] = BitArray_read_unchecked(bitarr, j);
+    }
+    free(buf);
+}
+
+
+// -- Variable length ---------------------------------------------------------
+/*
+ * Two stage prefetch: the sample of the value 2 * GATHER_DISTANCE ahead,
+ * and the codes of the value GATHER_DISTANCE ahead, whose sample has had
+ * time to arrive by then.
+ */
+void VLBitArray_gather(const VLBitArray *bit_arr, const size_t idx[],
+  size_t count, uint32_t out[], unsigned int flags)
+{
+    GatherItem *buf;
+    const GatherItem *items = gather_plan(idx, count, flags, &buf);
+    const size_t n = bit_arr->length, k = bit_arr->k;
+
+    VLBitArrayIter it;
+    size_t last = SIZE_MAX;
+    uint32_t value = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (i + 2 * GATHER_DISTANCE < count) {
+            const size_t ahead = gather_index(idx, items, i + 2 * GATHER_DISTANCE);
+            if (ahead < n) GATHER_PREFETCH(&bit_arr->P[ahead / k]);
+        }
+        if (i + GATHER_DISTANCE < count) {
+            const size_t ahead = gather_index(idx, items, i + GATHER_DISTANCE);
+            if (ahead < n) GATHER_PREFETCH(&bit_arr->W[bit_arr->P[ahead / k] / 32]);
+        }
+
+        const size_t j = gather_index(idx, items, i);
+        if (j >= n) gather_out_of_bounds(buf);
+        if (j != last) {
+            // Decoding on from the last value costs less than from the sample
+            if (last == SIZE_MAX || j < it.i || j - it.i > j % k) {
+                VLBitArray_iter(&it, bit_arr, j);
+            }
+            while (it.i < j) VLBitArray_iter_next(&it);
+            value = VLBitArray_iter_next(&it);
+            last = j;
+        }
+        out[gather_pos(items, i)] = value;
+    }
+    free(buf);
+}
@@ -0,0 +1,63 @@
+/**
+ * @file
+ * @brief Batched random reads with software prefetching
+ *
+ * Reading random indexes one at a time waits for every cache miss before
+ * the next read starts. A gather knows the whole batch up front, so it
+ * prefetches the words of the value GATHER_DISTANCE positions ahead while
+ * the current one is read, keeping several misses in flight.
+ *
+ * A VLBitArray read decodes from the sample before the index. Its gather
+ * first prefetches the sample, then the words it points to, and continues
+ * decoding from the previous value instead of seeking when the next index
+ * lies ahead of it in the same stretch of codes.
+ *
+ * With GATHER_SORT the indexes are first radix sorted and the values are
+ * read in increasing index order, written back to their position in the
+ * batch. This matters most for a VLBitArray: once sorted, indexes sharing a
+ * sample are decoded in one pass, and a batch holding several indexes per
+ * sample gets several times faster. A BitArray read is a single load, which
+ * the prefetches already overlap, and sorting usually costs more than it
+ * saves there.
+ */
+
+#ifndef BITARR_GATHER_H_
+#define BITARR_GATHER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bitarr.h"
+#include "bitarr_vl.h"
+
+// Values between a prefetch and the read it is for
+#define GATHER_DISTANCE 16
+
+typedef enum {
+  GATHER_SORT = 1 << 0      // Read in increasing index order
+} GATHER_FLAG;
+
+/**
+ * @brief out[i] = A[idx[i]] for i < count
+ *
+ * @param bitarr
+ * @param idx       Indexes to read, each below n, repeats allowed
+ * @param count     Number of indexes
+ * @param out       Array with room for count values
+ * @param flags     Bitmask of GATHER_FLAG values, 0 for none
+ */
+void BitArray_gather(const BitArray *bitarr, const size_t idx[], size_t count,
+  uint32_t out[], unsigned int flags);
+
+/**
+ * @brief out[i] = A[idx[i]] for i < count
+ *
+ * @param bit_arr
+ * @param idx       Indexes to read, each below length, repeats allowed
+ * @param count     Number of indexes
+ * @param out       Array with room for count values
+ * @param flags     Bitmask of GATHER_FLAG values, 0 for none
+ */
+void VLBitArray_gather(const VLBitArray *bit_arr, const size_t idx[],
+  size_t count, uint32_t out[], unsigned int flags);
+
+#endif // !BITARR_GATHER_H_
@@ -1,26 +1,269 @@
+#define _POSIX_C_SOURCE 200809L
 #include "bitarr_io.h"
+#include "crc32c.h"
+#include "bitpack.h"
+#include <stddef.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-void BitArray_save(BitArray* bitarr, FILE *fp)
+/*
+ * BitArray handed out by BitArray_mmap. map is NULL when the payload had to
+ * be copied to the heap (version 1 files).
+ */
+typedef struct {
+    BitArray arr;
+    BitFileHeader header;
+    void *map;
+    size_t map_len;
+} BitArrayMapping;
+
+#define BLOCK_WORDS (BIT_FILE_BLOCK / sizeof(uint32_t))
+
+_Static_assert(sizeof(BitFileHeader) == 64, "header must be 64 bytes");
+_Static_assert(sizeof(BitFileVLInfo) == 64, "VL info must be 64 bytes");
+
+// Reserved bytes of VLBitArray files, the mapping length then the struct
+#define VL_RESERVED (sizeof(BitFileHeader) + sizeof(BitFileVLInfo))
+_Static_assert(BIT_FILE_VL_PAYLOAD - VL_RESERVED >=
+  sizeof(size_t) + offsetof(VLBitArray, P), "struct must fit before P");
+
+// -- Header ------------------------------------------------------------------
+static uint64_t align_up(uint64_t x)
+{
+    return (x + BIT_FILE_ALIGN - 1) / BIT_FILE_ALIGN * BIT_FILE_ALIGN;
+}
+
+static uint64_t BitFileHeader_n_blocks(const BitFileHeader *header)
 {
+    if (header->block_size == 0) return 0;
+    return (header->payload_bytes + header->block_size - 1) / header->block_size;
+}
 
-    // Write file identifier
-    fwrite(&BIT_MAGIC_NUMBER, sizeof(char), strlen(BIT_MAGIC_NUMBER), fp);
+static uint32_t BitFileHeader_crc(const BitFileHeader *header)
+{
+    return crc32c(0, header, offsetof(BitFileHeader, header_crc));
+}
 
-    // BitArray metadata needed to construct data structure
-    fwrite(&bitarr->element_size, sizeof(uint8_t), 1, fp);
-    fwrite(&bitarr->width, sizeof(uint8_t), 1, fp);
-    fwrite(&bitarr->n, sizeof(uint32_t), 1, fp);
+// Exits unless header describes a file of the given type and size
+static void BitFileHeader_check(const BitFileHeader *header, uint64_t file_size,
+  BIT_FILE_TYPE type)
+{
+    uint64_t words = (header->n * header->element_size + 31) / 32,
+             payload_end = header->payload_offset + header->payload_bytes;
 
-    // Write out compressed array
-    unsigned int n_entries = 1 + (((bitarr->element_size * bitarr->n) - 1) / bitarr->width);
-    fwrite(&(bitarr->v), sizeof(unsigned int), n_entries, fp);
+    if (header->version == (uint16_t) (BIT_FILE_VERSION << 8)) {
+        fprintf(stderr, "Incorrect file, written with a different byte order\n");
+        exit(FILE_ERROR);
+    }
+    if (header->block_size && BitFileHeader_crc(header) != header->header_crc) {
+        fprintf(stderr, "Incorrect file, header checksum does not match\n");
+        exit(CHECKSUM_ERROR);
+    }
+
+    // VL payload sizes are checked against BitFileVLInfo
+    const int fixed_ok = type == BIT_FILE_FIXED ?
+      header->element_size != 0 && header->element_size <= 32 &&
+      header->n <= UINT32_MAX && header->payload_bytes == words * sizeof(uint32_t) :
+      header->element_size == 0 && header->payload_offset == BIT_FILE_VL_PAYLOAD;
+
+    if (header->version != BIT_FILE_VERSION || header->width != 32 ||
+        header->type != type || !fixed_ok ||
+        header->payload_offset < sizeof(BitFileHeader) ||
+        header->payload_offset % BIT_FILE_ALIGN != 0 ||
+        payload_end < header->payload_offset || payload_end > file_size ||
+        (header->block_size && (header->crc_offset != align_up(payload_end) ||
+          header->crc_offset + BitFileHeader_n_blocks(header) * sizeof(uint32_t)
+            > file_size))) {
+        fprintf(stderr, "Incorrect file, unsupported or corrupt header\n");
+        exit(FILE_ERROR);
+    }
 }
 
+static BITARR_ERROR BitFileHeader_verify(const BitFileHeader *header,
+  const unsigned char *payload, const uint32_t *crcs)
+{
+    uint64_t n_blocks = BitFileHeader_n_blocks(header);
+
+    for (uint64_t b = 0; b < n_blocks; ++b) {
+        uint64_t start = b * header->block_size,
+                 len = header->payload_bytes - start < header->block_size ?
+                   header->payload_bytes - start : header->block_size;
+        if (crc32c(0, payload + start, (size_t) len) != crcs[b]) {
+            return CHECKSUM_ERROR;
+        }
+    }
+    return BITARR_SUCCESS;
+}
+
+
+// -- Writing -----------------------------------------------------------------
+static void BitArrayWriter_flush(BitArrayWriter *writer)
+{
+    if (writer->block_fill == 0) return;
+
+    writer->crcs[writer->n_blocks++] = crc32c(0, writer->block,
+      writer->block_fill * sizeof(uint32_t));
+    fwrite(writer->block, sizeof(uint32_t), writer->block_fill, writer->fp);
+    writer->block_fill = 0;
+}
+
+static void BitArrayWriter_put_words(BitArrayWriter *writer,
+  const uint32_t *words, size_t count)
+{
+    while (count) {
+        size_t room = BLOCK_WORDS - writer->block_fill,
+               chunk = count < room ? count : room;
+
+        memcpy(writer->block + writer->block_fill, words, chunk * sizeof(uint32_t));
+        writer->block_fill += chunk;
+        words += chunk;
+        count -= chunk;
+        if (writer->block_fill == BLOCK_WORDS) BitArrayWriter_flush(writer);
+    }
+}
+
+// Header of a file of the given type, up to the payload placement
+static void BitFileHeader_init(BitFileHeader *header, BIT_FILE_TYPE type,
+  uint64_t n, uint8_t element_size)
+{
+    memset(header, 0, sizeof(BitFileHeader));
+
+    // Write file identifier and version
+    memcpy(header->magic, BIT_MAGIC_NUMBER, sizeof(header->magic));
+    header->version = BIT_FILE_VERSION;
+    header->type = (uint8_t) type;
+
+    // Metadata needed to construct data structure
+    header->element_size = element_size;
+    header->width = 32;
+    header->n = n;
+    header->block_size = BIT_FILE_BLOCK;
+}
+
+// Set the payload size and checksum the header
+static void BitFileHeader_seal(BitFileHeader *header, uint64_t payload_offset,
+  uint64_t payload_bytes)
+{
+    header->payload_offset = payload_offset;
+    header->payload_bytes = payload_bytes;
+    header->crc_offset = align_up(payload_offset + payload_bytes);
+    header->header_crc = BitFileHeader_crc(header);
+}
+
+// Allocate the buffers for writer->header and write it to fp
+static void BitArrayWriter_start(BitArrayWriter *writer, FILE *fp)
+{
+    const BitFileHeader *header = &writer->header;
+
+    writer->fp = fp;
+    writer->count = 0;
+    writer->acc = 0;
+    writer->acc_bits = 0;
+    writer->block = malloc(BIT_FILE_BLOCK);
+    writer->block_fill = 0;
+    writer->crcs = malloc(sizeof(uint32_t) * (BitFileHeader_n_blocks(header) + 1));
+    writer->n_blocks = 0;
+    if (writer->block == NULL || writer->crcs == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fwrite(header, sizeof(BitFileHeader), 1, fp);
+}
+
+void BitArrayWriter_begin(BitArrayWriter *writer, FILE *fp, uint32_t n,
+  uint8_t element_size)
+{
+    BitFileHeader_init(&writer->header, BIT_FILE_FIXED, n, element_size);
+    // Header size is a multiple of the alignment, payload follows directly
+    BitFileHeader_seal(&writer->header, sizeof(BitFileHeader),
+      ((uint64_t) n * element_size + 31) / 32 * sizeof(uint32_t));
+    BitArrayWriter_start(writer, fp);
+}
+
+void BitArrayWriter_push_many(BitArrayWriter *writer, const uint32_t A[],
+  size_t count)
+{
+    const size_t l = writer->header.element_size;
+    const uint32_t mask = 0xFFFFFFFFu >> (32 - l);
+
+    if (count > writer->header.n - writer->count) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    for (size_t i = 0; i < count; ) {
+        // Block aligned groups which fit in the buffer are packed in place
+        if (writer->count % BITPACK_BLOCK == 0 && count - i >= BITPACK_BLOCK &&
+            writer->block_fill + l <= BLOCK_WORDS) {
+            bitpack_pack(writer->block + writer->block_fill, l, 0, BITPACK_BLOCK,
+              A + i);
+            writer->block_fill += l;
+            writer->count += BITPACK_BLOCK;
+            i += BITPACK_BLOCK;
+            if (writer->block_fill == BLOCK_WORDS) BitArrayWriter_flush(writer);
+            continue;
+        }
+
+        writer->acc |= (uint64_t) (A[i++] & mask) << writer->acc_bits;
+        writer->acc_bits += l;
+        writer->count++;
+        if (writer->acc_bits >= 32) {
+            uint32_t word = (uint32_t) writer->acc;
+            BitArrayWriter_put_words(writer, &word, 1);
+            writer->acc >>= 32;
+            writer->acc_bits -= 32;
+        }
+    }
+}
+
+void BitArrayWriter_finish(BitArrayWriter *writer)
+{
+    const BitFileHeader *header = &writer->header;
+    const uint64_t words = header->payload_bytes / sizeof(uint32_t);
+    const unsigned char zeros[BIT_FILE_ALIGN] = { 0 };
+    uint32_t word = (uint32_t) writer->acc;
+
+    if (writer->acc_bits) BitArrayWriter_put_words(writer, &word, 1);
+
+    // Elements never pushed are 0
+    word = 0;
+    while (writer->n_blocks * BLOCK_WORDS + writer->block_fill < words) {
+        BitArrayWriter_put_words(writer, &word, 1);
+    }
+    BitArrayWriter_flush(writer);
+
+    // Checksums start on the next aligned offset
+    fwrite(zeros, 1, header->crc_offset -
+      (header->payload_offset + header->payload_bytes), writer->fp);
+    fwrite(writer->crcs, sizeof(uint32_t), writer->n_blocks, writer->fp);
+
+    free(writer->block);
+    free(writer->crcs);
+    writer->block = NULL;
+    writer->crcs = NULL;
+}
+
+void BitArray_save(BitArray* bitarr, FILE *fp)
+{
+    BitArrayWriter writer;
+    BitArrayWriter_begin(&writer, fp, bitarr->n, (uint8_t) bitarr->element_size);
+
+    // Write out compressed array as is
+    BitArrayWriter_put_words(&writer, bitarr->v, BitArray_n_words(bitarr));
+    writer.count = bitarr->n;
+    BitArrayWriter_finish(&writer);
+}
+
+
+// -- Reading -----------------------------------------------------------------
 BitArray* BitArray_open(FILE *fp)
 {
     uint8_t l, width;
-    uint32_t n; 
-    char magic_number[strlen(BIT_MAGIC_NUMBER)+1];     
+    uint32_t n;
+    char magic_number[sizeof(BIT_MAGIC_NUMBER)] = { 0 };
 
     // Verify it is a correct file
     fread(magic_number, sizeof(char), strlen(BIT_MAGIC_NUMBER), fp);
@@ -29,13 +272,348 @@ BitArray* BitArray_open(FILE *fp)
         exit(FILE_ERROR);
     }
 
-    // Read in data to allocate memory on heap
+    // Version 1 stores l right after the magic string, which is never 0
     fread(&l, sizeof(uint8_t), 1, fp);
+    if (l == 0) {
+        BitFileHeader header;
+        memcpy(header.magic, BIT_MAGIC_NUMBER, sizeof(header.magic));
+        fread(header.magic + sizeof(header.magic),
+          sizeof(header) - sizeof(header.magic), 1, fp);
+        BitFileHeader_check(&header, UINT64_MAX, BIT_FILE_FIXED);
+
+        BitArray* bitarr = BitArray_calloc((uint32_t) header.n,
+          header.element_size, header.width / CHAR_BIT);
+        fseek(fp, (long) (header.payload_offset - sizeof(header)), SEEK_CUR);
+        fread(bitarr->v, sizeof(uint32_t), BitArray_n_words(bitarr), fp);
+
+        // Checksum the payload just read
+        uint64_t n_blocks = BitFileHeader_n_blocks(&header);
+        if (n_blocks) {
+            uint32_t *crcs = malloc(sizeof(uint32_t) * n_blocks);
+            fseek(fp, (long) (header.crc_offset - header.payload_offset -
+              header.payload_bytes), SEEK_CUR);
+            if (crcs == NULL ||
+                fread(crcs, sizeof(uint32_t), n_blocks, fp) != n_blocks ||
+                BitFileHeader_verify(&header, (unsigned char *) bitarr->v, crcs)) {
+                fprintf(stderr, "Incorrect file, payload checksum does not match\n");
+                exit(CHECKSUM_ERROR);
+            }
+            free(crcs);
+        }
+        return bitarr;
+    }
+
+    // Read in data to allocate memory on heap
     fread(&width, sizeof(uint8_t), 1, fp);
     fread(&n, sizeof(uint32_t), 1, fp);
     BitArray* bitarr = BitArray_calloc(n, l, width / CHAR_BIT);
 
     // Read in compressed array
-    fread(&(bitarr->v), width, 1, fp);
+    fread(bitarr->v, width / CHAR_BIT, BitArray_n_words(bitarr), fp);
+    return bitarr;
+}
+
+// Map the whole file at path, private and writable for VLBitArray files
+static void* map_file(const char *path, size_t *len, int writable)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Couldn't open %s\n", path);
+        exit(FILE_ERROR);
+    }
+
+    *len = (size_t) st.st_size;
+    void *map = *len ? mmap(NULL, *len, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+      writable ? MAP_PRIVATE : MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);  // The mapping keeps its own reference to the file
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Couldn't map %s\n", path);
+        exit(FILE_ERROR);
+    }
+    return map;
+}
+
+BitArray* BitArray_mmap(const char *path)
+{
+    size_t len;
+    void *map = map_file(path, &len, 0);
+
+    const unsigned char *bytes = map;
+    if (len < 9 || memcmp(bytes, BIT_MAGIC_NUMBER, strlen(BIT_MAGIC_NUMBER)) != 0) {
+        fprintf(stderr, "Incorrect file, magic string does not match\n");
+        exit(FILE_ERROR);
+    }
+
+    BitArrayMapping *mapping = malloc(sizeof(BitArrayMapping));
+    if (mapping == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    BitArray *bitarr = &mapping->arr;
+
+    if (bytes[3] != 0) {
+        // Version 1, the payload at byte 9 can't be used in place
+        bitarr->element_size = bytes[3];
+        bitarr->width = bytes[4];
+        memcpy(&bitarr->n, bytes + 5, sizeof(uint32_t));
+
+        size_t payload = BitArray_n_words(bitarr) * sizeof(uint32_t);
+        if (bitarr->width != 32 || len < 9 + payload) {
+            fprintf(stderr, "Incorrect file, unsupported or corrupt header\n");
+            exit(FILE_ERROR);
+        }
+        if ((bitarr->v = malloc(payload ? payload : 1)) == NULL) {
+            printf("Couldn't allocate memory for vector.\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(bitarr->v, bytes + 9, payload);
+        munmap(map, len);
+        mapping->map = NULL;
+        mapping->map_len = 0;
+        return bitarr;
+    }
+
+    BitFileHeader *header = &mapping->header;
+    if (len < sizeof(BitFileHeader)) {
+        fprintf(stderr, "Incorrect file, unsupported or corrupt header\n");
+        exit(FILE_ERROR);
+    }
+    memcpy(header, bytes, sizeof(BitFileHeader));
+    BitFileHeader_check(header, len, BIT_FILE_FIXED);
+
+    bitarr->element_size = header->element_size;
+    bitarr->width = header->width;
+    bitarr->n = (uint32_t) header->n;
+    // Mapping is page aligned, so the payload is 64 byte aligned: read in place
+    bitarr->v = (uint32_t *) (void *) ((unsigned char *) map + header->payload_offset);
+    mapping->map = map;
+    mapping->map_len = len;
     return bitarr;
 }
+
+BITARR_ERROR BitArray_mmap_verify(BitArray *bitarr)
+{
+    BitArrayMapping *mapping = (BitArrayMapping *) bitarr;
+    const unsigned char *bytes = mapping->map;
+
+    // Version 1 files carry no checksums
+    if (bytes == NULL) return BITARR_SUCCESS;
+    return BitFileHeader_verify(&mapping->header,
+      bytes + mapping->header.payload_offset,
+      (const uint32_t *) (const void *) (bytes + mapping->header.crc_offset));
+}
+
+void BitArray_munmap(BitArray *bitarr)
+{
+    BitArrayMapping *mapping = (BitArrayMapping *) bitarr;
+
+    if (mapping->map) munmap(mapping->map, mapping->map_len);
+    else free(bitarr->v);
+    free(mapping);
+}
+
+
+// -- Variable length ---------------------------------------------------------
+static uint64_t vl_n_samples(uint64_t length, uint64_t k)
+{
+    return (length + k - 1) / k;
+}
+
+static uint32_t BitFileVLInfo_crc(const BitFileVLInfo *info)
+{
+    return crc32c(0, info, offsetof(BitFileVLInfo, crc));
+}
+
+// Exits unless info matches header and the sizes in it add up
+static void BitFileVLInfo_check(const BitFileHeader *header,
+  const BitFileVLInfo *info)
+{
+    if (BitFileVLInfo_crc(info) != info->crc) {
+        fprintf(stderr, "Incorrect file, header checksum does not match\n");
+        exit(CHECKSUM_ERROR);
+    }
+
+    const uint64_t p_end = info->k ?
+      BIT_FILE_VL_PAYLOAD + vl_n_samples(info->length, info->k) * sizeof(uint64_t) : 0;
+    if (info->k == 0 || info->length != header->n ||
+        info->element_size != 32 || info->codec > VL_VARBYTE || info->param > 31 ||
+        info->physical_size != (info->logical_size + 31) / 32 ||
+        info->w_offset != align_up(p_end) ||
+        header->payload_bytes != info->w_offset - BIT_FILE_VL_PAYLOAD +
+          info->physical_size * sizeof(uint32_t)) {
+        fprintf(stderr, "Incorrect file, unsupported or corrupt header\n");
+        exit(FILE_ERROR);
+    }
+}
+
+// Copy the members of info into vlb, W is left alone
+static void vl_from_info(VLBitArray *vlb, const BitFileVLInfo *info)
+{
+    vlb->k = (size_t) info->k;
+    vlb->length = (size_t) info->length;
+    vlb->logical_size = (size_t) info->logical_size;
+    vlb->physical_size = (size_t) info->physical_size;
+    vlb->element_size = info->element_size;
+    vlb->codec = (VL_CODEC) info->codec;
+    vlb->param = info->param;
+    vlb->W_inline = 1;
+}
+
+void VLBitArray_save(const VLBitArray *bit_arr, FILE *fp)
+{
+    if (bit_arr->element_size != 32) {
+        fprintf(stderr, "%s:%d Only 32 bit words can be saved\n", __FILE__, __LINE__);
+        exit(FILE_ERROR);
+    }
+
+    const uint64_t n_samples = vl_n_samples(bit_arr->length, bit_arr->k),
+                   p_end = BIT_FILE_VL_PAYLOAD + n_samples * sizeof(uint64_t);
+    BitFileVLInfo info;
+    memset(&info, 0, sizeof(info));
+    info.k = bit_arr->k;
+    info.length = bit_arr->length;
+    info.logical_size = bit_arr->logical_size;
+    info.physical_size = bit_arr->physical_size;
+    info.w_offset = align_up(p_end);
+    info.element_size = 32;
+    info.codec = (uint32_t) bit_arr->codec;
+    info.param = bit_arr->param;
+    info.crc = BitFileVLInfo_crc(&info);
+
+    BitArrayWriter writer;
+    BitFileHeader_init(&writer.header, BIT_FILE_VL, bit_arr->length, 0);
+    BitFileHeader_seal(&writer.header, BIT_FILE_VL_PAYLOAD, info.w_offset -
+      BIT_FILE_VL_PAYLOAD + bit_arr->physical_size * sizeof(uint32_t));
+    BitArrayWriter_start(&writer, fp);
+
+    // Info and reserved bytes are outside the checksummed payload
+    const unsigned char zeros[BIT_FILE_VL_PAYLOAD] = { 0 };
+    fwrite(&info, sizeof(info), 1, fp);
+    fwrite(zeros, 1, BIT_FILE_VL_PAYLOAD - VL_RESERVED, fp);
+
+    for (uint64_t s = 0; s < n_samples; ++s) {
+        const uint64_t p = bit_arr->P[s];
+        const uint32_t words[2] = { (uint32_t) p, (uint32_t) (p >> 32) };
+        BitArrayWriter_put_words(&writer, words, 2);
+    }
+    BitArrayWriter_put_words(&writer, (const uint32_t *) (const void *) zeros,
+      (size_t) (info.w_offset - p_end) / sizeof(uint32_t));
+    BitArrayWriter_put_words(&writer, bit_arr->W, bit_arr->physical_size);
+    BitArrayWriter_finish(&writer);
+}
+
+VLBitArray* VLBitArray_open(FILE *fp)
+{
+    BitFileHeader header;
+    BitFileVLInfo info;
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, BIT_MAGIC_NUMBER, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "Incorrect file, magic string does not match\n");
+        exit(FILE_ERROR);
+    }
+    BitFileHeader_check(&header, UINT64_MAX, BIT_FILE_VL);
+    if (fread(&info, sizeof(info), 1, fp) != 1) {
+        fprintf(stderr, "Incorrect file, unsupported or corrupt header\n");
+        exit(FILE_ERROR);
+    }
+    BitFileVLInfo_check(&header, &info);
+
+    // Payload and checksums are read whole, verified, then copied in place
+    const uint64_t n_blocks = BitFileHeader_n_blocks(&header);
+    unsigned char *payload = malloc((size_t) header.payload_bytes + 1);
+    uint32_t *crcs = malloc(sizeof(uint32_t) * (n_blocks + 1));
+    if (payload == NULL || crcs == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    fseek(fp, (long) (BIT_FILE_VL_PAYLOAD - VL_RESERVED), SEEK_CUR);
+    if (fread(payload, 1, (size_t) header.payload_bytes, fp) != header.payload_bytes ||
+        fseek(fp, (long) (header.crc_offset - header.payload_offset -
+          header.payload_bytes), SEEK_CUR) != 0 ||
+        fread(crcs, sizeof(uint32_t), (size_t) n_blocks, fp) != n_blocks ||
+        BitFileHeader_verify(&header, payload, crcs)) {
+        fprintf(stderr, "Incorrect file, payload checksum does not match\n");
+        exit(CHECKSUM_ERROR);
+    }
+
+    // Same single block layout as VLBitArray_init_codec
+    const size_t n_samples = (size_t) vl_n_samples(info.length, info.k),
+                 w_bytes = (size_t) info.physical_size * sizeof(uint32_t),
+                 head = BIT_ALIGN_UP(sizeof(VLBitArray) + sizeof(size_t) * n_samples);
+    VLBitArray *vlb = bit_alloc(&bit_heap_allocator, head + BIT_ALIGN_UP(w_bytes ? w_bytes : 1));
+    vl_from_info(vlb, &info);
+    vlb->W = (uint32_t *) ((char *) vlb + head);
+    for (size_t s = 0; s < n_samples; ++s) {
+        uint64_t p;
+        memcpy(&p, payload + s * sizeof(uint64_t), sizeof(p));
+        vlb->P[s] = (size_t) p;
+    }
+    memcpy(vlb->W, payload + (info.w_offset - BIT_FILE_VL_PAYLOAD), w_bytes);
+
+    free(payload);
+    free(crcs);
+    return vlb;
+}
+
+// Start of the mapping holding bit_arr
+static unsigned char* vl_map_base(const VLBitArray *bit_arr)
+{
+    return (unsigned char *) (uintptr_t) bit_arr->P - BIT_FILE_VL_PAYLOAD;
+}
+
+VLBitArray* VLBitArray_mmap(const char *path)
+{
+    // P is used in place, so it must have the layout of the file
+    if (sizeof(size_t) != sizeof(uint64_t)) {
+        fprintf(stderr, "%s:%d Mapping needs 64 bit size_t\n", __FILE__, __LINE__);
+        exit(FILE_ERROR);
+    }
+
+    size_t len;
+    unsigned char *map = map_file(path, &len, 1);
+    const BitFileHeader *header = (const BitFileHeader *) (void *) map;
+    const BitFileVLInfo *info = (const BitFileVLInfo *) (void *) (map + sizeof(BitFileHeader));
+    if (len < BIT_FILE_VL_PAYLOAD ||
+        memcmp(header->magic, BIT_MAGIC_NUMBER, sizeof(header->magic)) != 0) {
+        fprintf(stderr, "Incorrect file, magic string does not match\n");
+        exit(FILE_ERROR);
+    }
+    BitFileHeader_check(header, len, BIT_FILE_VL);
+    BitFileVLInfo_check(header, info);
+
+    // Struct right before P, mapping length at the start of the reserved bytes
+    VLBitArray *vlb = (VLBitArray *) (void *)
+      (map + BIT_FILE_VL_PAYLOAD - offsetof(VLBitArray, P));
+    memcpy(map + VL_RESERVED, &len, sizeof(len));
+    vl_from_info(vlb, info);
+    // W is 64 byte aligned within the page aligned mapping
+    vlb->W = (uint32_t *) (void *) (map + info->w_offset);
+
+    // Only the page holding the struct was copied, keep the rest shared
+    if (mprotect(map, len, PROT_READ) != 0) {
+        munmap(map, len);
+        fprintf(stderr, "Couldn't protect mapping of %s\n", path);
+        exit(FILE_ERROR);
+    }
+    return vlb;
+}
+
+BITARR_ERROR VLBitArray_mmap_verify(const VLBitArray *bit_arr)
+{
+    const unsigned char *map = vl_map_base(bit_arr);
+    const BitFileHeader *header = (const BitFileHeader *) (const void *) map;
+
+    return BitFileHeader_verify(header, map + header->payload_offset,
+      (const uint32_t *) (const void *) (map + header->crc_offset));
+}
+
+void VLBitArray_munmap(VLBitArray *bit_arr)
+{
+    unsigned char *map = vl_map_base(bit_arr);
+    size_t len;
+
+    memcpy(&len, map + VL_RESERVED, sizeof(len));
+    munmap(map, len);
+}
@@ -1,5 +1,7 @@
 /*
  * File format is specified as follows
+ *
+ * Version 1
  *  The header is 9 bytes long
  *  - magic number: 3 char   (3 byte)
  *  - l:            1 uint8  (1 byte)
@@ -12,10 +14,58 @@
  * where 32 is the size of a computer word. Thus the data is read
  * as the next unsigned int * i bytes
  *
- * ┌─────────┬───┬───┬────────────┬───────────────── 
- * │   BIT   │ l │ w │     n      │       ...        
- * └─────────┴───┴───┴────────────┴───────────────── 
+ * ┌─────────┬───┬───┬────────────┬─────────────────
+ * │   BIT   │ l │ w │     n      │       ...
+ * └─────────┴───┴───┴────────────┴─────────────────
+ *
+ * Version 2
+ *  The header is 64 bytes long (BitFileHeader), all fields in host byte order
+ *  - magic number:   4 char   "BIT\0"
+ *  - version:        1 uint16
+ *  - l:              1 uint8
+ *  - width:          1 uint8
+ *  - n:              1 uint64
+ *  - payload offset: 1 uint64
+ *  - payload bytes:  1 uint64
+ *  - type:           1 uint8  (BIT_FILE_TYPE)
+ *  - reserved:       3 bytes, zero
+ *  - block size:     1 uint32
+ *  - crc offset:     1 uint64
+ *  - header crc:     1 uint32 (CRC32C of the preceding 48 bytes)
+ *  - reserved:       12 bytes, zero
+ *
+ * Header and payload are written as they are in memory, so a mapped file
+ * needs no conversion. A file written on a machine of the other byte order
+ * has a byte swapped version and is rejected.
+ *
+ * Version 1 files can never have a 0 byte after "BIT" (l >= 1), which is
+ * how the two are told apart. The payload starts at the payload offset,
+ * which is a multiple of 64, so a mapped file can be read in place.
+ *
+ * The payload is checksummed in blocks of block size bytes (the last block
+ * may be shorter). One uint32 CRC32C per block is stored at the crc offset,
+ * the next multiple of 64 after the payload. A block size of 0 means the
+ * file carries no checksums.
  *
+ * ┌───────────────┬────────────────────────┬─────┬─────────────────────┐
+ * │ header (64 B) │ payload (offset)  ...  │ pad │ crc[0] crc[1] ...   │
+ * └───────────────┴────────────────────────┴─────┴─────────────────────┘
+ *
+ * All offsets and sizes are known once n and l are, so the header is written
+ * first and the file can be produced in one pass (see BitArrayWriter).
+ *
+ * VLBitArray files have type BIT_FILE_VL, l = 0 and n = length. A
+ * BitFileVLInfo follows the header, then reserved bytes up to the payload
+ * at offset BIT_FILE_VL_PAYLOAD. The payload holds the samples P as uint64,
+ * then W from the next multiple of 64.
+ *
+ * ┌────────┬──────┬──────────┬──────────┬─────┬─────────┬─────┬──────┐
+ * │ header │ info │ reserved │ P ...    │ pad │ W ...   │ pad │ crcs │
+ * └────────┴──────┴──────────┴──────────┴─────┴─────────┴─────┴──────┘
+ *
+ * The reserved bytes are where VLBitArray_mmap builds the struct, right
+ * before P, so that P in the mapping is the flexible member of the struct
+ * and neither P nor W is copied.
  */
 
 
@@ -24,9 +74,105 @@
 
 #include <string.h>
 #include "bitarr.h"
+#include "bitarr_vl.h"
 
 static const char BIT_MAGIC_NUMBER[] = { 'B', 'I', 'T', '\0'};
 
+#define BIT_FILE_VERSION 2
+// Alignment of the payload and checksums within version 2 files
+#define BIT_FILE_ALIGN 64
+// Bytes of payload covered by each checksum
+#define BIT_FILE_BLOCK 65536
+// Offset of the payload within VLBitArray files
+#define BIT_FILE_VL_PAYLOAD 256
+
+typedef enum {
+  BIT_FILE_FIXED,       // BitArray
+  BIT_FILE_VL           // VLBitArray
+} BIT_FILE_TYPE;
+
+/**
+ * @struct BitFileHeader
+ *
+ * On disk header of version 2 files
+ */
+typedef struct {
+  char magic[4];
+  uint16_t version;
+  uint8_t element_size;
+  uint8_t width;
+  uint64_t n;
+  uint64_t payload_offset;
+  uint64_t payload_bytes;
+  uint8_t type;
+  uint8_t reserved0[3];
+  uint32_t block_size;
+  uint64_t crc_offset;
+  uint32_t header_crc;
+  uint8_t reserved1[12];
+} BitFileHeader;
+
+/**
+ * @struct BitFileVLInfo
+ *
+ * VLBitArray members stored after the header of BIT_FILE_VL files
+ *
+ * @var BitFileVLInfo.w_offset
+ *  Offset of W within the file
+ * @var BitFileVLInfo.crc
+ *  CRC32C of the preceding 52 bytes
+ */
+typedef struct {
+  uint64_t k;
+  uint64_t length;
+  uint64_t logical_size;
+  uint64_t physical_size;
+  uint64_t w_offset;
+  uint32_t element_size;
+  uint32_t codec;
+  uint32_t param;
+  uint32_t crc;
+  uint8_t reserved[8];
+} BitFileVLInfo;
+
+/**
+ * @struct BitArrayWriter
+ *
+ * Streaming writer producing a version 2 file from values supplied in
+ * chunks. Only one checksum block is buffered at a time, so arrays larger
+ * than memory can be written.
+ *
+ * @var BitArrayWriter.fp
+ *  File being written
+ * @var BitArrayWriter.header
+ *  Header written by BitArrayWriter_begin
+ * @var BitArrayWriter.count
+ *  Number of values written so far
+ * @var BitArrayWriter.acc
+ *  Bits written but not yet stored in block
+ * @var BitArrayWriter.acc_bits
+ *  Number of pending bits in acc
+ * @var BitArrayWriter.block
+ *  Words of the current checksum block
+ * @var BitArrayWriter.block_fill
+ *  Number of words stored in block
+ * @var BitArrayWriter.crcs
+ *  Checksum of every block, written by BitArrayWriter_finish
+ * @var BitArrayWriter.n_blocks
+ *  Number of completed blocks
+ */
+typedef struct {
+  FILE *fp;
+  BitFileHeader header;
+  uint64_t count;
+  uint64_t acc;
+  size_t acc_bits;
+  uint32_t *block;
+  size_t block_fill;
+  uint32_t *crcs;
+  size_t n_blocks;
+} BitArrayWriter;
+
 /**
  * @brief Save BitArray to disk
  *
@@ -36,12 +182,130 @@ static const char BIT_MAGIC_NUMBER[] = { 'B', 'I', 'T', '\0'};
 void BitArray_save(BitArray* bitarr, FILE *fp);
 
 
+/**
+ * @brief Start writing a BitArray of n elements to disk
+ *
+ * @param writer        Writer to initialize
+ * @param fp            File to write to
+ * @param n             Number of elements
+ * @param element_size  Size in bits of each element (1-32)
+ */
+void BitArrayWriter_begin(BitArrayWriter *writer, FILE *fp, uint32_t n,
+  uint8_t element_size);
+
+/**
+ * @brief Append a chunk of values
+ *
+ * Bits of each value above element_size are ignored.
+ *
+ * @param writer    Writer started with BitArrayWriter_begin
+ * @param A         Values to append
+ * @param count     Number of values in A
+ */
+void BitArrayWriter_push_many(BitArrayWriter *writer, const uint32_t A[],
+  size_t count);
+
+/**
+ * @brief Write the remaining payload and the checksums
+ *
+ * Elements which were never pushed are written as 0.
+ *
+ * @param writer    Writer started with BitArrayWriter_begin
+ */
+void BitArrayWriter_finish(BitArrayWriter *writer);
+
 /**
  * @brief Opens bitarr saved to disk
  *
+ * Reads both version 1 and version 2 files into a heap allocated BitArray.
+ * Checksums of version 2 files are verified while reading.
+ *
  * @param fp    Filepath to bitarr saved on disk
  * @return
  */
 BitArray* BitArray_open(FILE *fp);
 
+/**
+ * @brief Map a bitarr saved to disk without copying it
+ *
+ * The returned BitArray reads its values straight from the read only file
+ * mapping, so opening is independent of the array size and the pages are
+ * shared with every other process mapping the same file. Writing to the
+ * array is not allowed.
+ *
+ * Only the header checksum is verified, checking the payload would read
+ * the whole file. Use BitArray_mmap_verify when that is wanted.
+ *
+ * Version 1 files have an unaligned payload and are copied to the heap
+ * instead.
+ *
+ * @param path  Path to bitarr saved on disk
+ * @return      Pointer to BitArray, release with BitArray_munmap
+ */
+BitArray* BitArray_mmap(const char *path);
+
+/**
+ * @brief Verify the payload checksums of a mapped bitarr
+ *
+ * @param bitarr    BitArray returned by BitArray_mmap
+ * @return          CHECKSUM_ERROR on mismatch, BITARR_SUCCESS otherwise
+ */
+BITARR_ERROR BitArray_mmap_verify(BitArray *bitarr);
+
+/**
+ * @brief Release a BitArray returned by BitArray_mmap
+ *
+ * @param bitarr
+ */
+void BitArray_munmap(BitArray *bitarr);
+
+/**
+ * @brief Save VLBitArray to disk
+ *
+ * @param bit_arr   VLBitArray with 32 bit words
+ * @param fp        File to write to
+ */
+void VLBitArray_save(const VLBitArray *bit_arr, FILE *fp);
+
+/**
+ * @brief Opens a VLBitArray saved to disk
+ *
+ * Reads the file into a heap allocated VLBitArray, verifying the checksums.
+ *
+ * @param fp    File to read from
+ * @return      Pointer to VLBitArray, release with VLBitArray_free
+ */
+VLBitArray* VLBitArray_open(FILE *fp);
+
+/**
+ * @brief Map a VLBitArray saved to disk without copying it
+ *
+ * The struct is written into the first page of a private mapping, a copy of
+ * that one page, while P and W are read straight from the file. Opening is
+ * independent of the array size. The mapping is read only once the struct is
+ * in place.
+ *
+ * Only the header checksums are verified, use VLBitArray_mmap_verify for the
+ * payload.
+ *
+ * @param path  Path to VLBitArray saved on disk
+ * @return      Pointer to VLBitArray, release with VLBitArray_munmap
+ */
+VLBitArray* VLBitArray_mmap(const char *path);
+
+/**
+ * @brief Verify the payload checksums of a mapped VLBitArray
+ *
+ * @param bit_arr   VLBitArray returned by VLBitArray_mmap
+ * @return          CHECKSUM_ERROR on mismatch, BITARR_SUCCESS otherwise
+ */
+BITARR_ERROR VLBitArray_mmap_verify(const VLBitArray *bit_arr);
+
+/**
+ * @brief Release a VLBitArray returned by VLBitArray_mmap
+ *
+ * @param bit_arr
+ */
+void VLBitArray_munmap(VLBitArray *bit_arr);
+
 #endif // BITARR_IO_H_
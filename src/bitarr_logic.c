@@ -0,0 +1,255 @@
+/**
+ * @file
+ * @brief Whole array bitwise operations and population counts
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bitarr_logic.h"
+#include "bitops.h"
+#include "cpu.h"
+
+#ifdef BITTER_X86
+#include <immintrin.h>
+#endif
+
+typedef enum {
+  LOGIC_AND,
+  LOGIC_OR,
+  LOGIC_XOR,
+  LOGIC_NOT
+} LOGIC_OP;
+
+// Number of 32 bit words holding the values
+static inline size_t logic_n_words(const BitArray *bitarr)
+{
+    return ((size_t) bitarr->n * bitarr->element_size + 31) / 32;
+}
+
+static void logic_check(const BitArray *a, const BitArray *b)
+{
+    if (a->n != b->n || a->element_size != b->element_size) {
+        fprintf(stderr, "%s:%d BitArrays differ in length or element size\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+}
+
+
+// -- Bitwise operations ------------------------------------------------------
+#define LOGIC_LOOP(STEP, EXPR)                                                \
+    for (; i + (STEP) <= n; i += (STEP)) { EXPR; }
+
+#ifdef BITTER_X86
+// Words [0, n / 8 * 8), returns the number of words done
+__attribute__((target("avx2")))
+static size_t logic_avx2(LOGIC_OP op, uint32_t *dst, const uint32_t *a,
+  const uint32_t *b, size_t n)
+{
+#define LD(p) _mm256_loadu_si256((const __m256i *) ((p) + i))
+#define ST(v) _mm256_storeu_si256((__m256i *) (dst + i), (v))
+    const __m256i ones = _mm256_set1_epi32(-1);
+    size_t i = 0;
+    switch (op) {
+    case LOGIC_AND: LOGIC_LOOP(8, ST(_mm256_and_si256(LD(a), LD(b)))) break;
+    case LOGIC_OR: LOGIC_LOOP(8, ST(_mm256_or_si256(LD(a), LD(b)))) break;
+    case LOGIC_XOR: LOGIC_LOOP(8, ST(_mm256_xor_si256(LD(a), LD(b)))) break;
+    default: LOGIC_LOOP(8, ST(_mm256_xor_si256(LD(a), ones))) break;
+    }
+    return i;
+#undef LD
+#undef ST
+}
+#endif
+
+// dst = a op b over n words, dst may be a or b
+static void logic_words(LOGIC_OP op, uint32_t *dst, const uint32_t *a,
+  const uint32_t *b, size_t n)
+{
+    size_t i = 0;
+#ifdef BITTER_X86
+    if (cpu_features() & CPU_AVX2) i = logic_avx2(op, dst, a, b, n);
+#endif
+    switch (op) {
+    case LOGIC_AND: LOGIC_LOOP(1, dst[i] = a[i] & b[i]) break;
+    case LOGIC_OR: LOGIC_LOOP(1, dst[i] = a[i] | b[i]) break;
+    case LOGIC_XOR: LOGIC_LOOP(1, dst[i] = a[i] ^ b[i]) break;
+    default: LOGIC_LOOP(1, dst[i] = ~a[i]) break;
+    }
+}
+
+// dst = a op b, then bits past the last value cleared
+static void logic_apply(LOGIC_OP op, BitArray *dst, const BitArray *a,
+  const BitArray *b)
+{
+    const size_t n_words = logic_n_words(a);
+    const size_t tail = (size_t) a->n * a->element_size % 32;
+
+    logic_words(op, dst->v, a->v, b->v, n_words);
+    if (tail) dst->v[n_words - 1] &= 0xFFFFFFFFu >> (32 - tail);
+}
+
+static BitArray* logic_new(LOGIC_OP op, const BitArray *a, const BitArray *b)
+{
+    logic_check(a, b);
+    BitArray *r = BitArray_calloc(a->n, (uint8_t) a->element_size, sizeof(uint32_t));
+    logic_apply(op, r, a, b);
+    return r;
+}
+
+BitArray* BitArray_and(const BitArray *a, const BitArray *b)
+{
+    return logic_new(LOGIC_AND, a, b);
+}
+
+BitArray* BitArray_or(const BitArray *a, const BitArray *b)
+{
+    return logic_new(LOGIC_OR, a, b);
+}
+
+BitArray* BitArray_xor(const BitArray *a, const BitArray *b)
+{
+    return logic_new(LOGIC_XOR, a, b);
+}
+
+BitArray* BitArray_not(const BitArray *a)
+{
+    return logic_new(LOGIC_NOT, a, a);
+}
+
+void BitArray_and_inplace(BitArray *a, const BitArray *b)
+{
+    logic_check(a, b);
+    logic_apply(LOGIC_AND, a, a, b);
+}
+
+void BitArray_or_inplace(BitArray *a, const BitArray *b)
+{
+    logic_check(a, b);
+    logic_apply(LOGIC_OR, a, a, b);
+}
+
+void BitArray_xor_inplace(BitArray *a, const BitArray *b)
+{
+    logic_check(a, b);
+    logic_apply(LOGIC_XOR, a, a, b);
+}
+
+void BitArray_not_inplace(BitArray *a)
+{
+    logic_apply(LOGIC_NOT, a, a, a);
+}
+
+
+// -- Population count --------------------------------------------------------
+/*
+ * Set bits of n words, two at a time. Instantiated twice so the loop can use
+ * popcnt when the CPU has it, independent of the flags the library was built
+ * with.
+ */
+#define COUNT_WORDS(NAME, POPCOUNT)                                           \
+static size_t NAME(const uint32_t *w, size_t n)                               \
+{                                                                             \
+    size_t count = 0, i = 0;                                                  \
+    for (; i + 2 <= n; i += 2) count += POPCOUNT(w[i] | (uint64_t) w[i+1] << 32); \
+    if (i < n) count += POPCOUNT((uint64_t) w[i]);                            \
+    return count;                                                             \
+}
+
+COUNT_WORDS(count_words_portable, popcount64)
+
+#ifdef BITTER_X86
+__attribute__((target("popcnt")))
+COUNT_WORDS(count_words_popcnt, (uint64_t) __builtin_popcountll)
+
+/*
+ * Nibble lookup (Mula, Kurz and Lemire, "Faster population counts using AVX2
+ * instructions"). Byte counts are summed per 64 bit lane with sad every 31
+ * vectors, before a byte can overflow. Counts words [0, n / 8 * 8).
+ */
+__attribute__((target("avx2")))
+static size_t count_words_avx2(const uint32_t *w, size_t n)
+{
+    const __m256i lookup = _mm256_setr_epi8(
+                    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4),
+                  low = _mm256_set1_epi8(0x0F),
+                  zero = _mm256_setzero_si256();
+    __m256i total = zero;
+    size_t i = 0;
+
+    while (i + 8 <= n) {
+        __m256i bytes = zero;
+        for (unsigned k = 0; k < 31 && i + 8 <= n; ++k, i += 8) {
+            const __m256i v = _mm256_loadu_si256((const __m256i *) (w + i));
+            bytes = _mm256_add_epi8(bytes, _mm256_add_epi8(
+              _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low)),
+              _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low))));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(bytes, zero));
+    }
+
+    uint64_t sums[4];
+    _mm256_storeu_si256((__m256i *) sums, total);
+    return (size_t) (sums[0] + sums[1] + sums[2] + sums[3]);
+}
+
+// All n words, the last partial vector through a masked load
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static size_t count_words_avx512(const uint32_t *w, size_t n)
+{
+    __m512i acc0 = _mm512_setzero_si512(), acc1 = _mm512_setzero_si512();
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm512_add_epi64(acc0, _mm512_popcnt_epi64(_mm512_loadu_si512(w + i)));
+        acc1 = _mm512_add_epi64(acc1, _mm512_popcnt_epi64(_mm512_loadu_si512(w + i + 16)));
+    }
+    for (; i < n; i += 16) {
+        const size_t left = n - i;
+        const __mmask16 m = (__mmask16) (left >= 16 ? 0xFFFF : (1u << left) - 1);
+        acc0 = _mm512_add_epi64(acc0, _mm512_popcnt_epi64(_mm512_maskz_loadu_epi32(m, w + i)));
+    }
+    return (size_t) _mm512_reduce_add_epi64(_mm512_add_epi64(acc0, acc1));
+}
+#endif
+
+static size_t count_words(const uint32_t *w, size_t n)
+{
+    size_t count = 0, i = 0;
+#ifdef BITTER_X86
+    const unsigned int features = cpu_features();
+    if (features & CPU_AVX512_VPOPCNT) return count_words_avx512(w, n);
+    if (features & CPU_AVX2) {
+        i = n / 8 * 8;
+        count = count_words_avx2(w, i);
+    }
+    if (features & CPU_POPCNT) return count + count_words_popcnt(w + i, n - i);
+#endif
+    return count + count_words_portable(w + i, n - i);
+}
+
+size_t BitArray_popcount(const BitArray *bitarr)
+{
+    return BitArray_popcount_range(bitarr, 0, bitarr->n);
+}
+
+size_t BitArray_popcount_range(const BitArray *bitarr, size_t start,
+  size_t end)
+{
+    if (start > end || end > bitarr->n) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+    const size_t s = start * bitarr->element_size, e = end * bitarr->element_size;
+    if (s == e) return 0;
+
+    // First and last word touched, partially covered at either end
+    const size_t first = s / 32, last = (e - 1) / 32;
+    const uint32_t lo = 0xFFFFFFFFu << (s % 32),
+                   hi = 0xFFFFFFFFu >> (31 - (e - 1) % 32);
+    if (first == last) return popcount64(bitarr->v[first] & lo & hi);
+
+    return popcount64(bitarr->v[first] & lo) +
+      count_words(bitarr->v + first + 1, last - first - 1) +
+      popcount64(bitarr->v[last] & hi);
+}
@@ -0,0 +1,112 @@
+/**
+ * @file
+ * @brief Whole array bitwise operations and population counts
+ *
+ * Operations work on the packed words, so combining two arrays of the same
+ * length and element size combines every pair of values bit by bit, and a
+ * pair of 1 bit arrays is combined as two masks. Bits past the last value
+ * are kept at 0, BitArray_not included.
+ *
+ * Each operation comes out of place, returning a new heap BitArray, and in
+ * place, overwriting its first argument.
+ *
+ * Word loops run 256 bits at a time with AVX2 when the CPU supports it.
+ * Population counts use VPOPCNTQ on 512 bits when the CPU has AVX-512
+ * VPOPCNTDQ, a nibble lookup with AVX2 otherwise, and popcnt or the
+ * portable popcount64 on the remaining words.
+ */
+
+#ifndef BITARR_LOGIC_H_
+#define BITARR_LOGIC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bitarr.h"
+
+/**
+ * @brief a & b
+ *
+ * @param a
+ * @param b     Same n and element_size as a
+ * @return      Pointer to a new BitArray
+ */
+BitArray* BitArray_and(const BitArray *a, const BitArray *b);
+
+/**
+ * @brief a | b
+ *
+ * @param a
+ * @param b     Same n and element_size as a
+ * @return      Pointer to a new BitArray
+ */
+BitArray* BitArray_or(const BitArray *a, const BitArray *b);
+
+/**
+ * @brief a ^ b
+ *
+ * @param a
+ * @param b     Same n and element_size as a
+ * @return      Pointer to a new BitArray
+ */
+BitArray* BitArray_xor(const BitArray *a, const BitArray *b);
+
+/**
+ * @brief ~a, each value complemented within its element_size bits
+ *
+ * @param a
+ * @return      Pointer to a new BitArray
+ */
+BitArray* BitArray_not(const BitArray *a);
+
+/**
+ * @brief a &= b
+ *
+ * @param a
+ * @param b     Same n and element_size as a
+ */
+void BitArray_and_inplace(BitArray *a, const BitArray *b);
+
+/**
+ * @brief a |= b
+ *
+ * @param a
+ * @param b     Same n and element_size as a
+ */
+void BitArray_or_inplace(BitArray *a, const BitArray *b);
+
+/**
+ * @brief a ^= b
+ *
+ * @param a
+ * @param b     Same n and element_size as a
+ */
+void BitArray_xor_inplace(BitArray *a, const BitArray *b);
+
+/**
+ * @brief a = ~a
+ *
+ * @param a
+ */
+void BitArray_not_inplace(BitArray *a);
+
+/**
+ * @brief Number of set bits over all values
+ *
+ * @param bitarr
+ */
+size_t BitArray_popcount(const BitArray *bitarr);
+
+/**
+ * @brief Number of set bits of the values in [start, end)
+ *
+ * For a 1 bit BitArray this counts the ones between two bit positions,
+ * which need not fall on word boundaries.
+ *
+ * @param bitarr
+ * @param start     First value, start <= end
+ * @param end       One past the last value, end <= n
+ */
+size_t BitArray_popcount_range(const BitArray *bitarr, size_t start,
+  size_t end);
+
+#endif // !BITARR_LOGIC_H_
@@ -0,0 +1,425 @@
+/**
+ * @file
+ * @brief Predicate scans and aggregates over packed BitArray values
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitarr_scan.h"
+#include "bitops.h"
+#include "cpu.h"
+#include "encoding.h"
+
+#if defined(BITTER_X86) && defined(BITTER_LITTLE_ENDIAN)
+#include <immintrin.h>
+#define SCAN_AVX2 1
+#endif
+
+// Mask of the lowest w bits, valid for w in [1, 32]
+#define MASK(w) (0xFFFFFFFFu >> (32 - (w)))
+// Mask of the lowest n bits, valid for n in [0, 64]
+#define MASK64(n) ((n) >= 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << (n)) - 1)
+
+// Aggregates computed by a reduction
+enum { SCAN_SUM = 1, SCAN_MIN = 2, SCAN_MAX = 4 };
+
+typedef struct {
+  uint64_t sum;
+  uint32_t min;
+  uint32_t max;
+} ScanTotals;
+
+// 64 bits starting at bit pos, bits past the last word read as 0
+static inline uint64_t scan_load(const uint32_t *W, size_t n_words, size_t pos)
+{
+    const size_t j = pos / 32;
+    const unsigned off = (unsigned) (pos % 32);
+    uint64_t x = W[j];
+
+    if (j + 1 < n_words) x |= (uint64_t) W[j + 1] << 32;
+    x >>= off;
+    if (off && j + 2 < n_words) x |= (uint64_t) W[j + 2] << (64 - off);
+    return x;
+}
+
+
+// -- SWAR --------------------------------------------------------------------
+/*
+ * k lanes of w bits packed from bit 0, lo and hi hold the lowest and the
+ * highest bit of every lane.
+ */
+typedef struct {
+  unsigned k;
+  uint64_t lo;
+  uint64_t hi;
+  uint64_t lanes;
+} SwarLanes;
+
+static SwarLanes swar_lanes(unsigned w)
+{
+    SwarLanes L = { 64 / w, 0, 0, 0 };
+    for (unsigned l = 0; l < L.k; ++l) L.lo |= (uint64_t) 1 << (l * w);
+    L.hi = L.lo << (w - 1);
+    L.lanes = MASK64(L.k * w);
+    return L;
+}
+
+/*
+ * Top bit of every lane where x < y. Setting the top bit of x before the
+ * subtraction absorbs the borrow of the lower bits, so lanes never borrow
+ * from each other, and the top bits are then compared on their own.
+ */
+static inline uint64_t swar_lt(uint64_t x, uint64_t y, uint64_t hi)
+{
+    const uint64_t d = (x | hi) - (y & ~hi);
+    return ((~x & y) | (~(x ^ y) & ~d)) & hi;
+}
+
+// Top bit of every lane where x == y
+static inline uint64_t swar_eq(uint64_t x, uint64_t y, const SwarLanes *L)
+{
+    const uint64_t z = x ^ y, low = L->lanes & ~L->hi;
+    // Adding low carries into the top bit of every lane with a low bit set
+    return ~(((z & low) + low) | z) & L->hi;
+}
+
+// Every lane set to all ones where its top bit is set in hits
+static inline uint64_t swar_spread(uint64_t hits, unsigned w)
+{
+    return (hits >> (w - 1)) * MASK(w);
+}
+
+// The top bits of the lanes in hits moved to the low bits, one per lane
+static inline uint64_t swar_compress(uint64_t hits, const SwarLanes *L,
+  unsigned w)
+{
+#if defined(__BMI2__)
+    (void) w;
+    return _pext_u64(hits, L->hi);
+#else
+    (void) L;
+    if (w == 1) return hits;
+    uint64_t bits = 0;
+    for (; hits; hits &= hits - 1) {
+        bits |= (uint64_t) 1 << ((unsigned) __builtin_ctzll(hits) / w);
+    }
+    return bits;
+#endif
+}
+
+static size_t scan_swar(const uint32_t *W, size_t n_words, unsigned w,
+  size_t i, size_t end, SCAN_OP op, uint32_t a, uint32_t b, BitWriter *out)
+{
+    const SwarLanes L = swar_lanes(w);
+    const uint64_t va = a * L.lo, vb = b * L.lo;
+    size_t count = 0;
+
+    for (; i < end; i += L.k) {
+        const unsigned m = end - i < L.k ? (unsigned) (end - i) : L.k;
+        const uint64_t valid = MASK64(m * w),
+                       x = scan_load(W, n_words, i * w) & valid;
+        uint64_t hits;
+        switch (op) {
+        case SCAN_EQ:
+            hits = swar_eq(x, va, &L);
+            break;
+        case SCAN_LT:
+            hits = swar_lt(x, va, L.hi);
+            break;
+        default:
+            hits = ~(swar_lt(x, va, L.hi) | swar_lt(vb, x, L.hi)) & L.hi;
+            break;
+        }
+        hits &= valid;
+        count += popcount64(hits);
+
+        if (out) {
+            const uint64_t bits = swar_compress(hits, &L, w);
+            if (m > 32) {
+                BitWriter_write(out, bits, 32);
+                BitWriter_write(out, bits >> 32, m - 32);
+            } else {
+                BitWriter_write(out, bits, m);
+            }
+        }
+    }
+    return count;
+}
+
+/*
+ * Sums fold pairs of lanes into lanes twice as wide until a single lane is
+ * left, a lane of w << s bits never holding more than w + s significant bits.
+ * Minimum and maximum are kept lane by lane and only combined at the end.
+ */
+static void reduce_swar(const uint32_t *W, size_t n_words, unsigned w,
+  size_t i, size_t end, unsigned what, ScanTotals *t)
+{
+    const SwarLanes L = swar_lanes(w);
+    uint64_t fold[6], mn = L.lanes, mx = 0;
+    unsigned n_fold = 0;
+
+    for (unsigned ws = w; ws < L.k * w; ws *= 2) {
+        uint64_t f = 0;
+        for (unsigned s = 0; s < 64; s += 2 * ws) f |= MASK64(ws) << s;
+        fold[n_fold++] = f;
+    }
+
+    for (; i < end; i += L.k) {
+        const unsigned m = end - i < L.k ? (unsigned) (end - i) : L.k;
+        const uint64_t valid = MASK64(m * w),
+                       x = scan_load(W, n_words, i * w) & valid;
+        if (what & SCAN_SUM) {
+            uint64_t s = x;
+            for (unsigned f = 0, ws = w; f < n_fold; ++f, ws *= 2) {
+                s = (s & fold[f]) + (s >> ws & fold[f]);
+            }
+            t->sum += s;
+        }
+        if (what & SCAN_MIN) {
+            // Missing lanes of the last group must not win
+            const uint64_t y = x | (L.lanes & ~valid),
+                           take = swar_spread(swar_lt(y, mn, L.hi), w);
+            mn = (y & take) | (mn & ~take);
+        }
+        if (what & SCAN_MAX) {
+            const uint64_t take = swar_spread(swar_lt(mx, x, L.hi), w);
+            mx = (x & take) | (mx & ~take);
+        }
+    }
+
+    for (unsigned l = 0; l < L.k; ++l) {
+        const uint32_t lo = (uint32_t) (mn >> (l * w)) & MASK(w),
+                       hi = (uint32_t) (mx >> (l * w)) & MASK(w);
+        if (lo < t->min) t->min = lo;
+        if (hi > t->max) t->max = hi;
+    }
+}
+
+
+// -- AVX2 --------------------------------------------------------------------
+#ifdef SCAN_AVX2
+/*
+ * Groups of 8 values are decoded as in bitpack.c: with i a multiple of 8 a
+ * group starts on a byte boundary and spans w bytes, and lane l finds its
+ * value at bit l * w of the group.
+ */
+typedef struct {
+  uint32_t idx[8];
+  uint32_t shr[8];
+  uint32_t shl[8];
+} ScanGroup;
+
+static void scan_group(ScanGroup *g, unsigned w)
+{
+    for (uint32_t l = 0; l < 8; ++l) {
+        const uint32_t s = l * w;
+        g->idx[l] = s / 32;
+        g->shr[l] = s % 32;
+        g->shl[l] = 32 - g->shr[l];
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i scan_load8(const uint8_t *p, __m256i idx, __m256i shr,
+  __m256i shl, __m256i mask)
+{
+    const __m256i lo = _mm256_loadu_si256((const __m256i *) p),
+                  hi = _mm256_loadu_si256((const __m256i *) (p + 4)),
+                  a = _mm256_permutevar8x32_epi32(lo, idx),
+                  b = _mm256_permutevar8x32_epi32(hi, idx);
+    return _mm256_and_si256(_mm256_or_si256(_mm256_srlv_epi32(a, shr),
+      _mm256_sllv_epi32(b, shl)), mask);
+}
+
+/*
+ * x < a is tested as min(x, a - 1) == x, and a <= x <= b as
+ * min(x - a, b - a) == x - a, which avoids signed compares.
+ *
+ * Returns the index of the first value not scanned.
+ */
+__attribute__((target("avx2")))
+static size_t scan_avx2(const uint32_t *W, size_t n_words, unsigned w,
+  size_t i, size_t end, SCAN_OP op, uint32_t a, uint32_t b, size_t *count,
+  BitWriter *out)
+{
+    ScanGroup g;
+    scan_group(&g, w);
+    const __m256i idx = _mm256_loadu_si256((const __m256i *) g.idx),
+                  shr = _mm256_loadu_si256((const __m256i *) g.shr),
+                  shl = _mm256_loadu_si256((const __m256i *) g.shl),
+                  mask = _mm256_set1_epi32((int) MASK(w)),
+                  va = _mm256_set1_epi32((int) a),
+                  vr = _mm256_set1_epi32((int) (op == SCAN_LT ? a - 1 : b - a));
+    const uint8_t *bytes = (const uint8_t *) W;
+    const size_t n_bytes = n_words * sizeof(uint32_t);
+    // Matches are -1 lanes, counted per lane and added up at the end
+    __m256i hits = _mm256_setzero_si256();
+
+    // Stop while both 32 byte loads stay inside the array
+    for (; i + 8 <= end && (i / 8) * w + 36 <= n_bytes; i += 8) {
+        const __m256i v = scan_load8(bytes + (i / 8) * w, idx, shr, shl, mask);
+        __m256i m;
+        if (op == SCAN_EQ) {
+            m = _mm256_cmpeq_epi32(v, va);
+        } else {
+            const __m256i d = op == SCAN_LT ? v : _mm256_sub_epi32(v, va);
+            m = _mm256_cmpeq_epi32(_mm256_min_epu32(d, vr), d);
+        }
+        hits = _mm256_sub_epi32(hits, m);
+        if (out) BitWriter_write(out, (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(m)), 8);
+    }
+
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i *) lanes, hits);
+    for (int l = 0; l < 8; ++l) *count += lanes[l];
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t reduce_avx2(const uint32_t *W, size_t n_words, unsigned w,
+  size_t i, size_t end, unsigned what, ScanTotals *t)
+{
+    ScanGroup g;
+    scan_group(&g, w);
+    const __m256i idx = _mm256_loadu_si256((const __m256i *) g.idx),
+                  shr = _mm256_loadu_si256((const __m256i *) g.shr),
+                  shl = _mm256_loadu_si256((const __m256i *) g.shl),
+                  mask = _mm256_set1_epi32((int) MASK(w));
+    const uint8_t *bytes = (const uint8_t *) W;
+    const size_t n_bytes = n_words * sizeof(uint32_t);
+    __m256i sum = _mm256_setzero_si256(),
+            mn = _mm256_set1_epi32(-1),
+            mx = _mm256_setzero_si256();
+
+    for (; i + 8 <= end && (i / 8) * w + 36 <= n_bytes; i += 8) {
+        const __m256i v = scan_load8(bytes + (i / 8) * w, idx, shr, shl, mask);
+        if (what & SCAN_SUM) {
+            sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)));
+            sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1)));
+        }
+        if (what & SCAN_MIN) mn = _mm256_min_epu32(mn, v);
+        if (what & SCAN_MAX) mx = _mm256_max_epu32(mx, v);
+    }
+
+    uint64_t sums[4];
+    uint32_t mins[8], maxs[8];
+    _mm256_storeu_si256((__m256i *) sums, sum);
+    _mm256_storeu_si256((__m256i *) mins, mn);
+    _mm256_storeu_si256((__m256i *) maxs, mx);
+    t->sum += sums[0] + sums[1] + sums[2] + sums[3];
+    for (int l = 0; l < 8; ++l) {
+        if (mins[l] < t->min) t->min = mins[l];
+        if (maxs[l] > t->max) t->max = maxs[l];
+    }
+    return i;
+}
+#endif
+
+
+// -- Public ------------------------------------------------------------------
+/*
+ * Operands outside of [0, MASK(w)] are clamped, which can leave a predicate
+ * that matches nothing or everything.
+ */
+enum { SCAN_NONE, SCAN_ALL, SCAN_RUN };
+
+static int scan_normalize(unsigned w, SCAN_OP *op, uint32_t *a, uint32_t *b)
+{
+    const uint32_t top = MASK(w);
+    switch (*op) {
+    case SCAN_EQ:
+        return *a > top ? SCAN_NONE : SCAN_RUN;
+    case SCAN_LT:
+        if (*a == 0) return SCAN_NONE;
+        return *a > top ? SCAN_ALL : SCAN_RUN;
+    default:
+        if (*a > *b || *a > top) return SCAN_NONE;
+        if (*b > top) *b = top;
+        if (*a == 0 && *b == top) return SCAN_ALL;
+        if (*a == *b) *op = SCAN_EQ;
+        else if (*a == 0) {
+            *op = SCAN_LT;
+            *a = *b + 1;
+        }
+        return SCAN_RUN;
+    }
+}
+
+static size_t scan(const BitArray *bitarr, SCAN_OP op, uint32_t a, uint32_t b,
+  uint32_t *bitmap)
+{
+    const unsigned w = (unsigned) bitarr->element_size;
+    const size_t n = bitarr->n, n_words = (n * w + 31) / 32;
+    BitWriter writer = { bitmap, 0 }, *out = bitmap ? &writer : NULL;
+    size_t i = 0, count = 0;
+
+    if (bitmap) memset(bitmap, 0, sizeof(uint32_t) * ((n + 31) / 32));
+
+    switch (scan_normalize(w, &op, &a, &b)) {
+    case SCAN_NONE:
+        return 0;
+    case SCAN_ALL:
+        for (; out && i < n; i += 32) {
+            BitWriter_write(out, 0xFFFFFFFFu, n - i < 32 ? (unsigned) (n - i) : 32);
+        }
+        return n;
+    default:
+        break;
+    }
+
+#ifdef SCAN_AVX2
+    if (cpu_features() & CPU_AVX2) {
+        i = scan_avx2(bitarr->v, n_words, w, i, n, op, a, b, &count, out);
+    }
+#endif
+    return count + scan_swar(bitarr->v, n_words, w, i, n, op, a, b, out);
+}
+
+static ScanTotals reduce(const BitArray *bitarr, unsigned what)
+{
+    const unsigned w = (unsigned) bitarr->element_size;
+    const size_t n = bitarr->n, n_words = (n * w + 31) / 32;
+    ScanTotals t = { 0, UINT32_MAX, 0 };
+    size_t i = 0;
+
+    if ((what & (SCAN_MIN | SCAN_MAX)) && n == 0) {
+        fprintf(stderr, "%s:%d Empty BitArray\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+#ifdef SCAN_AVX2
+    if (cpu_features() & CPU_AVX2) {
+        i = reduce_avx2(bitarr->v, n_words, w, i, n, what, &t);
+    }
+#endif
+    reduce_swar(bitarr->v, n_words, w, i, n, what, &t);
+    return t;
+}
+
+size_t BitArray_count(const BitArray *bitarr, SCAN_OP op, uint32_t a,
+  uint32_t b)
+{
+    return scan(bitarr, op, a, b, NULL);
+}
+
+size_t BitArray_filter(const BitArray *bitarr, SCAN_OP op, uint32_t a,
+  uint32_t b, uint32_t *bitmap)
+{
+    return scan(bitarr, op, a, b, bitmap);
+}
+
+uint64_t BitArray_sum(const BitArray *bitarr)
+{
+    return reduce(bitarr, SCAN_SUM).sum;
+}
+
+uint32_t BitArray_min(const BitArray *bitarr)
+{
+    return reduce(bitarr, SCAN_MIN).min;
+}
+
+uint32_t BitArray_max(const BitArray *bitarr)
+{
+    return reduce(bitarr, SCAN_MAX).max;
+}
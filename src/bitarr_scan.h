@@ -0,0 +1,82 @@
+/**
+ * @file
+ * @brief Predicate scans and aggregates over packed BitArray values
+ *
+ * Values are compared and summed straight from the packed words, without
+ * unpacking them to a buffer first.
+ *
+ * The portable kernels are SWAR (SIMD within a register): 64 bits are
+ * loaded at the start of each group of k = 64 / element_size values, so
+ * the k lanes sit at bits [l * w, (l+1) * w) with no spare bit between them.
+ * Lanes are compared with borrow free subtraction, giving the result in the
+ * top bit of every lane (Hacker's Delight, 2.18), and summed by folding
+ * pairs of lanes into lanes twice as wide. Bitmaps gather the lane results
+ * with pext when the build targets BMI2.
+ *
+ * When the CPU supports AVX2, groups of 8 values are decoded into a vector
+ * register (see bitpack.c) and compared, summed or reduced there instead.
+ * Both paths handle every element_size from 1 to 32.
+ */
+
+#ifndef BITARR_SCAN_H_
+#define BITARR_SCAN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bitarr.h"
+
+typedef enum {
+  SCAN_EQ,          // x == a
+  SCAN_LT,          // x < a
+  SCAN_BETWEEN      // a <= x <= b
+} SCAN_OP;
+
+/**
+ * @brief Number of values matching a predicate
+ *
+ * @param bitarr    Values to scan
+ * @param op        Predicate
+ * @param a         First operand
+ * @param b         Second operand, only used by SCAN_BETWEEN
+ */
+size_t BitArray_count(const BitArray *bitarr, SCAN_OP op, uint32_t a,
+  uint32_t b);
+
+/**
+ * @brief Bitmap of the values matching a predicate
+ *
+ * Bit i of bitmap is set when value i matches. The bitmap has the layout of
+ * a 1 bit BitArray, so it can be indexed by a RankSelectBitVector.
+ *
+ * @param bitarr    Values to scan
+ * @param op        Predicate
+ * @param a         First operand
+ * @param b         Second operand, only used by SCAN_BETWEEN
+ * @param bitmap    (n + 31) / 32 words, overwritten
+ * @return          Number of values matching
+ */
+size_t BitArray_filter(const BitArray *bitarr, SCAN_OP op, uint32_t a,
+  uint32_t b, uint32_t *bitmap);
+
+/**
+ * @brief Sum of all values
+ *
+ * @param bitarr
+ */
+uint64_t BitArray_sum(const BitArray *bitarr);
+
+/**
+ * @brief Smallest value
+ *
+ * @param bitarr    BitArray with n > 0
+ */
+uint32_t BitArray_min(const BitArray *bitarr);
+
+/**
+ * @brief Largest value
+ *
+ * @param bitarr    BitArray with n > 0
+ */
+uint32_t BitArray_max(const BitArray *bitarr);
+
+#endif // !BITARR_SCAN_H_
@@ -0,0 +1,92 @@
+/**
+ * @file
+ * @brief BitArray accessors specialized for an element size known at compile
+ * time
+ *
+ * BITARR_DEFINE(name, W) defines static inline functions for BitArrays
+ * whose element_size is the constant W:
+ *
+ *   BitArray* bitarr_name_calloc(uint32_t n)
+ *   uint32_t  bitarr_name_get(const BitArray *a, size_t i)
+ *   void      bitarr_name_set(BitArray *a, size_t i, uint32_t x)
+ *   void      bitarr_name_unpack(const BitArray *a, size_t start, size_t count, uint32_t out[])
+ *   void      bitarr_name_pack(BitArray *a, size_t start, size_t count, const uint32_t in[])
+ *
+ * With W constant, divisions become shifts and masks, and an element
+ * spanning two words is handled without a branch: get always loads word j
+ * and word j + (off + W > 32), which is word j again when the element fits,
+ * and set stores both with a mask that is empty for the second when
+ * unneeded. Arrays are ordinary BitArrays, so both APIs can be mixed.
+ *
+ * Like the 64 bit word accessors in bitops.h, indexes are not checked.
+ *
+ *   BITARR_DEFINE(u5, 5)
+ *
+ *   BitArray *a = bitarr_u5_calloc(n);
+ *   bitarr_u5_set(a, 3, 17);
+ *   uint32_t x = bitarr_u5_get(a, 3);
+ */
+
+#ifndef BITARR_STATIC_H_
+#define BITARR_STATIC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bitarr.h"
+#include "bitpack.h"
+
+#define BITARR_DEFINE(name, W)                                                \
+_Static_assert((W) >= 1 && (W) <= 32, "element size must be 1-32 bits");     \
+                                                                              \
+static inline BitArray* bitarr_##name##_calloc(uint32_t n)                   \
+{                                                                             \
+    return BitArray_calloc(n, (W), sizeof(uint32_t));                         \
+}                                                                             \
+                                                                              \
+static inline uint32_t bitarr_##name##_get(const BitArray *a, size_t i)      \
+{                                                                             \
+    const size_t bit = i * (W), j = bit / 32;                                 \
+    const unsigned off = (unsigned) (bit % 32);                               \
+    const uint64_t pair = a->v[j] |                                           \
+      (uint64_t) a->v[j + (off + (W) > 32)] << 32;                            \
+    return (uint32_t) (pair >> off) & (0xFFFFFFFFu >> (32 - (W)));            \
+}                                                                             \
+                                                                              \
+static inline void bitarr_##name##_set(BitArray *a, size_t i, uint32_t x)    \
+{                                                                             \
+    const size_t bit = i * (W), j = bit / 32;                                 \
+    const unsigned off = (unsigned) (bit % 32);                               \
+    const uint64_t mask = (uint64_t) (0xFFFFFFFFu >> (32 - (W))) << off,     \
+                   val = ((uint64_t) x << off) & mask;                        \
+    a->v[j] = (a->v[j] & ~(uint32_t) mask) | (uint32_t) val;                  \
+    uint32_t *hi = &a->v[j + (off + (W) > 32)];                               \
+    *hi = (*hi & ~(uint32_t) (mask >> 32)) | (uint32_t) (val >> 32);          \
+}                                                                             \
+                                                                              \
+static inline void bitarr_##name##_unpack(const BitArray *a, size_t start,   \
+  size_t count, uint32_t out[])                                               \
+{                                                                             \
+    /* Long runs go through the width specialized block kernels */          \
+    if (count >= BITPACK_BLOCK) {                                             \
+        bitpack_unpack(a->v, ((size_t) a->n * (W) + 31) / 32, (W), start,     \
+          count, out);                                                        \
+        return;                                                               \
+    }                                                                         \
+    for (size_t i = 0; i < count; ++i) {                                      \
+        out[i] = bitarr_##name##_get(a, start + i);                           \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+static inline void bitarr_##name##_pack(BitArray *a, size_t start,           \
+  size_t count, const uint32_t in[])                                          \
+{                                                                             \
+    if (count >= BITPACK_BLOCK) {                                             \
+        bitpack_pack(a->v, (W), start, count, in);                            \
+        return;                                                               \
+    }                                                                         \
+    for (size_t i = 0; i < count; ++i) {                                      \
+        bitarr_##name##_set(a, start + i, in[i]);                             \
+    }                                                                         \
+}
+
+#endif // !BITARR_STATIC_H_
@@ -1,102 +1,502 @@
 #include "bitarr_vl.h"
 #include "bitops.h"
 #include "encoding.h"
+#include "cpu.h"
+#include "parallel.h"
 
 void VLBitArray_free(VLBitArray *bit_arr)
 {
-    free(bit_arr->W);
+    if (!bit_arr->W_inline) free(bit_arr->W);
     free(bit_arr);
 }
 
+void VLBitArray_free_with(VLBitArray *bit_arr, const BitAllocator *allocator)
+{
+    bit_free(allocator, bit_arr);
+}
+
+// Number of bits of the code of x
+static size_t vl_code_bits(VL_CODEC codec, unsigned int param, uint32_t x)
+{
+    switch (codec) {
+    case VL_DELTA: return delta_bits((uint64_t) x + 1);
+    case VL_RICE: return rice_bits(x, param);
+    case VL_VARBYTE: return varbyte_bits(x);
+    default: return gamma_bits((uint64_t) x + 1);
+    }
+}
+
+static void vl_code_write(VL_CODEC codec, unsigned int param, BitWriter *w,
+  uint32_t x)
+{
+    switch (codec) {
+    case VL_DELTA: delta_write(w, (uint64_t) x + 1); break;
+    case VL_RICE: rice_write(w, x, param); break;
+    case VL_VARBYTE: varbyte_write(w, x); break;
+    default: gamma_write(w, (uint64_t) x + 1); break;
+    }
+}
+
+// Next value of the stream
+static inline uint32_t vl_code_read(const VLBitArray *bit_arr, BitReader *r)
+{
+    switch (bit_arr->codec) {
+    case VL_DELTA: return (uint32_t) (delta_read(r) - 1);
+    case VL_RICE: return (uint32_t) rice_read(r, bit_arr->param);
+    case VL_VARBYTE: return (uint32_t) varbyte_read(r);
+    default: return (uint32_t) (gamma_read(r) - 1);
+    }
+}
+
 VLBitArray *VLBitArray_init(unsigned int A[], size_t length, size_t k, size_t size)
 {
+    return VLBitArray_init_codec(A, length, k, size, VL_GAMMA, 0);
+}
 
-    // bytes -> bits
-    size_t size_bits = size * 8;
+// Rice parameter to use, tuned on A for VL_RICE_AUTO
+static unsigned int vl_param(const unsigned int A[], size_t length,
+  VL_CODEC codec, int param)
+{
+    if (codec != VL_RICE) return 0;
+    unsigned int b = param < 0 ? rice_tune(A, length) : (unsigned int) param;
+    if (b > 31) {
+        fprintf(stderr, "%s:%d Rice parameter out of range\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+    return b;
+}
 
+// Allocate the struct and P, with every member but W and its sizes set
+static VLBitArray* vl_alloc(const unsigned int A[], size_t length, size_t k,
+  size_t size, VL_CODEC codec, int param)
+{
     // Find length of P
-    int p_len = ceil_int(length, k);
+    size_t p_len = (length + k - 1) / k;
     // Allocate struct and pointer vla
     VLBitArray *vlb = calloc(1, sizeof(VLBitArray) + sizeof(size_t) * p_len);
+    if (vlb == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
 
-    size_t current_p_pos = 0;
-    // Create array of size the length of A
-    uint32_t gamma_A = 0,
-             g_length = 0,
-             g_offset = 0,
-             A_copy[length]; // Empty array of same size
-
-    for (size_t i = 0, j = 0; i < length; ++i) {
-        // Encode value as A[i] + 1 (gamma encoding can't be zero)
-        // code will be (g_offset << (g_length+1) | ((1 << g_length)))
-        g_length = (uint32_t) log2(A[i] + 1);
-        g_offset = (A[i] + 1) - (1 << g_length);
-
-        // Gamma code is of size length * 2
-        size_t p_increment = g_length * 2 + 1;
-
-        // Write gamma code of A[i] to array
-        bit_write_range(
-            A_copy,
-            size_bits,
-            current_p_pos,
-            current_p_pos + p_increment,
-            // Encode as g_offset.g_length
-            (g_offset << (g_length+1) | ((1 << g_length)))
-        );
+    // Set struct members
+    vlb->k = k;
+    vlb->length = length;
+    // bytes -> bits
+    vlb->element_size = size * 8;
+    vlb->codec = codec;
+    vlb->param = vl_param(A, length, codec, param);
+    return vlb;
+}
 
-        // Assign current bit idx to pointer array
-        if (i % k == 0) vlb->P[j++] = current_p_pos;
-        current_p_pos += p_increment;
+// Allocate W for logical_size bits
+static void vl_alloc_W(VLBitArray *vlb, size_t logical_size)
+{
+    // Maximum number of elements of word size we need to fit total number of bits
+    size_t max_idx = (logical_size + vlb->element_size - 1) / vlb->element_size;
+    vlb->W = calloc(max_idx ? max_idx : 1, vlb->element_size / 8);
+    if (vlb->W == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
     }
+    vlb->logical_size = logical_size;
+    vlb->physical_size = max_idx;
+}
 
-    // Maximum number of elements of word size we need to fit total number of bits
-    size_t max_idx = ceil_int(current_p_pos, size_bits);
-    // Allocate array, and copy over only the needed bits from A_copy
-    vlb->W = malloc((size) * max_idx);
-    memcpy(vlb->W, A_copy, (size) * max_idx);
+VLBitArray *VLBitArray_init_codec(const unsigned int A[], size_t length,
+  size_t k, size_t size, VL_CODEC codec, int param)
+{
+    return VLBitArray_init_with(A, length, k, size, codec, param, &bit_heap_allocator);
+}
 
-    // Set struct members
+VLBitArray *VLBitArray_init_with(const unsigned int A[], size_t length,
+  size_t k, size_t size, VL_CODEC codec, int param,
+  const BitAllocator *allocator)
+{
+    const unsigned int b = vl_param(A, length, codec, param);
+
+    // First pass sizes the codes, so struct, P and W are allocated at once
+    size_t logical_size = 0;
+    for (size_t i = 0; i < length; ++i) logical_size += vl_code_bits(codec, b, A[i]);
+    const size_t bits = size * 8,
+                 max_idx = (logical_size + bits - 1) / bits,
+                 head = BIT_ALIGN_UP(sizeof(VLBitArray) + sizeof(size_t) * ((length + k - 1) / k)),
+                 bytes = head + BIT_ALIGN_UP((max_idx ? max_idx : 1) * size);
+
+    VLBitArray *vlb = bit_alloc(allocator, bytes);
+    memset(vlb, 0, bytes);
     vlb->k = k;
     vlb->length = length;
-    vlb->logical_size = current_p_pos;
+    vlb->logical_size = logical_size;
     vlb->physical_size = max_idx;
-    vlb->element_size = size_bits;
+    vlb->element_size = bits;
+    vlb->codec = codec;
+    vlb->param = b;
+    vlb->W_inline = 1;
+    vlb->W = (uint32_t *) ((char *) vlb + head);
+
+    BitWriter w = { vlb->W, 0 };
+    for (size_t i = 0; i < length; ++i) {
+        // Assign current bit idx to pointer array
+        if (i % k == 0) vlb->P[i / k] = w.pos;
+        vl_code_write(codec, b, &w, A[i]);
+    }
 
     return vlb;
 }
 
 
+// -- Parallel ----------------------------------------------------------------
+/*
+ * Values are split into chunks of whole sample intervals. A first parallel
+ * pass sizes the codes of every chunk and fills its samples relative to the
+ * chunk, a prefix sum over the chunk sizes then places each chunk in W. In
+ * the second pass every chunk encodes into a private buffer at its offset
+ * within a word and copies out the words it alone covers. Its first and last
+ * word may be shared with the neighbouring chunks, and are merged serially.
+ */
+typedef struct {
+  VLBitArray *arr;
+  const unsigned int *A;
+  uint32_t *out;
+  size_t start;
+  size_t count;
+  size_t chunk;
+  size_t *offsets;  // Bits of every chunk, then their position in W
+  uint32_t *edges;  // First and last word of every chunk
+} VLBitArrayJob;
+
+static void VLBitArray_size_task(void *ctx, size_t task)
+{
+    VLBitArrayJob *job = ctx;
+    VLBitArray *vlb = job->arr;
+    const size_t i0 = task * job->chunk,
+                 i1 = vlb->length - i0 < job->chunk ? vlb->length : i0 + job->chunk;
+
+    size_t pos = 0;
+    for (size_t i = i0; i < i1; ++i) {
+        if (i % vlb->k == 0) vlb->P[i / vlb->k] = pos;
+        pos += vl_code_bits(vlb->codec, vlb->param, job->A[i]);
+    }
+    job->offsets[task] = pos;
+}
+
+static void VLBitArray_encode_task(void *ctx, size_t task)
+{
+    VLBitArrayJob *job = ctx;
+    VLBitArray *vlb = job->arr;
+    const size_t i0 = task * job->chunk,
+                 i1 = vlb->length - i0 < job->chunk ? vlb->length : i0 + job->chunk,
+                 offset = job->offsets[task],
+                 bits = job->offsets[task + 1] - offset;
+
+    const size_t n_words = (offset % 32 + bits + 31) / 32;
+    uint32_t *buf = calloc(n_words + 1, sizeof(uint32_t));
+    if (buf == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    BitWriter w = { buf, offset % 32 };
+    for (size_t i = i0; i < i1; ++i) {
+        if (i % vlb->k == 0) vlb->P[i / vlb->k] += offset;
+        vl_code_write(vlb->codec, vlb->param, &w, job->A[i]);
+    }
+
+    if (n_words) {
+        job->edges[2*task] = buf[0];
+        job->edges[2*task + 1] = buf[n_words - 1];
+    }
+    if (n_words > 2) {
+        memcpy(vlb->W + offset / 32 + 1, buf + 1, sizeof(uint32_t) * (n_words - 2));
+    }
+    free(buf);
+}
+
+static void VLBitArray_decode_task(void *ctx, size_t task)
+{
+    const VLBitArrayJob *job = ctx;
+    const size_t i = task * job->chunk,
+                 count = job->count - i < job->chunk ? job->count - i : job->chunk;
+    VLBitArray_decode(job->arr, job->start + i, count, job->out + i);
+}
+
+VLBitArray *VLBitArray_init_parallel(const unsigned int A[], size_t length,
+  size_t k, size_t size, VL_CODEC codec, int param, unsigned int n_threads)
+{
+    VLBitArrayJob job = { vl_alloc(A, length, k, size, codec, param), A, NULL,
+      0, length, parallel_chunk(length, n_threads, k), NULL, NULL };
+    const size_t n_tasks = (length + job.chunk - 1) / job.chunk;
+
+    job.offsets = malloc(sizeof(size_t) * (n_tasks + 1));
+    job.edges = calloc(2 * n_tasks + 1, sizeof(uint32_t));
+    if (job.offsets == NULL || job.edges == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    parallel_for(n_tasks, n_threads, VLBitArray_size_task, &job);
+
+    // Chunk sizes to chunk positions
+    size_t total = 0;
+    for (size_t t = 0; t < n_tasks; ++t) {
+        size_t bits = job.offsets[t];
+        job.offsets[t] = total;
+        total += bits;
+    }
+    job.offsets[n_tasks] = total;
+    vl_alloc_W(job.arr, total);
+
+    parallel_for(n_tasks, n_threads, VLBitArray_encode_task, &job);
+
+    // Merge the words shared between neighbouring chunks
+    for (size_t t = 0; t < n_tasks; ++t) {
+        const size_t offset = job.offsets[t], end = job.offsets[t + 1];
+        if (end == offset) continue;
+        job.arr->W[offset / 32] |= job.edges[2*t];
+        if ((end - 1) / 32 != offset / 32) job.arr->W[(end - 1) / 32] |= job.edges[2*t + 1];
+    }
+
+    free(job.offsets);
+    free(job.edges);
+    return job.arr;
+}
+
+void VLBitArray_decode_parallel(const VLBitArray *bit_arr, size_t start,
+  size_t count, uint32_t out[], unsigned int n_threads)
+{
+    if (start + count > bit_arr->length || start + count < start) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    VLBitArrayJob job = { (VLBitArray *) bit_arr, NULL, out, start, count,
+      parallel_chunk(count, n_threads, bit_arr->k), NULL, NULL };
+    parallel_for((count + job.chunk - 1) / job.chunk, n_threads,
+      VLBitArray_decode_task, &job);
+}
+
+
+// -- Streaming construction --------------------------------------------------
+void VLBitArrayBuilder_begin(VLBitArrayBuilder *builder, size_t k, size_t size,
+  VL_CODEC codec, int param)
+{
+    if (codec == VL_RICE && (param < 0 || param > 31)) {
+        fprintf(stderr, "%s:%d Rice parameter out of range\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    builder->p_capacity = 16;
+    builder->w_capacity = 16;
+    VLBitArray *vlb = calloc(1, sizeof(VLBitArray) + sizeof(size_t) * builder->p_capacity);
+    if (vlb == NULL || (vlb->W = calloc(builder->w_capacity, sizeof(uint32_t))) == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    vlb->k = k;
+    vlb->element_size = size * 8;
+    vlb->codec = codec;
+    vlb->param = codec == VL_RICE ? (unsigned int) param : 0;
+    builder->arr = vlb;
+    builder->writer.W = vlb->W;
+    builder->writer.pos = 0;
+}
+
+void VLBitArrayBuilder_push(VLBitArrayBuilder *builder, unsigned int x)
+{
+    VLBitArray *vlb = builder->arr;
+
+    if (vlb->length % vlb->k == 0) {
+        size_t j = vlb->length / vlb->k;
+        if (j == builder->p_capacity) {
+            builder->p_capacity *= 2;
+            vlb = realloc(vlb, sizeof(VLBitArray) + sizeof(size_t) * builder->p_capacity);
+            if (vlb == NULL) {
+                printf("Couldn't allocate memory for vector.\n");
+                exit(EXIT_FAILURE);
+            }
+            builder->arr = vlb;
+        }
+        vlb->P[j] = builder->writer.pos;
+    }
+
+    // Room for the code and the word a write may spill into, zeroed since
+    // codes are ORed in
+    size_t words = (builder->writer.pos + vl_code_bits(vlb->codec, vlb->param, x)) / 32 + 1;
+    if (words > builder->w_capacity) {
+        size_t capacity = builder->w_capacity;
+        while (capacity < words) capacity *= 2;
+        uint32_t *W = realloc(vlb->W, sizeof(uint32_t) * capacity);
+        if (W == NULL) {
+            printf("Couldn't allocate memory for vector.\n");
+            exit(EXIT_FAILURE);
+        }
+        memset(W + builder->w_capacity, 0,
+          sizeof(uint32_t) * (capacity - builder->w_capacity));
+        vlb->W = builder->writer.W = W;
+        builder->w_capacity = capacity;
+    }
+
+    vl_code_write(vlb->codec, vlb->param, &builder->writer, x);
+    vlb->length++;
+}
+
+void VLBitArrayBuilder_push_many(VLBitArrayBuilder *builder,
+  const unsigned int A[], size_t count)
+{
+    for (size_t i = 0; i < count; ++i) VLBitArrayBuilder_push(builder, A[i]);
+}
+
+VLBitArray* VLBitArrayBuilder_finish(VLBitArrayBuilder *builder)
+{
+    VLBitArray *vlb = builder->arr;
+    size_t p_len = (vlb->length + vlb->k - 1) / vlb->k;
+
+    vlb->logical_size = builder->writer.pos;
+    vlb->physical_size = (vlb->logical_size + 31) / 32;
+
+    // Give back the slack of the geometric growth
+    uint32_t *W = realloc(vlb->W, sizeof(uint32_t) * (vlb->physical_size ? vlb->physical_size : 1));
+    if (W != NULL) vlb->W = W;
+    VLBitArray *trimmed = realloc(vlb, sizeof(VLBitArray) + sizeof(size_t) * p_len);
+    if (trimmed != NULL) vlb = trimmed;
+
+    builder->arr = NULL;
+    return vlb;
+}
+
+
 uint32_t VLBitArray_read(VLBitArray* bit_arr, size_t i)
 {
     if (i >= bit_arr->length) {
         fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
         exit(OUT_OF_BOUNDS);
     }
+    return VLBitArray_read_unchecked(bit_arr, i);
+}
 
+BITARR_ERROR VLBitArray_read_checked(const VLBitArray* bit_arr, size_t i,
+  uint32_t *x)
+{
+    if (i >= bit_arr->length) return OUT_OF_BOUNDS;
+    *x = VLBitArray_read_unchecked(bit_arr, i);
+    return BITARR_SUCCESS;
+}
 
-    size_t curr_idx = bit_arr->P[ceil_int(i+1, bit_arr->k)-1],
-           idx_diff = i - (ceil_int(i+1, bit_arr->k)-1) * bit_arr->k,
-           max_idx = 0;
 
-    uint32_t g_length = 0,
-             chunk = 0;
+// -- Iteration ---------------------------------------------------------------
+// Position it at value start <= length
+static void vl_iter_seek(VLBitArrayIter *it, const VLBitArray *bit_arr, size_t start)
+{
+    // Start from the closest sample, or the end when there are no values left
+    size_t pos = bit_arr->logical_size;
+    it->arr = bit_arr;
+    it->i = start;
+    if (start < bit_arr->length) {
+        it->i = start - start % bit_arr->k;
+        pos = bit_arr->P[start / bit_arr->k];
+    }
+    BitReader_init(&it->reader, bit_arr->W, bit_arr->physical_size, pos);
+
+    // Skip the codes between the sample and start, short gamma codes a byte
+    // at a time
+    BitReader *r = &it->reader;
+    while (it->i < start) {
+        if (bit_arr->codec == VL_GAMMA) {
+            BitReader_refill(r);
+            const GammaTableEntry *e = &gamma_table[r->buf & 0xFF];
+            if (e->count && e->count <= start - it->i) {
+                BitReader_skip(r, e->bits);
+                it->i += e->count;
+                continue;
+            }
+        }
+        vl_code_read(bit_arr, r);
+        it->i++;
+    }
+}
+
+uint32_t VLBitArray_read_unchecked(const VLBitArray* bit_arr, size_t i)
+{
+    VLBitArrayIter it;
+    vl_iter_seek(&it, bit_arr, i);
+    return vl_code_read(bit_arr, &it.reader);
+}
 
-    int ii = 0;
-    while (ii <= idx_diff) {
-        max_idx = curr_idx + bit_arr->element_size - 1;
-        chunk = bit_read_range(
-            bit_arr->W, 
-            bit_arr->element_size, 
-            curr_idx,
-            max_idx + 
-            ((max_idx > bit_arr->logical_size) * (bit_arr->logical_size - max_idx)) - 1
-            );
+void VLBitArray_iter(VLBitArrayIter *it, const VLBitArray *bit_arr, size_t start)
+{
+    if (start > bit_arr->length) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+    vl_iter_seek(it, bit_arr, start);
+}
 
-        curr_idx += 1 + ((find_LSB(chunk)) * 2);
-        ii++;
+uint32_t VLBitArray_iter_next(VLBitArrayIter *it)
+{
+    if (it->i >= it->arr->length) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
     }
 
-    return (gamma_decode(chunk) - 1);
+    it->i++;
+    return vl_code_read(it->arr, &it->reader);
 }
 
+void VLBitArray_decode(const VLBitArray *bit_arr, size_t start, size_t count,
+  uint32_t out[])
+{
+    if (start + count > bit_arr->length || start + count < start) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    VLBitArrayIter it;
+    VLBitArray_iter(&it, bit_arr, start);
+    BitReader *r = &it.reader;
+
+    size_t i = 0;
+    switch (bit_arr->codec) {
+    case VL_GAMMA:
+        while (i < count) {
+            BitReader_refill(r);
+            const GammaTableEntry *e = &gamma_table[r->buf & 0xFF];
+            // Codes past the last value may be garbage, never take them
+            if (e->count && e->count <= count - i) {
+                for (size_t j = 0; j < e->count; ++j) out[i + j] = e->values[j] - 1u;
+                BitReader_skip(r, e->bits);
+                i += e->count;
+            } else {
+                out[i++] = (uint32_t) (gamma_read(r) - 1);
+            }
+        }
+        break;
+    case VL_DELTA:
+        for (; i < count; ++i) out[i] = (uint32_t) (delta_read(r) - 1);
+        break;
+    case VL_RICE:
+        for (; i < count; ++i) out[i] = (uint32_t) rice_read(r, bit_arr->param);
+        break;
+    case VL_VARBYTE: {
+#ifdef BITTER_LITTLE_ENDIAN
+        // Codes start on byte boundaries, read them straight from W
+        const uint8_t *p = (const uint8_t *) bit_arr->W +
+          (r->word * 32 - r->avail) / 8;
+        for (; i < count; ++i) {
+            uint32_t v = 0, c;
+            unsigned int shift = 0;
+            do {
+                c = *p++;
+                v |= (c & 0x7F) << shift;
+                shift += 7;
+            } while (c & 0x80);
+            out[i] = v;
+        }
+#else
+        for (; i < count; ++i) out[i] = (uint32_t) varbyte_read(r);
+#endif
+        break;
+    }
+    }
+}
@@ -5,10 +5,22 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
-#include <math.h>
 
 #include "common.h"
 #include "bitops.h"
+#include "encoding.h"
+#include "alloc.h"
+
+// Code used for the values of a VLBitArray, see encoding.h
+typedef enum {
+  VL_GAMMA,
+  VL_DELTA,
+  VL_RICE,
+  VL_VARBYTE
+} VL_CODEC;
+
+// Pick the Rice parameter from the data
+#define VL_RICE_AUTO (-1)
 
 typedef struct {
     size_t k;
@@ -16,18 +28,236 @@ typedef struct {
     size_t logical_size; // Length of B
     size_t physical_size; // Length of W
     size_t element_size; // Size of each word in W
+    VL_CODEC codec; // Code of each value
+    unsigned int param; // Rice parameter
+    int W_inline; // W shares the allocation of the struct
     uint32_t *W;
     size_t P[];
 } VLBitArray;
 
+/**
+ * @struct VLBitArrayBuilder
+ *
+ * Streaming construction of a VLBitArray from values supplied in chunks.
+ * W and P grow geometrically on the heap as codes are written, and W is
+ * trimmed to its final size by VLBitArrayBuilder_finish, so peak memory stays
+ * within a small factor of the compressed size rather than the input size.
+ *
+ * @var VLBitArrayBuilder.arr
+ *  VLBitArray under construction, reallocated as P grows
+ * @var VLBitArrayBuilder.p_capacity
+ *  Number of samples arr has room for
+ * @var VLBitArrayBuilder.w_capacity
+ *  Number of words allocated for arr->W
+ * @var VLBitArrayBuilder.writer
+ *  Position of the next code in arr->W
+ */
+typedef struct {
+    VLBitArray *arr;
+    size_t p_capacity;
+    size_t w_capacity;
+    BitWriter writer;
+} VLBitArrayBuilder;
+
 
 void VLBitArray_free(VLBitArray *bit_arr);
 
+/**
+ * @brief Gamma code A, sampling the position of every k-th value
+ *
+ * Same as VLBitArray_init_codec with VL_GAMMA.
+ */
 VLBitArray *VLBitArray_init(
     unsigned int A[], size_t length, size_t k, size_t size
 );
 
+/**
+ * @brief Encode A with the given codec, sampling every k-th value
+ *
+ * Gamma and delta codes store A[i] + 1, Rice and varbyte store A[i].
+ *
+ * @param A         Values to encode
+ * @param length    Length of A
+ * @param k         Values between two samples of P
+ * @param size      Size in bytes of each word in W
+ * @param codec     Code to use
+ * @param param     Rice parameter (0-31) or VL_RICE_AUTO, ignored otherwise
+ * @return          Pointer to VLBitArray
+ */
+VLBitArray *VLBitArray_init_codec(
+    const unsigned int A[], size_t length, size_t k, size_t size,
+    VL_CODEC codec, int param
+);
+
+/**
+ * @brief VLBitArray_init_codec drawing its memory from an allocator
+ *
+ * The struct, P and W share one allocation, W starting BIT_ALIGN aligned.
+ * VLBitArray_init_codec builds the same layout on the heap.
+ *
+ * @param A         Values to encode
+ * @param length    Length of A
+ * @param k         Values between two samples of P
+ * @param size      Size in bytes of each word in W
+ * @param codec     Code to use
+ * @param param     Rice parameter (0-31) or VL_RICE_AUTO, ignored otherwise
+ * @param allocator Allocator providing the memory
+ * @return          Pointer to VLBitArray, release with VLBitArray_free_with
+ */
+VLBitArray *VLBitArray_init_with(
+    const unsigned int A[], size_t length, size_t k, size_t size,
+    VL_CODEC codec, int param, const BitAllocator *allocator
+);
+
+/**
+ * @brief Free VLBitArray built with VLBitArray_init_with
+ *
+ * @param bit_arr
+ * @param allocator Allocator bit_arr came from
+ */
+void VLBitArray_free_with(VLBitArray *bit_arr, const BitAllocator *allocator);
+
+/**
+ * @brief Start building a VLBitArray
+ *
+ * The Rice parameter can't be tuned before the values are known, so
+ * VL_RICE_AUTO is not accepted here.
+ *
+ * @param builder   Builder to initialize
+ * @param k         Values between two samples of P
+ * @param size      Size in bytes of each word in W
+ * @param codec     Code to use
+ * @param param     Rice parameter (0-31), ignored by the other codecs
+ */
+void VLBitArrayBuilder_begin(VLBitArrayBuilder *builder, size_t k, size_t size,
+  VL_CODEC codec, int param);
+
+/**
+ * @brief Append a single value
+ *
+ * @param builder   Builder started with VLBitArrayBuilder_begin
+ * @param x         Value to append
+ */
+void VLBitArrayBuilder_push(VLBitArrayBuilder *builder, unsigned int x);
+
+/**
+ * @brief Append a chunk of values
+ *
+ * @param builder   Builder started with VLBitArrayBuilder_begin
+ * @param A         Values to append
+ * @param count     Number of values in A
+ */
+void VLBitArrayBuilder_push_many(VLBitArrayBuilder *builder,
+  const unsigned int A[], size_t count);
+
+/**
+ * @brief Trim W and return the finished VLBitArray
+ *
+ * The builder no longer owns the array afterwards.
+ *
+ * @param builder   Builder started with VLBitArrayBuilder_begin
+ * @return          Pointer to VLBitArray
+ */
+VLBitArray* VLBitArrayBuilder_finish(VLBitArrayBuilder *builder);
+
+/**
+ * @brief VLBitArray_init_codec on several threads
+ *
+ * A is split at sample boundaries. The result is identical to
+ * VLBitArray_init_codec.
+ *
+ * @param n_threads Number of threads, 0 for one per online CPU
+ */
+VLBitArray *VLBitArray_init_parallel(
+    const unsigned int A[], size_t length, size_t k, size_t size,
+    VL_CODEC codec, int param, unsigned int n_threads
+);
+
+/**
+ * @brief VLBitArray_decode on several threads
+ *
+ * Every thread starts decoding from the sample before its range.
+ *
+ * @param n_threads Number of threads, 0 for one per online CPU
+ */
+void VLBitArray_decode_parallel(const VLBitArray *bit_arr, size_t start,
+  size_t count, uint32_t out[], unsigned int n_threads);
+
 
 uint32_t VLBitArray_read(VLBitArray* bit_arr, size_t i);
 
+/**
+ * @brief VLBitArray_read returning an error instead of exiting
+ *
+ * @param bit_arr
+ * @param i         Index of the value
+ * @param x         Receives the value, untouched on error
+ * @return          OUT_OF_BOUNDS if i >= length, BITARR_SUCCESS otherwise
+ */
+BITARR_ERROR VLBitArray_read_checked(const VLBitArray* bit_arr, size_t i,
+  uint32_t *x);
+
+/**
+ * @brief VLBitArray_read without the bounds check, i < length is assumed
+ *
+ * Decoding from the sample dominates the cost, so unlike
+ * BitArray_read_unchecked this is not inline.
+ *
+ * @param bit_arr
+ * @param i         Index of the value
+ */
+uint32_t VLBitArray_read_unchecked(const VLBitArray* bit_arr, size_t i);
+
+
+/**
+ * @struct VLBitArrayIter
+ *
+ * Cursor over a VLBitArray. Keeps its bit position between values, so a
+ * scan of n values costs O(n) instead of the O(n*k) of repeated reads.
+ *
+ * @var VLBitArrayIter.arr
+ *  Array being iterated
+ * @var VLBitArrayIter.i
+ *  Index of the next value
+ * @var VLBitArrayIter.reader
+ *  Position of the next code in W
+ */
+typedef struct {
+    const VLBitArray *arr;
+    size_t i;
+    BitReader reader;
+} VLBitArrayIter;
+
+/**
+ * @brief Position an iterator at value start
+ *
+ * @param it        Iterator to initialize
+ * @param bit_arr   Array to iterate, must outlive the iterator
+ * @param start     Index of the first value, 0 <= start <= length
+ */
+void VLBitArray_iter(VLBitArrayIter *it, const VLBitArray *bit_arr,
+  size_t start);
+
+/**
+ * @brief Return the next value and advance the iterator
+ *
+ * @param it
+ */
+uint32_t VLBitArray_iter_next(VLBitArrayIter *it);
+
+/**
+ * @brief Decode count consecutive values starting at start
+ *
+ * Each codec has its own loop. Runs of short gamma codes are decoded
+ * several at a time (see gamma_table) and varbyte codes straight from the
+ * bytes of W.
+ *
+ * @param bit_arr
+ * @param start     Index of the first value
+ * @param count     Number of values to decode
+ * @param out       Array with room for count values
+ */
+void VLBitArray_decode(const VLBitArray *bit_arr, size_t start, size_t count,
+  uint32_t out[]);
+
 #endif // !BITARR_VL_
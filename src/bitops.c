@@ -45,14 +45,14 @@ uint32_t find_MSB(uint32_t v)
 void bit_set(uint32_t *bit_arr, size_t size, size_t j)
 {
   // Shift word left to bit idx, OR w/ 1
-  bit_arr[j/size] |= 1 << (j % size);
+  bit_arr[j/size] |= 1u << (j % size);
 }
 
 
 void bit_clear(uint32_t* bit_arr, size_t size, size_t j)
 {
   // Shift word left to bit idx, AND w/ NOT(1)
-  bit_arr[j/size] &= ~(1 << (j % size));
+  bit_arr[j/size] &= ~(1u << (j % size));
 }
 
 
@@ -66,7 +66,7 @@ void bit_write_range(
   if (j1 / w == j / w) {
     // Clear bits
     bit_arr[j/w] &= (
-      ~((unsigned) ((1 << (j-j1+1)) - 1) << (j1 % w))
+      ~((0xFFFFFFFFu >> (w - (j-j1+1))) << (j1 % w))
     );
     // Write x bits
     bit_arr[j/w] |= x << (j1 % w);
@@ -74,14 +74,14 @@ void bit_write_range(
     // Spans two words
     bit_arr[j1/w] = (
       // Get bits in first word to store lower bits
-      (bit_arr[j1/w] & ((1 << (j1 % w)) - 1)) |
+      (bit_arr[j1/w] & ((1u << (j1 % w)) - 1)) |
       // Write bits
       (x <<  (j1 % w))
     );
 
     bit_arr[j/w] = (
       // Get bits in second word to store lower bits
-      (bit_arr[j/w] & ~((1 << ((j+1) % w)) - 1)) |
+      (bit_arr[j/w] & ~((1u << ((j+1) % w)) - 1)) |
       // Write bits
       (x >> (w - (j1 % w)))
     );
@@ -107,8 +107,8 @@ unsigned int bit_read_range(
       // Shift word right
       (bit_arr[j/width] >> (j1 % width)) &
       // AND on bit vector of 1s the necessary length to extract only needed
-      // bits
-      ((1 << (j-j1+1)) - 1)
+      // bits (shifting down keeps a full 32 bit range defined)
+      (0xFFFFFFFFu >> (width - (j-j1+1)))
     );
   }
 
@@ -117,10 +117,58 @@ unsigned int bit_read_range(
   // Get bits in the first word
   (bit_arr[j1/width] >> (j1 % width)) |
   // Bits in second word
-  (bit_arr[j/width] &  ((1 << ((j+1) % width)) - 1)) <<
+  (bit_arr[j/width] &  ((1u << ((j+1) % width)) - 1)) <<
     // Shift bits from second word n bits from first word left to make
     // room for concatenation
     (width - (j1 % width))
   );
 }
 
+
+// -- 64 bit words ------------------------------------------------------------
+void bit_set64(uint64_t *bit_arr, uint64_t j)
+{
+  bit_arr[j/64] |= (uint64_t) 1 << (j % 64);
+}
+
+void bit_clear64(uint64_t *bit_arr, uint64_t j)
+{
+  bit_arr[j/64] &= ~((uint64_t) 1 << (j % 64));
+}
+
+void bit_write_range64(uint64_t *bit_arr, uint64_t j1, uint64_t j, uint64_t x)
+{
+  if (j1 > j) return; // Early return if start idx > end idx
+
+  const uint64_t len = j - j1 + 1,
+                 off = j1 % 64,
+                 mask = ~(uint64_t) 0 >> (64 - len);
+
+  x &= mask;
+  // Clear and write bits in the first word
+  bit_arr[j1/64] = (bit_arr[j1/64] & ~(mask << off)) | (x << off);
+
+  // Spans two words, off > 0 here so the shifts stay below 64
+  if (off + len > 64) {
+    bit_arr[j/64] = (bit_arr[j/64] & ~(mask >> (64 - off))) | (x >> (64 - off));
+  }
+}
+
+unsigned bit_read64(const uint64_t *bit_arr, uint64_t j)
+{
+  return (unsigned) (bit_arr[j/64] >> (j % 64)) & 1;
+}
+
+uint64_t bit_read_range64(const uint64_t *bit_arr, uint64_t j1, uint64_t j)
+{
+  if (j1 > j) return 0; // Early return if start idx > end idx
+
+  const uint64_t len = j - j1 + 1,
+                 off = j1 % 64;
+
+  // At most two loads, the second only when the range crosses a word
+  uint64_t x = bit_arr[j1/64] >> off;
+  if (off + len > 64) x |= bit_arr[j/64] << (64 - off);
+
+  return x & (~(uint64_t) 0 >> (64 - len));
+}
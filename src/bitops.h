@@ -5,6 +5,10 @@
 #include <stdint.h>
 #include "common.h"
 
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
 
 uint32_t find_LSB(uint32_t v);
 uint32_t find_MSB(uint32_t v);
@@ -21,4 +25,59 @@ unsigned int bit_read_range(
   uint32_t *bit_arr, size_t width, unsigned int j1, unsigned int j
 );
 
+// -- Counting ------------------------------------------------------------------
+/*
+ * Population count and in-word select. These sit in the innermost loop of
+ * rank/select queries, so they are inlined and use popcnt and pdep/tzcnt
+ * when the target allows it (e.g. -march=native), falling back to
+ * broadword code otherwise.
+ */
+static inline unsigned popcount64(uint64_t x)
+{
+#if defined(__x86_64__) && !defined(__POPCNT__)
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return (unsigned) ((x * 0x0101010101010101ULL) >> 56);
+#else
+  return (unsigned) __builtin_popcountll(x);
+#endif
+}
+
+// Position of the highest set bit of x, x must not be 0
+static inline unsigned msb64(uint64_t x)
+{
+  return 63u - (unsigned) __builtin_clzll(x);
+}
+
+// Position of the r-th (0 based) set bit of x, x must have more than r set bits
+static inline unsigned select64(uint64_t x, unsigned r)
+{
+#if defined(__BMI2__)
+  return (unsigned) __builtin_ctzll(_pdep_u64((uint64_t) 1 << r, x));
+#else
+  unsigned shift = 0, c;
+  // Skip whole bytes, then clear the remaining lower set bits
+  while (r >= (c = popcount64(x & 0xFF))) {
+    r -= c;
+    x >>= 8;
+    shift += 8;
+  }
+  while (r--) x &= x - 1;
+  return shift + (unsigned) __builtin_ctzll(x);
+#endif
+}
+
+// -- 64 bit words -------------------------------------------------------------
+/*
+ * Same layout as above on an array of 64 bit words with 64 bit bit indexes.
+ * Ranges may be up to 64 bits long and touch at most two words.
+ */
+void bit_set64(uint64_t *bit_arr, uint64_t j);
+void bit_clear64(uint64_t *bit_arr, uint64_t j);
+void bit_write_range64(uint64_t *bit_arr, uint64_t j1, uint64_t j, uint64_t x);
+
+unsigned bit_read64(const uint64_t *bit_arr, uint64_t j);
+uint64_t bit_read_range64(const uint64_t *bit_arr, uint64_t j1, uint64_t j);
+
 #endif // !BITOPS_H_
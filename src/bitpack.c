@@ -0,0 +1,226 @@
+/**
+ * @file
+ * @brief Bulk packing and unpacking of fixed width values
+ */
+
+#include "bitpack.h"
+#include "cpu.h"
+
+#if defined(BITTER_X86) && defined(BITTER_LITTLE_ENDIAN)
+#include <immintrin.h>
+#define BITPACK_AVX2 1
+#endif
+
+#if defined(__SSE2__) && defined(BITTER_LITTLE_ENDIAN)
+#include <emmintrin.h>
+#define BITPACK_SSE2 1
+#endif
+
+// Mask of the lowest w bits, valid for w in [1, 32]
+#define MASK(w) (0xFFFFFFFFu >> (32 - (w)))
+
+
+// -- Single values -----------------------------------------------------------
+static inline uint32_t read_one(const uint32_t *W, size_t w, size_t i)
+{
+    const size_t j = i * w, word = j / 32, off = j % 32;
+    uint64_t v = W[word] >> off;
+
+    // Spans two words
+    if (off + w > 32) v |= (uint64_t) W[word + 1] << (32 - off);
+    return (uint32_t) v & MASK(w);
+}
+
+static inline void write_one(uint32_t *W, size_t w, size_t i, uint32_t x)
+{
+    const size_t j = i * w, word = j / 32, off = j % 32;
+    const uint64_t m = (uint64_t) MASK(w) << off,
+                   v = (uint64_t) (x & MASK(w)) << off;
+
+    W[word] = (W[word] & ~(uint32_t) m) | (uint32_t) v;
+    // Spans two words
+    if (off + w > 32) {
+        W[word + 1] = (W[word + 1] & ~(uint32_t) (m >> 32)) | (uint32_t) (v >> 32);
+    }
+}
+
+
+// -- Block kernels -----------------------------------------------------------
+/*
+ * One pair of kernels per width. With w a constant the offsets, shifts and
+ * the two word branch all fold away once the loop is unrolled.
+ */
+#define BITPACK_KERNELS(w)                                                    \
+static void unpack_block_##w(const uint32_t *restrict in,                     \
+  uint32_t *restrict out)                                                     \
+{                                                                             \
+    _Pragma("GCC unroll 32")                                                  \
+    for (unsigned int i = 0; i < BITPACK_BLOCK; ++i) {                        \
+        const unsigned int j = i * (w), word = j / 32, off = j % 32;          \
+        uint64_t v = in[word] >> off;                                         \
+        if (off + (w) > 32) v |= (uint64_t) in[word + 1] << (32 - off);       \
+        out[i] = (uint32_t) v & MASK(w);                                      \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+static void pack_block_##w(const uint32_t *restrict in,                       \
+  uint32_t *restrict out)                                                     \
+{                                                                             \
+    uint64_t acc = 0;                                                         \
+    unsigned int bits = 0;                                                    \
+    _Pragma("GCC unroll 32")                                                  \
+    for (unsigned int i = 0; i < BITPACK_BLOCK; ++i) {                        \
+        acc |= (uint64_t) (in[i] & MASK(w)) << bits;                          \
+        bits += (w);                                                          \
+        if (bits >= 32) {                                                     \
+            *out++ = (uint32_t) acc;                                          \
+            acc >>= 32;                                                       \
+            bits -= 32;                                                       \
+        }                                                                     \
+    }                                                                         \
+}
+
+#define BITPACK_WIDTHS(X)                                                     \
+    X(1)  X(2)  X(3)  X(4)  X(5)  X(6)  X(7)  X(8)                            \
+    X(9)  X(10) X(11) X(12) X(13) X(14) X(15) X(16)                           \
+    X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24)                           \
+    X(25) X(26) X(27) X(28) X(29) X(30) X(31) X(32)
+
+BITPACK_WIDTHS(BITPACK_KERNELS)
+
+typedef void (*unpack_fn)(const uint32_t *restrict, uint32_t *restrict);
+typedef void (*pack_fn)(const uint32_t *restrict, uint32_t *restrict);
+
+#define UNPACK_ENTRY(w) unpack_block_##w,
+#define PACK_ENTRY(w) pack_block_##w,
+
+static const unpack_fn unpack_blocks[33] = { NULL, BITPACK_WIDTHS(UNPACK_ENTRY) };
+static const pack_fn pack_blocks[33] = { NULL, BITPACK_WIDTHS(PACK_ENTRY) };
+
+
+// -- SIMD kernels ------------------------------------------------------------
+#ifdef BITPACK_SSE2
+/*
+ * Byte and half word aligned widths are plain zero extension.
+ */
+static void unpack_block_8_sse2(const uint32_t *restrict in,
+  uint32_t *restrict out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    for (int k = 0; k < 2; ++k) {
+        const __m128i b = _mm_loadu_si128((const __m128i *) in + k),
+                      lo = _mm_unpacklo_epi8(b, zero),
+                      hi = _mm_unpackhi_epi8(b, zero);
+        _mm_storeu_si128((__m128i *) out + 4*k + 0, _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128((__m128i *) out + 4*k + 1, _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128((__m128i *) out + 4*k + 2, _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128((__m128i *) out + 4*k + 3, _mm_unpackhi_epi16(hi, zero));
+    }
+}
+
+static void unpack_block_16_sse2(const uint32_t *restrict in,
+  uint32_t *restrict out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    for (int k = 0; k < 4; ++k) {
+        const __m128i h = _mm_loadu_si128((const __m128i *) in + k);
+        _mm_storeu_si128((__m128i *) out + 2*k + 0, _mm_unpacklo_epi16(h, zero));
+        _mm_storeu_si128((__m128i *) out + 2*k + 1, _mm_unpackhi_epi16(h, zero));
+    }
+}
+#endif
+
+#ifdef BITPACK_AVX2
+/*
+ * Decodes groups of 8 values. A group of width w spans exactly w bytes, so
+ * with i a multiple of 8 every group starts on a byte boundary and lane l
+ * always finds its value at the same bit offset l * w from the group start.
+ * Two overlapping loads provide dword d and d+1 to each lane, which are then
+ * shifted into place and merged.
+ *
+ * Returns the index of the first value not decoded.
+ */
+__attribute__((target("avx2")))
+static size_t unpack_avx2(const uint32_t *W, size_t n_words, size_t w,
+  size_t i, size_t end, uint32_t *out)
+{
+    uint32_t idx[8], shr[8], shl[8];
+    for (uint32_t l = 0; l < 8; ++l) {
+        const uint32_t s = l * (uint32_t) w;
+        idx[l] = s / 32;
+        shr[l] = s % 32;
+        shl[l] = 32 - shr[l];   // 32 shifts the upper dword out entirely
+    }
+
+    const __m256i vidx = _mm256_loadu_si256((const __m256i *) idx),
+                  vshr = _mm256_loadu_si256((const __m256i *) shr),
+                  vshl = _mm256_loadu_si256((const __m256i *) shl),
+                  vmask = _mm256_set1_epi32((int) MASK(w));
+    const uint8_t *bytes = (const uint8_t *) W;
+    const size_t n_bytes = n_words * sizeof(uint32_t);
+
+    // Stop while both 32 byte loads stay inside the array
+    for (; i + 8 <= end && (i / 8) * w + 36 <= n_bytes; i += 8) {
+        const uint8_t *p = bytes + (i / 8) * w;
+        const __m256i lo = _mm256_loadu_si256((const __m256i *) p),
+                      hi = _mm256_loadu_si256((const __m256i *) (p + 4)),
+                      a = _mm256_permutevar8x32_epi32(lo, vidx),
+                      b = _mm256_permutevar8x32_epi32(hi, vidx),
+                      v = _mm256_or_si256(_mm256_srlv_epi32(a, vshr),
+                            _mm256_sllv_epi32(b, vshl));
+        _mm256_storeu_si256((__m256i *) out, _mm256_and_si256(v, vmask));
+        out += 8;
+    }
+    return i;
+}
+#endif
+
+
+// -- Public ------------------------------------------------------------------
+void bitpack_unpack(const uint32_t *W, size_t n_words, size_t w, size_t start,
+  size_t count, uint32_t *out)
+{
+    const size_t end = start + count;
+    const unsigned int features = cpu_features();
+    unpack_fn kernel = unpack_blocks[w];
+    size_t i = start;
+
+#ifdef BITPACK_AVX2
+    if (features & CPU_AVX2) {
+        for (; i < end && i % 8; ++i) out[i - start] = read_one(W, w, i);
+        i = unpack_avx2(W, n_words, w, i, end, out + (i - start));
+    }
+#else
+    (void) n_words;
+#endif
+
+#ifdef BITPACK_SSE2
+    if (features & CPU_SSE2) {
+        if (w == 8) kernel = unpack_block_8_sse2;
+        if (w == 16) kernel = unpack_block_16_sse2;
+    }
+#else
+    (void) features;
+#endif
+
+    for (; i < end && i % BITPACK_BLOCK; ++i) out[i - start] = read_one(W, w, i);
+    for (; i + BITPACK_BLOCK <= end; i += BITPACK_BLOCK) {
+        kernel(W + (i / BITPACK_BLOCK) * w, out + (i - start));
+    }
+    for (; i < end; ++i) out[i - start] = read_one(W, w, i);
+}
+
+void bitpack_pack(uint32_t *W, size_t w, size_t start, size_t count,
+  const uint32_t *in)
+{
+    const size_t end = start + count;
+    const pack_fn kernel = pack_blocks[w];
+    size_t i = start;
+
+    // Blocks own whole words, partial blocks must preserve their neighbours
+    for (; i < end && i % BITPACK_BLOCK; ++i) write_one(W, w, i, in[i - start]);
+    for (; i + BITPACK_BLOCK <= end; i += BITPACK_BLOCK) {
+        kernel(in + (i - start), W + (i / BITPACK_BLOCK) * w);
+    }
+    for (; i < end; ++i) write_one(W, w, i, in[i - start]);
+}
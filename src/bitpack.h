@@ -0,0 +1,53 @@
+/**
+ * @file
+ * @brief Bulk packing and unpacking of fixed width values
+ *
+ * Operates on the same layout as BitArray: value i of width w occupies bits
+ * [i * w, (i+1) * w - 1] of an array of 32 bit words, least significant bit
+ * first.
+ *
+ * Values are processed in blocks of 32. A block of width w covers exactly w
+ * words, so block aligned ranges are decoded and encoded a whole word at a
+ * time by kernels specialized for each width from 1 to 32. When the CPU
+ * supports AVX2, unpacking decodes 8 values per instruction sequence. Head
+ * and tail values which do not fill a block fall back to per-element access.
+ */
+
+#ifndef BITPACK_H_
+#define BITPACK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of values handled by one block kernel
+#define BITPACK_BLOCK 32
+
+/**
+ * @brief Decode a run of values from a packed word array
+ *
+ * @param W         Packed words
+ * @param n_words   Number of valid words in W
+ * @param w         Bits per value (1-32)
+ * @param start     Index of the first value to decode
+ * @param count     Number of values to decode
+ * @param out       Output array, at least count values long
+ */
+void bitpack_unpack(const uint32_t *W, size_t n_words, size_t w, size_t start,
+  size_t count, uint32_t *out);
+
+/**
+ * @brief Encode a run of values into a packed word array
+ *
+ * Bits of each value above w are ignored. Bits of W outside of the written
+ * range are preserved.
+ *
+ * @param W         Packed words
+ * @param w         Bits per value (1-32)
+ * @param start     Index of the first value to encode
+ * @param count     Number of values to encode
+ * @param in        Values to encode
+ */
+void bitpack_pack(uint32_t *W, size_t w, size_t start, size_t count,
+  const uint32_t *in);
+
+#endif // !BITPACK_H_
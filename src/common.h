@@ -6,7 +6,8 @@
 typedef enum {
   BITARR_SUCCESS,
   OUT_OF_BOUNDS,      // Indexing error
-  FILE_ERROR          // I/O Error
+  FILE_ERROR,         // I/O Error
+  CHECKSUM_ERROR      // Stored and computed checksums differ
 } BITARR_ERROR;
 
 #endif
\ No newline at end of file
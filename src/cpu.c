@@ -0,0 +1,31 @@
+/**
+ * @file
+ * @brief Runtime CPU feature detection
+ */
+
+#include "cpu.h"
+
+static unsigned int allowed = ~0u;
+
+unsigned int cpu_features(void)
+{
+    unsigned int features = 0;
+
+#ifdef BITTER_X86
+    // Populated by a libgcc / compiler-rt constructor before main
+    if (__builtin_cpu_supports("sse2")) features |= CPU_SSE2;
+    if (__builtin_cpu_supports("avx2")) features |= CPU_AVX2;
+    if (__builtin_cpu_supports("sse4.2")) features |= CPU_SSE42;
+    if (__builtin_cpu_supports("popcnt")) features |= CPU_POPCNT;
+    if (__builtin_cpu_supports("bmi2")) features |= CPU_BMI2;
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512vpopcntdq")) features |= CPU_AVX512_VPOPCNT;
+#endif
+
+    return features & allowed;
+}
+
+void cpu_restrict(unsigned int mask)
+{
+    allowed = mask;
+}
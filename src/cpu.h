@@ -0,0 +1,48 @@
+/**
+ * @file
+ * @brief Runtime CPU feature detection
+ *
+ * SIMD kernels are compiled with per-function target attributes so the rest
+ * of the library keeps building for the baseline ISA. Which kernel runs is
+ * picked at call time from cpu_features().
+ */
+
+#ifndef CPU_H_
+#define CPU_H_
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define BITTER_X86 1
+#endif
+
+// Kernels reinterpret the word array as a little endian byte stream
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BITTER_LITTLE_ENDIAN 1
+#endif
+
+typedef enum {
+  CPU_SSE2 = 1 << 0,
+  CPU_AVX2 = 1 << 1,
+  CPU_SSE42 = 1 << 2,
+  CPU_POPCNT = 1 << 3,
+  CPU_BMI2 = 1 << 4,
+  CPU_AVX512_VPOPCNT = 1 << 5   // AVX-512F with VPOPCNTDQ
+} CPU_FEATURE;
+
+/**
+ * @brief Features supported by the running CPU
+ *
+ * @return Bitmask of CPU_FEATURE values, limited by cpu_restrict()
+ */
+unsigned int cpu_features(void);
+
+/**
+ * @brief Restrict the features reported by cpu_features()
+ *
+ * Used by tests and benchmarks to force the portable code paths.
+ *
+ * @param mask  Bitmask of CPU_FEATURE values allowed, ~0u to reset
+ */
+void cpu_restrict(unsigned int mask);
+
+#endif // !CPU_H_
@@ -0,0 +1,25 @@
+/**
+ * @file
+ * @brief CRC32C (Castagnoli) checksums
+ *
+ * Uses the SSE4.2 crc32 instruction when available, otherwise a byte wise
+ * table driven implementation.
+ */
+
+#ifndef CRC32C_H_
+#define CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Extend a CRC32C with len bytes
+ *
+ * @param crc   CRC of the preceding data, 0 to start
+ * @param buf   Data to checksum
+ * @param len   Number of bytes in buf
+ * @return      CRC of the preceding data followed by buf
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+#endif // !CRC32C_H_
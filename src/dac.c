@@ -0,0 +1,112 @@
+/**
+ * @file
+ * @brief Directly addressable codes
+ */
+
+#include "dac.h"
+#include "bitops.h"
+
+// Number of chunks needed for x, at least one
+static inline size_t dac_n_chunks(uint32_t x, uint8_t chunk_size)
+{
+    return x ? (find_MSB(x) + chunk_size) / chunk_size : 1;
+}
+
+DACArray* DACArray_init(const uint32_t A[], uint32_t n, uint8_t chunk_size)
+{
+    if (chunk_size < 1 || chunk_size > 32) {
+        fprintf(stderr, "%s:%d Chunk size out of range\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    // Entries per level, 32 levels at most
+    uint32_t counts[32] = { 0 };
+    size_t n_levels = 1;
+    for (uint32_t i = 0; i < n; ++i) {
+        size_t c = dac_n_chunks(A[i], chunk_size);
+        for (size_t l = 0; l < c; ++l) counts[l]++;
+        if (c > n_levels) n_levels = c;
+    }
+
+    DACArray *dac = malloc(sizeof(DACArray) + sizeof(DACLevel) * n_levels);
+    if (dac == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    dac->n = n;
+    dac->chunk_size = chunk_size;
+    dac->n_levels = n_levels;
+
+    // Every level is filled front to back, so each is streamed by a builder
+    BitArrayBuilder chunks[32], more[32];
+    for (size_t l = 0; l < n_levels; ++l) {
+        BitArrayBuilder_begin(&chunks[l], counts[l], chunk_size, sizeof(uint32_t));
+        if (l + 1 < n_levels) BitArrayBuilder_begin(&more[l], counts[l], 1, sizeof(uint32_t));
+    }
+
+    for (uint32_t i = 0; i < n; ++i) {
+        size_t c = dac_n_chunks(A[i], chunk_size);
+        uint64_t x = A[i];
+        for (size_t l = 0; l < c; ++l, x >>= chunk_size) {
+            BitArrayBuilder_push(&chunks[l], (unsigned int) x);
+            if (l + 1 < n_levels) BitArrayBuilder_push(&more[l], l + 1 < c);
+        }
+    }
+
+    for (size_t l = 0; l < n_levels; ++l) {
+        DACLevel *level = &dac->levels[l];
+        level->chunks = BitArrayBuilder_finish(&chunks[l]);
+        level->more = NULL;
+        level->rank = NULL;
+        if (l + 1 < n_levels) {
+            level->more = BitArrayBuilder_finish(&more[l]);
+            level->rank = RankSelectBitVector_from_BitArray(level->more);
+        }
+    }
+
+    return dac;
+}
+
+void DACArray_free(DACArray *dac)
+{
+    for (size_t l = 0; l < dac->n_levels; ++l) {
+        BitArray_free(dac->levels[l].chunks);
+        if (dac->levels[l].more) {
+            RankSelectBitVector_free(dac->levels[l].rank);
+            BitArray_free(dac->levels[l].more);
+        }
+    }
+    free(dac);
+}
+
+uint32_t DACArray_read(const DACArray *dac, size_t i)
+{
+    if (i >= dac->n) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    uint32_t x = 0;
+    unsigned int shift = 0;
+    for (const DACLevel *level = dac->levels;; ++level) {
+        x |= BitArray_read_unchecked(level->chunks, i) << shift;
+        if (level->more == NULL || !bit_read(level->more->v, 32, i)) return x;
+        // Position of the next chunk among the entries continuing here
+        i = RankSelectBitVector_rank1(level->rank, i);
+        shift += dac->chunk_size;
+    }
+}
+
+size_t DACArray_size(const DACArray *dac)
+{
+    size_t bytes = sizeof(DACArray) + sizeof(DACLevel) * dac->n_levels;
+    for (size_t l = 0; l < dac->n_levels; ++l) {
+        const DACLevel *level = &dac->levels[l];
+        bytes += sizeof(BitArray) + sizeof(uint32_t) * BitArray_n_words(level->chunks);
+        if (level->more) {
+            bytes += sizeof(BitArray) + sizeof(uint32_t) * BitArray_n_words(level->more);
+            bytes += RankSelectBitVector_size(level->rank);
+        }
+    }
+    return bytes;
+}
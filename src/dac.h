@@ -0,0 +1,105 @@
+/**
+ * @file
+ * @brief Directly addressable codes
+ *
+ * Variable length array with random access (Brisaboa, Ladra and Navarro,
+ * "DACs: Bringing Direct Access to Variable-Length Codes"). Every value is
+ * cut into chunks of chunk_size bits, lowest first, and only as many chunks
+ * as the value needs are stored:
+ *
+ *  - level 0 holds the first chunk of every value, level l + 1 the next
+ *    chunk of every value that continues past level l, in the same order.
+ *  - each level but the last has a 1 bit BitArray marking the entries that
+ *    continue. Its rank gives the position of the next chunk:
+ *    entry j of level l continues at entry rank1(j) of level l + 1.
+ *
+ * A read costs one step per chunk of the value being read, independent of
+ * the values before it, so small values of skewed data are both compact and
+ * fast to reach.
+ *
+ * ┌────────────────────────────┐  chunks   level 0
+ * │ c00 c10 c20 c30 c40 ...    │
+ * │  1   0   1   0   0  ...    │  more
+ * ├────────────────────────────┤
+ * │ c01 c21 ...                │  chunks   level 1
+ * │  0   1  ...                │  more
+ * └────────────────────────────┘
+ */
+
+#ifndef DAC_H_
+#define DAC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bitarr.h"
+#include "rank_select.h"
+
+/**
+ * @struct DACLevel
+ *
+ * @var DACLevel.chunks
+ *  chunk_size bits of every value reaching this level
+ * @var DACLevel.more
+ *  Set for the entries continuing on the next level, NULL on the last
+ * @var DACLevel.rank
+ *  Rank index over more
+ */
+typedef struct {
+  BitArray *chunks;
+  BitArray *more;
+  RankSelectBitVector *rank;
+} DACLevel;
+
+/**
+ * @struct DACArray
+ *
+ * @var DACArray.n
+ *  Number of values
+ * @var DACArray.chunk_size
+ *  Bits per chunk
+ * @var DACArray.n_levels
+ *  Number of levels, enough for the largest value
+ * @var DACArray.levels
+ *  Levels, lowest chunks first
+ */
+typedef struct {
+  size_t n;
+  uint8_t chunk_size;
+  size_t n_levels;
+  DACLevel levels[];
+} DACArray;
+
+
+/**
+ * @brief Build a DACArray holding the values of A
+ *
+ * @param A             Values to store
+ * @param n             Length of A
+ * @param chunk_size    Bits per chunk (1-32), 8 gives byte chunks
+ * @return              Pointer to DACArray
+ */
+DACArray* DACArray_init(const uint32_t A[], uint32_t n, uint8_t chunk_size);
+
+/**
+ * @brief Free a DACArray and its levels
+ *
+ * @param dac
+ */
+void DACArray_free(DACArray *dac);
+
+/**
+ * @brief Get value at index i
+ *
+ * @param dac
+ * @param i
+ */
+uint32_t DACArray_read(const DACArray *dac, size_t i);
+
+/**
+ * @brief Bytes used by the values and their indexes
+ *
+ * @param dac
+ */
+size_t DACArray_size(const DACArray *dac);
+
+#endif // !DAC_H_
@@ -0,0 +1,157 @@
+/**
+ * @file
+ * @brief Elias-Fano coding of non-decreasing sequences
+ */
+
+#include <string.h>
+#include "elias_fano.h"
+#include "bitops.h"
+
+EliasFano* EliasFano_init(const uint32_t A[], uint32_t n)
+{
+    // Checked up front, high is sized by the last value
+    for (uint32_t i = 1; i < n; ++i) {
+        if (A[i] < A[i-1]) {
+            fprintf(stderr, "%s:%d Sequence is not sorted\n", __FILE__, __LINE__);
+            exit(OUT_OF_BOUNDS);
+        }
+    }
+
+    EliasFano *ef = malloc(sizeof(EliasFano));
+    if (ef == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    ef->n = n;
+    ef->universe = n ? (uint64_t) A[n-1] + 1 : 0;
+    ef->low_bits = ef->universe > n ? (uint8_t) msb64(ef->universe / n) : 0;
+    // u / n reaches 2^32 for a single UINT32_MAX, shifts need l < 32
+    if (ef->low_bits > 31) ef->low_bits = 31;
+
+    const uint8_t l = ef->low_bits;
+    const uint32_t n_high = n ? n + (uint32_t) (A[n-1] >> l) + 1 : 0;
+    ef->high = BitArray_calloc(n_high, 1, sizeof(uint32_t));
+    ef->low = NULL;
+
+    BitArrayBuilder low;
+    if (l) BitArrayBuilder_begin(&low, n, l, sizeof(uint32_t));
+    for (uint32_t i = 0; i < n; ++i) {
+        bit_set(ef->high->v, 32, (size_t) (A[i] >> l) + i);
+        if (l) BitArrayBuilder_push(&low, A[i]);
+    }
+    if (l) ef->low = BitArrayBuilder_finish(&low);
+
+    ef->rs = RankSelectBitVector_from_BitArray(ef->high);
+    return ef;
+}
+
+void EliasFano_free(EliasFano *ef)
+{
+    RankSelectBitVector_free(ef->rs);
+    BitArray_free(ef->high);
+    if (ef->low) BitArray_free(ef->low);
+    free(ef);
+}
+
+static inline uint32_t ef_low(const EliasFano *ef, size_t i)
+{
+    return ef->low_bits ? BitArray_read_unchecked(ef->low, i) : 0;
+}
+
+
+// -- Queries -----------------------------------------------------------------
+uint32_t EliasFano_access(const EliasFano *ef, size_t i)
+{
+    if (i >= ef->n) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    const size_t high = RankSelectBitVector_select1(ef->rs, i + 1) - i;
+    return (uint32_t) (high << ef->low_bits) | ef_low(ef, i);
+}
+
+size_t EliasFano_next_geq(const EliasFano *ef, uint32_t x)
+{
+    if (x >= ef->universe) return ef->n;
+
+    // First position of the bucket of x, after the h-th zero
+    const size_t h = x >> ef->low_bits;
+    size_t pos = h ? RankSelectBitVector_select0(ef->rs, h) + 1 : 0,
+           i = pos - h;
+    const uint32_t x_low = x & (uint32_t) (((uint64_t) 1 << ef->low_bits) - 1);
+
+    // Scan the bucket, the value after it is larger than x
+    for (; bit_read(ef->high->v, 32, pos); ++pos, ++i) {
+        if (ef_low(ef, i) >= x_low) return i;
+    }
+    return i;
+}
+
+size_t EliasFano_prev_leq(const EliasFano *ef, uint32_t x)
+{
+    const size_t i = x == UINT32_MAX ? ef->n : EliasFano_next_geq(ef, x + 1);
+    return i ? i - 1 : ef->n;
+}
+
+size_t EliasFano_size(const EliasFano *ef)
+{
+    size_t bytes = sizeof(EliasFano) +
+      sizeof(BitArray) + sizeof(uint32_t) * BitArray_n_words(ef->high) +
+      RankSelectBitVector_size(ef->rs);
+    if (ef->low) bytes += sizeof(BitArray) + sizeof(uint32_t) * BitArray_n_words(ef->low);
+    return bytes;
+}
+
+
+// -- Iteration ---------------------------------------------------------------
+// Unpack the low bits of the block holding value i
+static void ef_iter_lows(EliasFanoIter *it)
+{
+    const EliasFano *ef = it->ef;
+    if (ef->low == NULL) return;
+
+    const size_t start = it->i - it->i % BITPACK_BLOCK,
+                 count = ef->n - start < BITPACK_BLOCK ? ef->n - start : BITPACK_BLOCK;
+    BitArray_unpack(ef->low, start, count, it->lows);
+}
+
+void EliasFano_iter(EliasFanoIter *it, const EliasFano *ef, size_t start)
+{
+    if (start > ef->n) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    it->ef = ef;
+    it->i = start;
+    it->word = 0;
+    it->bits = 0;
+    memset(it->lows, 0, sizeof(it->lows));
+    if (start == ef->n) return;
+
+    const size_t pos = RankSelectBitVector_select1(ef->rs, start + 1);
+    it->word = pos / 32;
+    it->bits = ef->high->v[it->word] & (~0u << (pos % 32));
+    ef_iter_lows(it);
+}
+
+uint32_t EliasFano_iter_next(EliasFanoIter *it)
+{
+    const EliasFano *ef = it->ef;
+    if (it->i >= ef->n) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    // Next set bit of the high bits
+    while (it->bits == 0) it->bits = ef->high->v[++it->word];
+    const size_t pos = it->word * 32 + (size_t) __builtin_ctz(it->bits);
+    it->bits &= it->bits - 1;
+
+    const uint32_t x = (uint32_t) ((pos - it->i) << ef->low_bits) |
+      it->lows[it->i % BITPACK_BLOCK];
+    if (++it->i % BITPACK_BLOCK == 0 && it->i < ef->n) ef_iter_lows(it);
+    return x;
+}
@@ -0,0 +1,145 @@
+/**
+ * @file
+ * @brief Elias-Fano coding of non-decreasing sequences
+ *
+ * A sorted sequence of n values below a universe u is split at
+ * l = floor(log2(u / n)) bits:
+ *
+ *  - the l low bits of every value are kept in a fixed width BitArray.
+ *  - the high bits are kept in unary in a bit vector of n + (u >> l) + 1
+ *    bits, value i setting bit (x_i >> l) + i. Zeros separate the buckets
+ *    of equal high bits.
+ *
+ * That is at most 2 + l bits per value. With a rank/select index over the
+ * high bits:
+ *
+ *   access(i)   ((select1(i + 1) - i) << l) | low[i]
+ *   next_geq(x) jumps to the bucket of x >> l with select0 and scans it
+ *
+ * Sequential iteration walks the set bits of the high bits word by word and
+ * unpacks the low bits a block at a time.
+ */
+
+#ifndef ELIAS_FANO_H_
+#define ELIAS_FANO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bitarr.h"
+#include "bitpack.h"
+#include "rank_select.h"
+
+/**
+ * @struct EliasFano
+ *
+ * @var EliasFano.n
+ *  Number of values
+ * @var EliasFano.universe
+ *  One more than the largest value
+ * @var EliasFano.low_bits
+ *  Number of low bits per value, l
+ * @var EliasFano.low
+ *  Low bits of every value, NULL when l is 0
+ * @var EliasFano.high
+ *  High bits in unary, 1 bit BitArray
+ * @var EliasFano.rs
+ *  Rank/select index over high
+ */
+typedef struct {
+  size_t n;
+  uint64_t universe;
+  uint8_t low_bits;
+  BitArray *low;
+  BitArray *high;
+  RankSelectBitVector *rs;
+} EliasFano;
+
+/**
+ * @struct EliasFanoIter
+ *
+ * @var EliasFanoIter.ef
+ *  Sequence being iterated
+ * @var EliasFanoIter.i
+ *  Index of the next value
+ * @var EliasFanoIter.word
+ *  Index of the word of high holding the next set bit
+ * @var EliasFanoIter.bits
+ *  Set bits of that word not yet visited
+ * @var EliasFanoIter.lows
+ *  Unpacked low bits of the block holding value i
+ */
+typedef struct {
+  const EliasFano *ef;
+  size_t i;
+  size_t word;
+  uint32_t bits;
+  uint32_t lows[BITPACK_BLOCK];
+} EliasFanoIter;
+
+
+/**
+ * @brief Encode a non-decreasing sequence
+ *
+ * @param A     Sorted values
+ * @param n     Length of A
+ * @return      Pointer to EliasFano
+ */
+EliasFano* EliasFano_init(const uint32_t A[], uint32_t n);
+
+/**
+ * @brief Free the sequence and its index
+ *
+ * @param ef
+ */
+void EliasFano_free(EliasFano *ef);
+
+/**
+ * @brief Value at index i
+ *
+ * @param ef
+ * @param i     0 <= i < n
+ */
+uint32_t EliasFano_access(const EliasFano *ef, size_t i);
+
+/**
+ * @brief Index of the first value greater than or equal to x
+ *
+ * @param ef
+ * @param x
+ * @return      Index in [0, n], n when every value is smaller than x
+ */
+size_t EliasFano_next_geq(const EliasFano *ef, uint32_t x);
+
+/**
+ * @brief Index of the last value less than or equal to x
+ *
+ * @param ef
+ * @param x
+ * @return      Index in [0, n), n when every value is larger than x
+ */
+size_t EliasFano_prev_leq(const EliasFano *ef, uint32_t x);
+
+/**
+ * @brief Bytes used by the sequence and its index
+ *
+ * @param ef
+ */
+size_t EliasFano_size(const EliasFano *ef);
+
+/**
+ * @brief Position an iterator at value start
+ *
+ * @param it    Iterator to initialize
+ * @param ef    Sequence to iterate, must outlive the iterator
+ * @param start 0 <= start <= n
+ */
+void EliasFano_iter(EliasFanoIter *it, const EliasFano *ef, size_t start);
+
+/**
+ * @brief Return the next value and advance the iterator
+ *
+ * @param it
+ */
+uint32_t EliasFano_iter_next(EliasFanoIter *it);
+
+#endif // !ELIAS_FANO_H_
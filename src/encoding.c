@@ -5,6 +5,266 @@
 
 #include "encoding.h"
 
+// Generated by walking every byte value, see gamma_read for the layout
+const GammaTableEntry gamma_table[1 << GAMMA_TABLE_BITS] = {
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 1, 1, { 1, 0, 0, 0, 0, 0, 0, 0 } },
+    { 1, 3, { 2, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 2, { 1, 1, 0, 0, 0, 0, 0, 0 } },
+    { 1, 5, { 4, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 1, 2, 0, 0, 0, 0, 0, 0 } },
+    { 1, 3, { 3, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 3, { 1, 1, 1, 0, 0, 0, 0, 0 } },
+    { 1, 7, { 8, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 1, 4, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 2, 1, 0, 0, 0, 0, 0, 0 } },
+    { 3, 5, { 1, 1, 2, 0, 0, 0, 0, 0 } },
+    { 1, 5, { 5, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 1, 3, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 3, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 4, { 1, 1, 1, 1, 0, 0, 0, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 1, 8, 0, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 2, 2, 0, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 1, 1, 4, 0, 0, 0, 0, 0 } },
+    { 1, 5, { 6, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 5, { 1, 2, 1, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 3, 2, 0, 0, 0, 0, 0, 0 } },
+    { 4, 6, { 1, 1, 1, 2, 0, 0, 0, 0 } },
+    { 1, 7, { 9, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 1, 5, 0, 0, 0, 0, 0, 0 } },
+    { 3, 5, { 2, 1, 1, 0, 0, 0, 0, 0 } },
+    { 3, 5, { 1, 1, 3, 0, 0, 0, 0, 0 } },
+    { 1, 5, { 7, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 5, { 1, 3, 1, 0, 0, 0, 0, 0 } },
+    { 3, 5, { 3, 1, 1, 0, 0, 0, 0, 0 } },
+    { 5, 5, { 1, 1, 1, 1, 1, 0, 0, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 1, 1, { 1, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 2, 4, 0, 0, 0, 0, 0, 0 } },
+    { 2, 2, { 1, 1, 0, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 4, 1, 0, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 1, 2, 2, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 3, 4, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 1, 1, 4, 0, 0, 0, 0 } },
+    { 1, 7, { 10, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 1, 6, 0, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 2, 1, 2, 0, 0, 0, 0, 0 } },
+    { 4, 6, { 1, 1, 2, 1, 0, 0, 0, 0 } },
+    { 2, 6, { 5, 1, 0, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 1, 3, 2, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 3, 1, 2, 0, 0, 0, 0, 0 } },
+    { 5, 7, { 1, 1, 1, 1, 2, 0, 0, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 1, 9, 0, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 2, 3, 0, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 1, 1, 5, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 6, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 6, { 1, 2, 1, 1, 0, 0, 0, 0 } },
+    { 2, 6, { 3, 3, 0, 0, 0, 0, 0, 0 } },
+    { 4, 6, { 1, 1, 1, 3, 0, 0, 0, 0 } },
+    { 1, 7, { 11, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 1, 7, 0, 0, 0, 0, 0, 0 } },
+    { 4, 6, { 2, 1, 1, 1, 0, 0, 0, 0 } },
+    { 4, 6, { 1, 1, 3, 1, 0, 0, 0, 0 } },
+    { 2, 6, { 7, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 6, { 1, 3, 1, 1, 0, 0, 0, 0 } },
+    { 4, 6, { 3, 1, 1, 1, 0, 0, 0, 0 } },
+    { 6, 6, { 1, 1, 1, 1, 1, 1, 0, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 1, 1, { 1, 0, 0, 0, 0, 0, 0, 0 } },
+    { 1, 3, { 2, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 2, { 1, 1, 0, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 4, 2, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 1, 2, 0, 0, 0, 0, 0, 0 } },
+    { 1, 3, { 3, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 3, { 1, 1, 1, 0, 0, 0, 0, 0 } },
+    { 1, 7, { 12, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 1, 4, 1, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 2, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 1, 2, 2, 0, 0, 0, 0 } },
+    { 2, 8, { 5, 2, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 1, 3, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 3, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 4, { 1, 1, 1, 1, 0, 0, 0, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 1, 10, 0, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 2, 2, 1, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 1, 1, 6, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 6, 2, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 2, 1, 2, 0, 0, 0, 0 } },
+    { 3, 7, { 3, 2, 1, 0, 0, 0, 0, 0 } },
+    { 5, 7, { 1, 1, 1, 2, 1, 0, 0, 0 } },
+    { 1, 7, { 13, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 1, 5, 1, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 2, 1, 1, 2, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 1, 3, 2, 0, 0, 0, 0 } },
+    { 2, 8, { 7, 2, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 3, 1, 2, 0, 0, 0, 0 } },
+    { 4, 8, { 3, 1, 1, 2, 0, 0, 0, 0 } },
+    { 6, 8, { 1, 1, 1, 1, 1, 2, 0, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 1, 1, { 1, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 2, 5, 0, 0, 0, 0, 0, 0 } },
+    { 2, 2, { 1, 1, 0, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 4, 1, 1, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 1, 2, 3, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 3, 5, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 1, 1, 5, 0, 0, 0, 0 } },
+    { 1, 7, { 14, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 1, 6, 1, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 2, 1, 3, 0, 0, 0, 0, 0 } },
+    { 5, 7, { 1, 1, 2, 1, 1, 0, 0, 0 } },
+    { 3, 7, { 5, 1, 1, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 1, 3, 3, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 3, 1, 3, 0, 0, 0, 0, 0 } },
+    { 5, 7, { 1, 1, 1, 1, 3, 0, 0, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 1, 11, 0, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 2, 3, 1, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 1, 1, 7, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 6, 1, 1, 0, 0, 0, 0, 0 } },
+    { 5, 7, { 1, 2, 1, 1, 1, 0, 0, 0 } },
+    { 3, 7, { 3, 3, 1, 0, 0, 0, 0, 0 } },
+    { 5, 7, { 1, 1, 1, 3, 1, 0, 0, 0 } },
+    { 1, 7, { 15, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 7, { 1, 7, 1, 0, 0, 0, 0, 0 } },
+    { 5, 7, { 2, 1, 1, 1, 1, 0, 0, 0 } },
+    { 5, 7, { 1, 1, 3, 1, 1, 0, 0, 0 } },
+    { 3, 7, { 7, 1, 1, 0, 0, 0, 0, 0 } },
+    { 5, 7, { 1, 3, 1, 1, 1, 0, 0, 0 } },
+    { 5, 7, { 3, 1, 1, 1, 1, 0, 0, 0 } },
+    { 7, 7, { 1, 1, 1, 1, 1, 1, 1, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 1, 1, { 1, 0, 0, 0, 0, 0, 0, 0 } },
+    { 1, 3, { 2, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 2, { 1, 1, 0, 0, 0, 0, 0, 0 } },
+    { 1, 5, { 4, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 1, 2, 0, 0, 0, 0, 0, 0 } },
+    { 1, 3, { 3, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 3, { 1, 1, 1, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 8, 1, 0, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 1, 4, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 2, 1, 0, 0, 0, 0, 0, 0 } },
+    { 3, 5, { 1, 1, 2, 0, 0, 0, 0, 0 } },
+    { 1, 5, { 5, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 1, 3, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 3, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 4, { 1, 1, 1, 1, 0, 0, 0, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 1, 12, 0, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 2, 2, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 1, 4, 1, 0, 0, 0, 0 } },
+    { 1, 5, { 6, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 5, { 1, 2, 1, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 3, 2, 0, 0, 0, 0, 0, 0 } },
+    { 4, 6, { 1, 1, 1, 2, 0, 0, 0, 0 } },
+    { 2, 8, { 9, 1, 0, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 1, 5, 0, 0, 0, 0, 0, 0 } },
+    { 3, 5, { 2, 1, 1, 0, 0, 0, 0, 0 } },
+    { 3, 5, { 1, 1, 3, 0, 0, 0, 0, 0 } },
+    { 1, 5, { 7, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 5, { 1, 3, 1, 0, 0, 0, 0, 0 } },
+    { 3, 5, { 3, 1, 1, 0, 0, 0, 0, 0 } },
+    { 5, 5, { 1, 1, 1, 1, 1, 0, 0, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 1, 1, { 1, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 2, 6, 0, 0, 0, 0, 0, 0 } },
+    { 2, 2, { 1, 1, 0, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 4, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 2, 2, 1, 0, 0, 0, 0 } },
+    { 2, 8, { 3, 6, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 1, 1, 6, 0, 0, 0, 0 } },
+    { 2, 8, { 10, 1, 0, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 1, 6, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 2, 1, 2, 1, 0, 0, 0, 0 } },
+    { 4, 6, { 1, 1, 2, 1, 0, 0, 0, 0 } },
+    { 2, 6, { 5, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 3, 2, 1, 0, 0, 0, 0 } },
+    { 4, 8, { 3, 1, 2, 1, 0, 0, 0, 0 } },
+    { 6, 8, { 1, 1, 1, 1, 2, 1, 0, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 1, 13, 0, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 2, 3, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 1, 5, 1, 0, 0, 0, 0 } },
+    { 2, 6, { 6, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 6, { 1, 2, 1, 1, 0, 0, 0, 0 } },
+    { 2, 6, { 3, 3, 0, 0, 0, 0, 0, 0 } },
+    { 4, 6, { 1, 1, 1, 3, 0, 0, 0, 0 } },
+    { 2, 8, { 11, 1, 0, 0, 0, 0, 0, 0 } },
+    { 2, 6, { 1, 7, 0, 0, 0, 0, 0, 0 } },
+    { 4, 6, { 2, 1, 1, 1, 0, 0, 0, 0 } },
+    { 4, 6, { 1, 1, 3, 1, 0, 0, 0, 0 } },
+    { 2, 6, { 7, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 6, { 1, 3, 1, 1, 0, 0, 0, 0 } },
+    { 4, 6, { 3, 1, 1, 1, 0, 0, 0, 0 } },
+    { 6, 6, { 1, 1, 1, 1, 1, 1, 0, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 1, 1, { 1, 0, 0, 0, 0, 0, 0, 0 } },
+    { 1, 3, { 2, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 2, { 1, 1, 0, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 4, 3, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 1, 2, 0, 0, 0, 0, 0, 0 } },
+    { 1, 3, { 3, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 3, { 1, 1, 1, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 12, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 4, 1, 1, 0, 0, 0, 0 } },
+    { 2, 4, { 2, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 1, 2, 3, 0, 0, 0, 0 } },
+    { 2, 8, { 5, 3, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 1, 3, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, { 3, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 4, { 1, 1, 1, 1, 0, 0, 0, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 1, 14, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 2, 2, 1, 1, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 1, 6, 1, 0, 0, 0, 0 } },
+    { 2, 8, { 6, 3, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 2, 1, 3, 0, 0, 0, 0 } },
+    { 4, 8, { 3, 2, 1, 1, 0, 0, 0, 0 } },
+    { 6, 8, { 1, 1, 1, 2, 1, 1, 0, 0 } },
+    { 2, 8, { 13, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 5, 1, 1, 0, 0, 0, 0 } },
+    { 4, 8, { 2, 1, 1, 3, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 1, 3, 3, 0, 0, 0, 0 } },
+    { 2, 8, { 7, 3, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 3, 1, 3, 0, 0, 0, 0 } },
+    { 4, 8, { 3, 1, 1, 3, 0, 0, 0, 0 } },
+    { 6, 8, { 1, 1, 1, 1, 1, 3, 0, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 1, 1, { 1, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 2, 7, 0, 0, 0, 0, 0, 0 } },
+    { 2, 2, { 1, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 4, 1, 1, 1, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 2, 3, 1, 0, 0, 0, 0 } },
+    { 2, 8, { 3, 7, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 1, 1, 7, 0, 0, 0, 0 } },
+    { 2, 8, { 14, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 6, 1, 1, 0, 0, 0, 0 } },
+    { 4, 8, { 2, 1, 3, 1, 0, 0, 0, 0 } },
+    { 6, 8, { 1, 1, 2, 1, 1, 1, 0, 0 } },
+    { 4, 8, { 5, 1, 1, 1, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 3, 3, 1, 0, 0, 0, 0 } },
+    { 4, 8, { 3, 1, 3, 1, 0, 0, 0, 0 } },
+    { 6, 8, { 1, 1, 1, 1, 3, 1, 0, 0 } },
+    { 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 8, { 1, 15, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 2, 3, 1, 1, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 1, 7, 1, 0, 0, 0, 0 } },
+    { 4, 8, { 6, 1, 1, 1, 0, 0, 0, 0 } },
+    { 6, 8, { 1, 2, 1, 1, 1, 1, 0, 0 } },
+    { 4, 8, { 3, 3, 1, 1, 0, 0, 0, 0 } },
+    { 6, 8, { 1, 1, 1, 3, 1, 1, 0, 0 } },
+    { 2, 8, { 15, 1, 0, 0, 0, 0, 0, 0 } },
+    { 4, 8, { 1, 7, 1, 1, 0, 0, 0, 0 } },
+    { 6, 8, { 2, 1, 1, 1, 1, 1, 0, 0 } },
+    { 6, 8, { 1, 1, 3, 1, 1, 1, 0, 0 } },
+    { 4, 8, { 7, 1, 1, 1, 0, 0, 0, 0 } },
+    { 6, 8, { 1, 3, 1, 1, 1, 1, 0, 0 } },
+    { 6, 8, { 3, 1, 1, 1, 1, 1, 0, 0 } },
+    { 8, 8, { 1, 1, 1, 1, 1, 1, 1, 1 } }
+};
+
 unsigned int unary_encode(uint32_t k)
 {
     // code 1 . 0 k times (e.g. 3 := 1 . 000
@@ -17,7 +277,7 @@ unsigned int gamma_encode(uint32_t k)
     uint32_t length, offset;
 
     // floor(log_2(k))
-    length = (uint32_t) log2(k);
+    length = find_MSB(k);
     offset = k - (1 << length);
 
     // Unary coded offset . length
@@ -39,3 +299,70 @@ unsigned int gamma_decode(unsigned int k)
 }
 
 
+// -- Codes -------------------------------------------------------------------
+size_t gamma_bits(uint64_t v)
+{
+    return 2 * (size_t) msb64(v) + 1;
+}
+
+size_t delta_bits(uint64_t v)
+{
+    const unsigned int l = msb64(v);
+    return gamma_bits(l + 1) + l;
+}
+
+size_t rice_bits(uint64_t v, unsigned int b)
+{
+    return (size_t) (v >> b) + 1 + b;
+}
+
+size_t varbyte_bits(uint64_t v)
+{
+    return 8 * (v ? msb64(v) / 7 + 1 : 1);
+}
+
+void gamma_write(BitWriter *w, uint64_t v)
+{
+    const unsigned int l = msb64(v);
+    BitWriter_zeros(w, l);
+    BitWriter_write(w, 1, 1);
+    BitWriter_write(w, v, l);
+}
+
+void delta_write(BitWriter *w, uint64_t v)
+{
+    const unsigned int l = msb64(v);
+    gamma_write(w, l + 1);
+    BitWriter_write(w, v, l);
+}
+
+void rice_write(BitWriter *w, uint64_t v, unsigned int b)
+{
+    BitWriter_zeros(w, (size_t) (v >> b));
+    BitWriter_write(w, 1, 1);
+    BitWriter_write(w, v, b);
+}
+
+void varbyte_write(BitWriter *w, uint64_t v)
+{
+    while (v > 0x7F) {
+        BitWriter_write(w, (v & 0x7F) | 0x80, 8);
+        v >>= 7;
+    }
+    BitWriter_write(w, v, 8);
+}
+
+unsigned int rice_tune(const uint32_t A[], size_t length)
+{
+    // Total size for parameter b is sum(A[i] >> b) + length * (b + 1)
+    uint64_t quotients[32] = { 0 };
+    for (size_t i = 0; i < length; ++i) {
+        for (unsigned int b = 0; b < 32; ++b) quotients[b] += A[i] >> b;
+    }
+
+    unsigned int best = 0;
+    for (unsigned int b = 1; b < 32; ++b) {
+        if (quotients[b] + length * b < quotients[best] + length * best) best = b;
+    }
+    return best;
+}
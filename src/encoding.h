@@ -1,11 +1,227 @@
 #ifndef ENCODING_H_
 #define ENCODING_H_
 
+#include <stddef.h>
 #include <stdint.h>
-#include <math.h>
 #include "bitops.h"
 
 
+/**
+ * @struct BitReader
+ *
+ * Sequential reader over an array of 32 bit words, least significant bit
+ * first. Up to two words are kept in a 64 bit buffer so that a code is
+ * usually decoded with a single shift and mask.
+ *
+ * @var BitReader.W
+ *  Words being read
+ * @var BitReader.n_words
+ *  Number of words in W
+ * @var BitReader.word
+ *  Next word of W to load into buf
+ * @var BitReader.buf
+ *  Loaded bits not yet consumed, the next bit is bit 0
+ * @var BitReader.avail
+ *  Number of valid bits in buf, the bits above are zero
+ */
+typedef struct {
+    const uint32_t *W;
+    size_t n_words;
+    size_t word;
+    uint64_t buf;
+    unsigned int avail;
+} BitReader;
+
+/**
+ * @brief Load words until more than 32 bits are buffered, or W runs out
+ */
+static inline void BitReader_refill(BitReader *r)
+{
+    while (r->avail <= 32 && r->word < r->n_words) {
+        r->buf |= (uint64_t) r->W[r->word++] << r->avail;
+        r->avail += 32;
+    }
+}
+
+/**
+ * @brief Drop n <= avail buffered bits
+ */
+static inline void BitReader_skip(BitReader *r, unsigned int n)
+{
+    r->buf = n < 64 ? r->buf >> n : 0;
+    r->avail -= n;
+}
+
+/**
+ * @brief Position a reader at bit pos of W
+ */
+static inline void BitReader_init(BitReader *r, const uint32_t *W,
+  size_t n_words, size_t pos)
+{
+    r->W = W;
+    r->n_words = n_words;
+    r->word = pos / 32;
+    r->buf = 0;
+    r->avail = 0;
+    BitReader_refill(r);
+    BitReader_skip(r, (unsigned int) (pos % 32));
+}
+
+/**
+ * @brief Read the next n <= 32 bits
+ */
+static inline uint32_t BitReader_read(BitReader *r, unsigned int n)
+{
+    if (r->avail < n) BitReader_refill(r);
+    uint32_t x = (uint32_t) (r->buf & (((uint64_t) 1 << n) - 1));
+    BitReader_skip(r, n);
+    return x;
+}
+
+/**
+ * @brief Read a unary code, the zeros up to and including the next one
+ *
+ * @return  Number of zeros
+ */
+static inline unsigned int BitReader_unary(BitReader *r)
+{
+    unsigned int zeros = 0;
+    for (;;) {
+        if (r->avail <= 32) BitReader_refill(r);
+        if (r->buf) {
+            unsigned int z = (unsigned int) __builtin_ctzll(r->buf);
+            BitReader_skip(r, z + 1);
+            return zeros + z;
+        }
+        // Run of zeros longer than the buffer
+        zeros += r->avail;
+        r->avail = 0;
+        if (r->word >= r->n_words) return zeros;
+    }
+}
+
+/**
+ * @struct BitWriter
+ *
+ * Sequential writer into zeroed 32 bit words, least significant bit first.
+ * The words must have room for every bit written.
+ *
+ * @var BitWriter.W
+ *  Words being written
+ * @var BitWriter.pos
+ *  Bit index of the next bit
+ */
+typedef struct {
+    uint32_t *W;
+    size_t pos;
+} BitWriter;
+
+/**
+ * @brief Write the n <= 32 low bits of x
+ */
+static inline void BitWriter_write(BitWriter *w, uint64_t x, unsigned int n)
+{
+    // At the end of W, pos / 32 may be one past the last word
+    if (n == 0) return;
+    const size_t j = w->pos / 32;
+    const unsigned int off = (unsigned int) (w->pos % 32);
+
+    x &= ((uint64_t) 1 << n) - 1;
+    w->W[j] |= (uint32_t) (x << off);
+    if (off + n > 32) w->W[j + 1] |= (uint32_t) (x >> (32 - off));
+    w->pos += n;
+}
+
+/**
+ * @brief Write n zero bits
+ */
+static inline void BitWriter_zeros(BitWriter *w, size_t n)
+{
+    w->pos += n;
+}
+
+
+// -- Codes -------------------------------------------------------------------
+/*
+ * Every code is written least significant bit first, the layouts being
+ *
+ *   gamma(v),   v >= 1   l = msb(v): l zeros, a one, the l low bits of v
+ *   delta(v),   v >= 1   gamma(msb(v) + 1), the msb(v) low bits of v
+ *   rice(v, b)           v >> b in unary (zeros closed by a one), the b low
+ *                        bits of v
+ *   varbyte(v)           7 bits of v per byte, low bits first, the high bit
+ *                        of a byte set when another follows
+ *
+ * Gamma suits small values, delta large ones and Rice geometrically
+ * distributed values, with b close to log2 of their mean. Varbyte codes are
+ * whole bytes, so a stream of them can be decoded byte by byte.
+ *
+ * Values are up to 2^32 (gamma, delta) or 2^32 - 1 (rice, varbyte). The
+ * unary part of a Rice code grows with v >> b, so b must fit the values.
+ */
+
+size_t gamma_bits(uint64_t v);
+size_t delta_bits(uint64_t v);
+size_t rice_bits(uint64_t v, unsigned int b);
+size_t varbyte_bits(uint64_t v);
+
+void gamma_write(BitWriter *w, uint64_t v);
+void delta_write(BitWriter *w, uint64_t v);
+void rice_write(BitWriter *w, uint64_t v, unsigned int b);
+void varbyte_write(BitWriter *w, uint64_t v);
+
+/**
+ * @brief Rice parameter giving the shortest encoding of A
+ *
+ * @param A         Values to encode
+ * @param length    Length of A
+ * @return          b in [0, 31]
+ */
+unsigned int rice_tune(const uint32_t A[], size_t length);
+
+static inline uint64_t gamma_read(BitReader *r)
+{
+    unsigned int l = BitReader_unary(r);
+    return (uint64_t) 1 << l | BitReader_read(r, l);
+}
+
+static inline uint64_t delta_read(BitReader *r)
+{
+    unsigned int l = (unsigned int) gamma_read(r) - 1;
+    return (uint64_t) 1 << l | BitReader_read(r, l);
+}
+
+static inline uint64_t rice_read(BitReader *r, unsigned int b)
+{
+    uint64_t q = BitReader_unary(r);
+    return q << b | BitReader_read(r, b);
+}
+
+static inline uint64_t varbyte_read(BitReader *r)
+{
+    uint64_t v = 0;
+    for (unsigned int shift = 0;; shift += 7) {
+        uint32_t c = BitReader_read(r, 8);
+        v |= (uint64_t) (c & 0x7F) << shift;
+        if (!(c & 0x80)) return v;
+    }
+}
+
+/*
+ * Gamma codes of small values are short enough that several of them fit in
+ * one byte. gamma_table maps the next GAMMA_TABLE_BITS bits of a stream to
+ * the codes lying entirely within them, so a run of small values is decoded
+ * a byte at a time. Entries with count 0 start with a longer code.
+ */
+#define GAMMA_TABLE_BITS 8
+
+typedef struct {
+    uint8_t count;      // Complete codes in the byte
+    uint8_t bits;       // Bits taken by those codes
+    uint8_t values[8];  // Decoded values
+} GammaTableEntry;
+
+extern const GammaTableEntry gamma_table[1 << GAMMA_TABLE_BITS];
 
 
 uint32_t count_trailing_zeros(unsigned int v);
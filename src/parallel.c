@@ -0,0 +1,71 @@
+/**
+ * @file
+ * @brief Minimal thread pool for bulk construction and decoding
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "parallel.h"
+
+typedef struct {
+  parallel_fn fn;
+  void *ctx;
+  size_t n_tasks;
+  atomic_size_t next;
+} ParallelJob;
+
+static void* parallel_worker(void *arg)
+{
+    ParallelJob *job = arg;
+    size_t task;
+    while ((task = atomic_fetch_add(&job->next, 1)) < job->n_tasks) {
+        job->fn(job->ctx, task);
+    }
+    return NULL;
+}
+
+unsigned int parallel_threads(unsigned int n_threads)
+{
+    if (n_threads) return n_threads;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (unsigned int) cpus : 1;
+}
+
+size_t parallel_chunk(size_t count, unsigned int n_threads, size_t align)
+{
+    const size_t tasks = 4 * (size_t) parallel_threads(n_threads);
+    size_t chunk = (count + tasks - 1) / tasks;
+    if (chunk < PARALLEL_GRAIN) chunk = PARALLEL_GRAIN;
+    return (chunk + align - 1) / align * align;
+}
+
+void parallel_for(size_t n_tasks, unsigned int n_threads, parallel_fn fn,
+  void *ctx)
+{
+    ParallelJob job = { fn, ctx, n_tasks, 0 };
+    size_t n_workers = parallel_threads(n_threads) - 1;
+    if (n_workers > n_tasks - (n_tasks > 0)) n_workers = n_tasks - (n_tasks > 0);
+
+    pthread_t *workers = NULL;
+    if (n_workers) {
+        workers = malloc(sizeof(pthread_t) * n_workers);
+        if (workers == NULL) {
+            printf("Couldn't allocate memory for vector.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Threads which fail to start leave their share to the others
+    size_t started = 0;
+    for (; started < n_workers; ++started) {
+        if (pthread_create(&workers[started], NULL, parallel_worker, &job)) break;
+    }
+    parallel_worker(&job);
+    for (size_t t = 0; t < started; ++t) pthread_join(workers[t], NULL);
+    free(workers);
+}
@@ -0,0 +1,61 @@
+/**
+ * @file
+ * @brief Minimal thread pool for bulk construction and decoding
+ *
+ * Work is cut into independent tasks numbered 0 to n_tasks - 1. The calling
+ * thread and n_threads - 1 workers claim tasks from a shared atomic counter
+ * until none are left, so uneven tasks balance themselves. Workers only
+ * live for the duration of a call, which keeps the library free of global
+ * state; bulk calls are large enough for thread start up not to matter.
+ */
+
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include <stddef.h>
+
+// Smallest number of values worth handing to a thread
+#define PARALLEL_GRAIN 16384
+
+/**
+ * @brief Task body, called once for every task number
+ *
+ * @param ctx   Context passed to parallel_for
+ * @param task  Task number
+ */
+typedef void (*parallel_fn)(void *ctx, size_t task);
+
+/**
+ * @brief Number of threads to use for a requested count
+ *
+ * @param n_threads Requested number of threads, 0 for one per online CPU
+ * @return          At least 1
+ */
+unsigned int parallel_threads(unsigned int n_threads);
+
+/**
+ * @brief Values per task when splitting count values over n_threads
+ *
+ * Gives each thread a few tasks so uneven ones balance out, but no fewer
+ * than PARALLEL_GRAIN values per task.
+ *
+ * @param count     Number of values
+ * @param n_threads Number of threads, 0 for one per online CPU
+ * @param align     Task sizes are a multiple of align
+ */
+size_t parallel_chunk(size_t count, unsigned int n_threads, size_t align);
+
+/**
+ * @brief Run fn for every task on up to n_threads threads
+ *
+ * Returns once every task has finished.
+ *
+ * @param n_tasks   Number of tasks
+ * @param n_threads Number of threads, 0 for one per online CPU
+ * @param fn        Task body
+ * @param ctx       Passed to every call of fn
+ */
+void parallel_for(size_t n_tasks, unsigned int n_threads, parallel_fn fn,
+  void *ctx);
+
+#endif // !PARALLEL_H_
@@ -0,0 +1,233 @@
+/**
+ * @file
+ * @brief Patched frame of reference block compression
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pfor.h"
+#include "bitpack.h"
+#include "bitops.h"
+#include "common.h"
+
+/**
+ * @struct PForBlock
+ *
+ * Layout of one block, see pfor.h
+ */
+typedef struct {
+  uint32_t base;
+  uint8_t b;          // Width of the packed values
+  uint8_t hb;         // Width of the exception high bits
+  uint8_t n_exc;      // Number of exceptions, < PFOR_BLOCK
+} PForBlock;
+
+// Bits needed for x
+static inline unsigned pfor_bits(uint32_t x)
+{
+    return x ? find_MSB(x) + 1 : 0;
+}
+
+static inline size_t pfor_words(size_t count, unsigned w)
+{
+    return (count * w + 31) / 32;
+}
+
+static size_t PForBlock_words(const PForBlock *blk, size_t len)
+{
+    return 2 + pfor_words(len, blk->b) + (blk->n_exc + 3u) / 4 +
+      pfor_words(blk->n_exc, blk->hb);
+}
+
+// Base and widths giving the smallest encoding of A[0, len)
+static PForBlock PForBlock_plan(const uint32_t A[], size_t len)
+{
+    PForBlock blk = { A[0], 0, 0, 0 };
+    for (size_t i = 1; i < len; ++i) if (A[i] < blk.base) blk.base = A[i];
+
+    size_t hist[33] = { 0 };
+    for (size_t i = 0; i < len; ++i) hist[pfor_bits(A[i] - blk.base)]++;
+    unsigned max_bits = 32;
+    while (max_bits && hist[max_bits] == 0) max_bits--;
+
+    // Values wider than b become exceptions of 8 + max_bits - b bits
+    size_t best = SIZE_MAX, exceptions = 0;
+    for (unsigned b = max_bits + 1; b-- > 0;) {
+        size_t cost = len * b + exceptions * (8 + max_bits - b);
+        if (exceptions < PFOR_BLOCK && cost < best) {
+            best = cost;
+            blk.b = (uint8_t) b;
+            blk.n_exc = (uint8_t) exceptions;
+        }
+        exceptions += hist[b];
+    }
+    blk.hb = (uint8_t) (max_bits - blk.b);
+    return blk;
+}
+
+// Write A[0, len) as a block at W, returns the number of words used
+static size_t PForBlock_write(uint32_t *W, const uint32_t A[], size_t len)
+{
+    const PForBlock blk = PForBlock_plan(A, len);
+    uint32_t diff[PFOR_BLOCK], high[PFOR_BLOCK];
+    uint32_t *positions = W + 2 + pfor_words(len, blk.b);
+    size_t e = 0;
+
+    W[0] = blk.base;
+    W[1] = blk.b | (uint32_t) blk.hb << 8 | (uint32_t) blk.n_exc << 16;
+    for (size_t i = 0; i < len; ++i) {
+        diff[i] = A[i] - blk.base;
+        if (blk.b < 32 && diff[i] >> blk.b) {
+            positions[e / 4] |= (uint32_t) i << (8 * (e % 4));
+            high[e++] = diff[i] >> blk.b;
+        }
+    }
+    if (blk.b) bitpack_pack(W + 2, blk.b, 0, len, diff);
+    if (blk.hb) bitpack_pack(positions + (e + 3) / 4, blk.hb, 0, e, high);
+    return PForBlock_words(&blk, len);
+}
+
+static inline PForBlock PForBlock_header(const uint32_t *W)
+{
+    PForBlock blk = { W[0], (uint8_t) W[1], (uint8_t) (W[1] >> 8), (uint8_t) (W[1] >> 16) };
+    return blk;
+}
+
+// Decode the len values of the block at W into out
+static void PForBlock_decode(const uint32_t *W, size_t len, uint32_t *out)
+{
+    const PForBlock blk = PForBlock_header(W);
+    const size_t packed = pfor_words(len, blk.b);
+
+    if (blk.b) bitpack_unpack(W + 2, packed, blk.b, 0, len, out);
+    else memset(out, 0, sizeof(uint32_t) * len);
+
+    if (blk.n_exc) {
+        const uint32_t *positions = W + 2 + packed;
+        uint32_t high[PFOR_BLOCK];
+        bitpack_unpack(positions + (blk.n_exc + 3) / 4, pfor_words(blk.n_exc, blk.hb),
+          blk.hb, 0, blk.n_exc, high);
+        for (size_t e = 0; e < blk.n_exc; ++e) {
+            out[(positions[e / 4] >> (8 * (e % 4))) & 0xFF] |= high[e] << blk.b;
+        }
+    }
+
+    for (size_t i = 0; i < len; ++i) out[i] += blk.base;
+}
+
+static inline size_t pfor_block_len(const PForArray *pfor, size_t block)
+{
+    const size_t start = block * PFOR_BLOCK;
+    return pfor->n - start < PFOR_BLOCK ? pfor->n - start : PFOR_BLOCK;
+}
+
+
+PForArray* PForArray_init(const uint32_t A[], size_t n)
+{
+    PForArray *pfor = malloc(sizeof(PForArray));
+    if (pfor == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    pfor->n = n;
+    pfor->n_blocks = (n + PFOR_BLOCK - 1) / PFOR_BLOCK;
+    pfor->offsets = malloc(sizeof(size_t) * (pfor->n_blocks + 1));
+    if (pfor->offsets == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Size every block first so the data is allocated once
+    pfor->offsets[0] = 0;
+    for (size_t k = 0; k < pfor->n_blocks; ++k) {
+        const size_t len = pfor_block_len(pfor, k);
+        const PForBlock blk = PForBlock_plan(A + k * PFOR_BLOCK, len);
+        pfor->offsets[k + 1] = pfor->offsets[k] + PForBlock_words(&blk, len);
+    }
+
+    pfor->data = calloc(pfor->offsets[pfor->n_blocks] + 1, sizeof(uint32_t));
+    if (pfor->data == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t k = 0; k < pfor->n_blocks; ++k) {
+        PForBlock_write(pfor->data + pfor->offsets[k], A + k * PFOR_BLOCK,
+          pfor_block_len(pfor, k));
+    }
+
+    return pfor;
+}
+
+void PForArray_free(PForArray *pfor)
+{
+    free(pfor->offsets);
+    free(pfor->data);
+    free(pfor);
+}
+
+uint32_t PForArray_read(const PForArray *pfor, size_t i)
+{
+    if (i >= pfor->n) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    const uint32_t *W = pfor->data + pfor->offsets[i / PFOR_BLOCK];
+    const PForBlock blk = PForBlock_header(W);
+    const size_t j = i % PFOR_BLOCK,
+                 packed = pfor_words(pfor_block_len(pfor, i / PFOR_BLOCK), blk.b);
+    uint32_t x = 0;
+
+    if (blk.b) bitpack_unpack(W + 2, packed, blk.b, j, 1, &x);
+
+    // Positions are increasing, stop at the first one not before j
+    const uint32_t *positions = W + 2 + packed;
+    for (size_t e = 0; e < blk.n_exc; ++e) {
+        const size_t pos = (positions[e / 4] >> (8 * (e % 4))) & 0xFF;
+        if (pos < j) continue;
+        if (pos == j) {
+            uint32_t high;
+            bitpack_unpack(positions + (blk.n_exc + 3) / 4,
+              pfor_words(blk.n_exc, blk.hb), blk.hb, e, 1, &high);
+            x |= high << blk.b;
+        }
+        break;
+    }
+
+    return blk.base + x;
+}
+
+void PForArray_decode(const PForArray *pfor, size_t start, size_t count,
+  uint32_t out[])
+{
+    if (start + count > pfor->n || start + count < start) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    uint32_t tmp[PFOR_BLOCK];
+    size_t i = start;
+    while (i < start + count) {
+        const size_t k = i / PFOR_BLOCK, len = pfor_block_len(pfor, k),
+                     lo = i % PFOR_BLOCK,
+                     hi = start + count - k * PFOR_BLOCK < len ?
+                       start + count - k * PFOR_BLOCK : len;
+        const uint32_t *W = pfor->data + pfor->offsets[k];
+
+        // Whole blocks are decoded in place, partial ones through tmp
+        if (lo == 0 && hi == len) {
+            PForBlock_decode(W, len, out + (i - start));
+        } else {
+            PForBlock_decode(W, len, tmp);
+            memcpy(out + (i - start), tmp + lo, sizeof(uint32_t) * (hi - lo));
+        }
+        i += hi - lo;
+    }
+}
+
+size_t PForArray_size(const PForArray *pfor)
+{
+    return sizeof(PForArray) + sizeof(size_t) * (pfor->n_blocks + 1) +
+      sizeof(uint32_t) * pfor->offsets[pfor->n_blocks];
+}
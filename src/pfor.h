@@ -0,0 +1,96 @@
+/**
+ * @file
+ * @brief Patched frame of reference block compression
+ *
+ * Values are cut into blocks of PFOR_BLOCK. Each block stores its minimum
+ * as a base and the differences to it at the width b that gives the
+ * smallest block, typically much narrower than the widest value. The few
+ * differences which do not fit in b bits are exceptions (PForDelta, Zukowski
+ * et al., "Super-Scalar RAM-CPU Cache Compression"): their low b bits stay in
+ * place and the high bits are patched in from a list after unpacking.
+ *
+ * Blocks are stored one after the other in a single word array, with the
+ * word offset of every block kept in a table for random access:
+ *
+ * ┌──────┬──────────────┬─────────────────────┬───────────┬──────────────┐
+ * │ base │ b, hb, n_exc │ PFOR_BLOCK x b bits │ positions │ n_exc x hb   │
+ * └──────┴──────────────┴─────────────────────┴───────────┴──────────────┘
+ *
+ * Exception positions are one byte each, four to a word, and their high bits
+ * are packed at width hb, the bits above b of the largest difference.
+ * A block is decoded with bitpack_unpack, which uses AVX2 when available,
+ * followed by the patch and base loops.
+ */
+
+#ifndef PFOR_H_
+#define PFOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Values per block
+#define PFOR_BLOCK 128
+
+/**
+ * @struct PForArray
+ *
+ * @var PForArray.n
+ *  Number of values
+ * @var PForArray.n_blocks
+ *  Number of blocks, the last one may be partial
+ * @var PForArray.offsets
+ *  Word offset of every block in data, plus the total number of words
+ * @var PForArray.data
+ *  Blocks
+ */
+typedef struct {
+  size_t n;
+  size_t n_blocks;
+  size_t *offsets;
+  uint32_t *data;
+} PForArray;
+
+
+/**
+ * @brief Compress A into a PForArray
+ *
+ * @param A     Values to compress
+ * @param n     Length of A
+ * @return      Pointer to PForArray
+ */
+PForArray* PForArray_init(const uint32_t A[], size_t n);
+
+/**
+ * @brief Free the array
+ *
+ * @param pfor
+ */
+void PForArray_free(PForArray *pfor);
+
+/**
+ * @brief Get value at index i
+ *
+ * @param pfor
+ * @param i
+ */
+uint32_t PForArray_read(const PForArray *pfor, size_t i);
+
+/**
+ * @brief Decode count consecutive values starting at start
+ *
+ * @param pfor
+ * @param start     Index of the first value
+ * @param count     Number of values to decode
+ * @param out       Array with room for count values
+ */
+void PForArray_decode(const PForArray *pfor, size_t start, size_t count,
+  uint32_t out[]);
+
+/**
+ * @brief Bytes used by the blocks and the offset table
+ *
+ * @param pfor
+ */
+size_t PForArray_size(const PForArray *pfor);
+
+#endif // !PFOR_H_
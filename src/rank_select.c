@@ -0,0 +1,201 @@
+/**
+ * @file
+ * @brief Rank and select over a bit vector
+ */
+
+#include "rank_select.h"
+#include "bitops.h"
+#include "cpu.h"
+
+// Number of 64 bit blocks covering n bits
+#define N_BLOCKS(n) (((n) + 63) / 64)
+
+// 64 bit block j of the indexed bits
+static inline uint64_t rs_block(const RankSelectBitVector *rs, size_t j)
+{
+    if (j + 1 >= N_BLOCKS(rs->n)) return rs->tail;
+    return rs->bits[2*j] | (uint64_t) rs->bits[2*j + 1] << 32;
+}
+
+
+// -- Construction ------------------------------------------------------------
+/*
+ * Fills the rank directory and returns the number of ones. Instantiated
+ * twice so that the bulk pass over the bits can use popcnt when the CPU has
+ * it, independent of the flags the library was built with.
+ */
+#define RS_COUNT(NAME, POPCOUNT)                                              \
+static size_t NAME(RankSelectBitVector *rs, size_t n_super)                   \
+{                                                                             \
+    const size_t n_blocks = N_BLOCKS(rs->n);                                  \
+    size_t total = 0;                                                         \
+                                                                              \
+    for (size_t s = 0; s < n_super; ++s) {                                    \
+        uint64_t rel = 0, in_super = 0;                                       \
+        rs->counts[2*s] = total;                                              \
+        for (size_t t = 0; t < 8; ++t) {                                      \
+            if (t) rel |= in_super << (9 * (t-1));                            \
+            if (s*8 + t < n_blocks) in_super += POPCOUNT(rs_block(rs, s*8 + t)); \
+        }                                                                     \
+        rs->counts[2*s + 1] = rel;                                            \
+        total += in_super;                                                    \
+    }                                                                         \
+    return total;                                                             \
+}
+
+RS_COUNT(rs_count, popcount64)
+
+#ifdef BITTER_X86
+__attribute__((target("popcnt")))
+RS_COUNT(rs_count_popcnt, (uint64_t) __builtin_popcountll)
+#endif
+
+// Ones before superblock s, or zeros when bit is 0
+static inline size_t rs_before(const RankSelectBitVector *rs, unsigned bit, size_t s)
+{
+    if (bit) return rs->counts[2*s];
+    // The superblocks past n only hold padding, which must not count as zeros
+    size_t bits = s * RS_SUPERBLOCK < rs->n ? s * RS_SUPERBLOCK : rs->n;
+    return bits - rs->counts[2*s];
+}
+
+// Superblock of every RS_SELECT_SAMPLE-th bit, the sentinel holds the last
+static size_t* rs_samples(const RankSelectBitVector *rs, unsigned bit, size_t total)
+{
+    size_t n_samples = (total + RS_SELECT_SAMPLE - 1) / RS_SELECT_SAMPLE;
+    size_t *samples = malloc(sizeof(size_t) * (n_samples + 1));
+    if (samples == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t s = 0;
+    for (size_t m = 0; m <= n_samples; ++m) {
+        size_t k = m < n_samples ? m * RS_SELECT_SAMPLE + 1 : total;
+        while (rs_before(rs, bit, s + 1) < k) s++;
+        samples[m] = s;
+    }
+    return samples;
+}
+
+RankSelectBitVector* RankSelectBitVector_init(const uint32_t *bits, size_t n)
+{
+    RankSelectBitVector *rs = malloc(sizeof(RankSelectBitVector));
+    // One superblock past the last bit keeps rank1(n) branch free
+    size_t n_super = n / RS_SUPERBLOCK + 1;
+    if (rs == NULL ||
+        (rs->counts = malloc(sizeof(uint64_t) * 2 * (n_super + 1))) == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    rs->bits = bits;
+    rs->n = n;
+    rs->tail = 0;
+    if (n) {
+        // Copy the last block so queries never read past the last word
+        size_t j = N_BLOCKS(n) - 1, words = (n + 31) / 32;
+        rs->tail = bits[2*j];
+        if (2*j + 1 < words) rs->tail |= (uint64_t) bits[2*j + 1] << 32;
+        if (n % 64) rs->tail &= ((uint64_t) 1 << (n % 64)) - 1;
+    }
+
+#ifdef BITTER_X86
+    if (cpu_features() & CPU_POPCNT) rs->ones = rs_count_popcnt(rs, n_super);
+    else
+#endif
+    rs->ones = rs_count(rs, n_super);
+    rs->counts[2*n_super] = rs->ones;
+    rs->counts[2*n_super + 1] = 0;
+
+    rs->samples1 = rs_samples(rs, 1, rs->ones);
+    rs->samples0 = rs_samples(rs, 0, n - rs->ones);
+
+    return rs;
+}
+
+RankSelectBitVector* RankSelectBitVector_from_BitArray(BitArray *bitarr)
+{
+    if (bitarr->element_size != 1) {
+        fprintf(stderr, "%s:%d Rank/select needs a 1 bit BitArray\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+    return RankSelectBitVector_init(bitarr->v, bitarr->n);
+}
+
+void RankSelectBitVector_free(RankSelectBitVector *rs)
+{
+    free(rs->counts);
+    free(rs->samples1);
+    free(rs->samples0);
+    free(rs);
+}
+
+
+// -- Queries -----------------------------------------------------------------
+size_t RankSelectBitVector_rank1(const RankSelectBitVector *rs, size_t i)
+{
+    const size_t s = i / RS_SUPERBLOCK, t = (i / 64) % 8;
+    size_t r = rs->counts[2*s];
+
+    if (t) r += (rs->counts[2*s + 1] >> (9 * (t-1))) & 0x1FF;
+    if (i % 64) r += popcount64(rs_block(rs, i / 64) & (((uint64_t) 1 << (i % 64)) - 1));
+    return r;
+}
+
+size_t RankSelectBitVector_rank0(const RankSelectBitVector *rs, size_t i)
+{
+    return i - RankSelectBitVector_rank1(rs, i);
+}
+
+size_t RankSelectBitVector_select1(const RankSelectBitVector *rs, size_t k)
+{
+    const size_t m = (k - 1) / RS_SELECT_SAMPLE;
+    size_t lo = rs->samples1[m], hi = rs->samples1[m + 1];
+
+    // Last superblock with fewer than k ones before it
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        if (rs->counts[2*mid] < k) lo = mid;
+        else hi = mid - 1;
+    }
+
+    // Block within the superblock
+    const uint64_t rel = rs->counts[2*lo + 1];
+    size_t r = k - rs->counts[2*lo], t = 0;
+    while (t < 7 && ((rel >> (9 * t)) & 0x1FF) < r) t++;
+    if (t) r -= (rel >> (9 * (t-1))) & 0x1FF;
+
+    return lo * RS_SUPERBLOCK + t * 64 +
+      select64(rs_block(rs, lo * 8 + t), (unsigned) (r - 1));
+}
+
+size_t RankSelectBitVector_select0(const RankSelectBitVector *rs, size_t k)
+{
+    const size_t m = (k - 1) / RS_SELECT_SAMPLE;
+    size_t lo = rs->samples0[m], hi = rs->samples0[m + 1];
+
+    // Last superblock with fewer than k zeros before it
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        if (rs_before(rs, 0, mid) < k) lo = mid;
+        else hi = mid - 1;
+    }
+
+    // Block within the superblock, zeros before block t are t * 64 - ones
+    const uint64_t rel = rs->counts[2*lo + 1];
+    size_t r = k - rs_before(rs, 0, lo), t = 0;
+    while (t < 7 && (t + 1) * 64 - ((rel >> (9 * t)) & 0x1FF) < r) t++;
+    if (t) r -= t * 64 - ((rel >> (9 * (t-1))) & 0x1FF);
+
+    return lo * RS_SUPERBLOCK + t * 64 +
+      select64(~rs_block(rs, lo * 8 + t), (unsigned) (r - 1));
+}
+
+size_t RankSelectBitVector_size(const RankSelectBitVector *rs)
+{
+    const size_t n_super = rs->n / RS_SUPERBLOCK + 1;
+    const size_t n_samples1 = (rs->ones + RS_SELECT_SAMPLE - 1) / RS_SELECT_SAMPLE;
+    const size_t n_samples0 = (rs->n - rs->ones + RS_SELECT_SAMPLE - 1) / RS_SELECT_SAMPLE;
+    return sizeof(RankSelectBitVector) + sizeof(uint64_t) * 2 * (n_super + 1) +
+      sizeof(size_t) * (n_samples1 + n_samples0 + 2);
+}
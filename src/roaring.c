@@ -0,0 +1,588 @@
+/**
+ * @file
+ * @brief Compressed bitmap of 32 bit integers with Roaring containers
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "roaring.h"
+#include "bitops.h"
+#include "cpu.h"
+
+#ifdef BITTER_X86
+#include <immintrin.h>
+#endif
+
+// Values of a chunk
+#define CHUNK 65536u
+
+// Set operations
+typedef enum {
+  OP_AND,
+  OP_OR,
+  OP_XOR,
+  OP_ANDNOT
+} ROARING_OP;
+
+static void* roaring_alloc(size_t bytes)
+{
+    void *ptr = malloc(bytes ? bytes : 1);
+    if (ptr == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+
+// -- Words -------------------------------------------------------------------
+// Set bits [start, end) of a bitmap container
+static void words_set_range(uint64_t *words, uint32_t start, uint32_t end)
+{
+    for (uint32_t i = start / 64; i * 64 < end; ++i) {
+        uint64_t m = ~(uint64_t) 0;
+        if (i == start / 64) m &= ~(uint64_t) 0 << (start % 64);
+        if ((i + 1) * 64 > end) m &= ~(uint64_t) 0 >> (64 - end % 64);
+        words[i] |= m;
+    }
+}
+
+// First set bit at or after pos, CHUNK if none
+static uint32_t words_next(const uint64_t *words, uint32_t pos, uint64_t flip)
+{
+    if (pos >= CHUNK) return CHUNK;
+    uint32_t i = pos / 64;
+    uint64_t w = (words[i] ^ flip) & (~(uint64_t) 0 << (pos % 64));
+    while (w == 0) {
+        if (++i == ROARING_WORDS) return CHUNK;
+        w = words[i] ^ flip;
+    }
+    return i * 64 + (uint32_t) __builtin_ctzll(w);
+}
+
+#define WORDS_LOOP(EXPR)                                                      \
+    for (size_t i = 0; i < ROARING_WORDS; ++i) {                              \
+        out[i] = (EXPR);                                                      \
+        card += popcount64(out[i]);                                           \
+    }
+
+#ifdef BITTER_X86
+/*
+ * Counts with a nibble lookup (Mula, Kurz and Lemire, "Faster population
+ * counts using AVX2 instructions"), summed per 64 bit lane with sad.
+ */
+__attribute__((target("avx2")))
+static uint32_t words_op_avx2(ROARING_OP op, const uint64_t *a,
+  const uint64_t *b, uint64_t *out)
+{
+    const __m256i lookup = _mm256_setr_epi8(
+                    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4),
+                  low = _mm256_set1_epi8(0x0F),
+                  zero = _mm256_setzero_si256();
+    __m256i acc = zero;
+
+    for (size_t i = 0; i < ROARING_WORDS; i += 4) {
+        const __m256i x = _mm256_loadu_si256((const __m256i *) (a + i)),
+                      y = _mm256_loadu_si256((const __m256i *) (b + i));
+        __m256i v;
+        switch (op) {
+        case OP_AND: v = _mm256_and_si256(x, y); break;
+        case OP_OR: v = _mm256_or_si256(x, y); break;
+        case OP_XOR: v = _mm256_xor_si256(x, y); break;
+        default: v = _mm256_andnot_si256(y, x); break;
+        }
+        _mm256_storeu_si256((__m256i *) (out + i), v);
+
+        const __m256i cnt = _mm256_add_epi8(
+          _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low)),
+          _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, zero));
+    }
+
+    uint64_t sums[4];
+    _mm256_storeu_si256((__m256i *) sums, acc);
+    return (uint32_t) (sums[0] + sums[1] + sums[2] + sums[3]);
+}
+#endif
+
+// Combine two bitmap containers, returning the cardinality of the result
+static uint32_t words_op(ROARING_OP op, const uint64_t *a, const uint64_t *b,
+  uint64_t *out)
+{
+#ifdef BITTER_X86
+    if (cpu_features() & CPU_AVX2) return words_op_avx2(op, a, b, out);
+#endif
+    uint32_t card = 0;
+    switch (op) {
+    case OP_AND: WORDS_LOOP(a[i] & b[i]) break;
+    case OP_OR: WORDS_LOOP(a[i] | b[i]) break;
+    case OP_XOR: WORDS_LOOP(a[i] ^ b[i]) break;
+    default: WORDS_LOOP(a[i] & ~b[i]) break;
+    }
+    return card;
+}
+
+
+// -- Containers --------------------------------------------------------------
+static void container_clear(RoaringContainer *c)
+{
+    free(c->values);
+    free(c->words);
+    c->values = NULL;
+    c->words = NULL;
+    c->n = c->capacity = c->cardinality = 0;
+    c->type = ROARING_ARRAY;
+}
+
+// Room for n entries in values
+static void container_reserve(RoaringContainer *c, uint32_t n)
+{
+    if (n <= c->capacity) return;
+    uint32_t capacity = c->capacity ? c->capacity : 4;
+    while (capacity < n) capacity *= 2;
+    uint16_t *values = realloc(c->values, sizeof(uint16_t) * capacity);
+    if (values == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    c->values = values;
+    c->capacity = capacity;
+}
+
+// First index of a sorted array whose value is not below x, branch free
+static uint32_t array_lower(const uint16_t *values, uint32_t n, uint16_t x)
+{
+    if (n == 0) return 0;
+    const uint16_t *base = values;
+    while (n > 1) {
+        const uint32_t half = n / 2;
+        base = base[half] < x ? base + half : base;
+        n -= half;
+    }
+    return (uint32_t) (base - values) + (*base < x);
+}
+
+static int container_contains(const RoaringContainer *c, uint16_t x)
+{
+    switch (c->type) {
+    case ROARING_BITMAP:
+        return (int) (c->words[x / 64] >> (x % 64) & 1);
+    case ROARING_RUN: {
+        // Last run starting at or before x
+        uint32_t lo = 0, hi = c->n;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (c->values[2*mid] <= x) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo > 0 && x - c->values[2*(lo-1)] <= c->values[2*(lo-1) + 1];
+    }
+    default: {
+        uint32_t i = array_lower(c->values, c->n, x);
+        return i < c->n && c->values[i] == x;
+    }
+    }
+}
+
+// Bits of any container, in scratch unless it is a bitmap already
+static const uint64_t* container_bits(const RoaringContainer *c, uint64_t *scratch)
+{
+    if (c->type == ROARING_BITMAP) return c->words;
+    memset(scratch, 0, sizeof(uint64_t) * ROARING_WORDS);
+    if (c->type == ROARING_RUN) {
+        for (uint32_t j = 0; j < c->n; ++j) {
+            words_set_range(scratch, c->values[2*j],
+              (uint32_t) c->values[2*j] + c->values[2*j + 1] + 1);
+        }
+    } else {
+        for (uint32_t j = 0; j < c->n; ++j) {
+            scratch[c->values[j] / 64] |= (uint64_t) 1 << (c->values[j] % 64);
+        }
+    }
+    return scratch;
+}
+
+// Fill an empty container from bits, as an array when card is small enough
+static void container_from_words(RoaringContainer *c, const uint64_t *words,
+  uint32_t card)
+{
+    c->cardinality = card;
+    if (card > ROARING_ARRAY_MAX) {
+        c->type = ROARING_BITMAP;
+        c->words = roaring_alloc(sizeof(uint64_t) * ROARING_WORDS);
+        memcpy(c->words, words, sizeof(uint64_t) * ROARING_WORDS);
+        return;
+    }
+    c->type = ROARING_ARRAY;
+    container_reserve(c, card);
+    for (uint32_t i = 0; i < ROARING_WORDS; ++i) {
+        for (uint64_t w = words[i]; w; w &= w - 1) {
+            c->values[c->n++] = (uint16_t) (i * 64 + (uint32_t) __builtin_ctzll(w));
+        }
+    }
+}
+
+// Fill an empty container from sorted values
+static void container_from_values(RoaringContainer *c, const uint16_t *values,
+  uint32_t n)
+{
+    if (n > ROARING_ARRAY_MAX) {
+        uint64_t words[ROARING_WORDS] = {0};
+        for (uint32_t j = 0; j < n; ++j) words[values[j] / 64] |= (uint64_t) 1 << (values[j] % 64);
+        container_from_words(c, words, n);
+        return;
+    }
+    c->type = ROARING_ARRAY;
+    c->cardinality = n;
+    container_reserve(c, n);
+    // values stays NULL when nothing was reserved
+    if (n) memcpy(c->values, values, sizeof(uint16_t) * n);
+    c->n = n;
+}
+
+// Re-encode a container from its bits, dropping run encoding
+static void container_rebuild(RoaringContainer *c, int as_bitmap)
+{
+    uint64_t scratch[ROARING_WORDS];
+    const uint32_t card = c->cardinality;
+    memcpy(scratch, container_bits(c, scratch), sizeof(scratch));
+    container_clear(c);
+    if (as_bitmap) {
+        c->type = ROARING_BITMAP;
+        c->cardinality = card;
+        c->words = roaring_alloc(sizeof(scratch));
+        memcpy(c->words, scratch, sizeof(scratch));
+    } else {
+        container_from_words(c, scratch, card);
+    }
+}
+
+static void container_add(RoaringContainer *c, uint16_t x)
+{
+    if (c->type == ROARING_BITMAP) {
+        uint64_t *w = &c->words[x / 64], bit = (uint64_t) 1 << (x % 64);
+        c->cardinality += !(*w & bit);
+        *w |= bit;
+        return;
+    }
+    if (c->type == ROARING_RUN) {
+        if (container_contains(c, x)) return;
+        container_rebuild(c, c->cardinality >= ROARING_ARRAY_MAX);
+        container_add(c, x);
+        return;
+    }
+
+    const uint32_t i = array_lower(c->values, c->n, x);
+    if (i < c->n && c->values[i] == x) return;
+    if (c->n == ROARING_ARRAY_MAX) {
+        container_rebuild(c, 1);
+        container_add(c, x);
+        return;
+    }
+    container_reserve(c, c->n + 1);
+    memmove(c->values + i + 1, c->values + i, sizeof(uint16_t) * (c->n - i));
+    c->values[i] = x;
+    c->n++;
+    c->cardinality++;
+}
+
+static void container_copy(RoaringContainer *dst, const RoaringContainer *src)
+{
+    *dst = *src;
+    if (src->words) {
+        dst->words = roaring_alloc(sizeof(uint64_t) * ROARING_WORDS);
+        memcpy(dst->words, src->words, sizeof(uint64_t) * ROARING_WORDS);
+    }
+    if (src->values) {
+        const uint32_t entries = src->type == ROARING_RUN ? 2 * src->n : src->n;
+        dst->values = roaring_alloc(sizeof(uint16_t) * entries);
+        memcpy(dst->values, src->values, sizeof(uint16_t) * entries);
+        dst->capacity = entries;
+    }
+}
+
+// Merge two array containers
+static void container_merge(ROARING_OP op, const RoaringContainer *a,
+  const RoaringContainer *b, RoaringContainer *out)
+{
+    uint16_t merged[2 * ROARING_ARRAY_MAX];
+    uint32_t i = 0, j = 0, n = 0;
+    const int keep_a = op != OP_AND, keep_b = op == OP_OR || op == OP_XOR,
+              keep_both = op == OP_AND || op == OP_OR;
+
+    while (i < a->n && j < b->n) {
+        if (a->values[i] < b->values[j]) {
+            if (keep_a) merged[n++] = a->values[i];
+            i++;
+        } else if (b->values[j] < a->values[i]) {
+            if (keep_b) merged[n++] = b->values[j];
+            j++;
+        } else {
+            if (keep_both) merged[n++] = a->values[i];
+            i++;
+            j++;
+        }
+    }
+    for (; keep_a && i < a->n; ++i) merged[n++] = a->values[i];
+    for (; keep_b && j < b->n; ++j) merged[n++] = b->values[j];
+    container_from_values(out, merged, n);
+}
+
+// Values of array a kept or dropped by their presence in c
+static void container_filter(const RoaringContainer *a,
+  const RoaringContainer *c, int present, RoaringContainer *out)
+{
+    uint16_t kept[ROARING_ARRAY_MAX];
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < a->n; ++i) {
+        if (container_contains(c, a->values[i]) == present) kept[n++] = a->values[i];
+    }
+    container_from_values(out, kept, n);
+}
+
+// out is empty with its key set
+static void container_op(ROARING_OP op, const RoaringContainer *a,
+  const RoaringContainer *b, RoaringContainer *out)
+{
+    if (a->type == ROARING_ARRAY && b->type == ROARING_ARRAY) {
+        container_merge(op, a, b, out);
+    } else if (a->type == ROARING_ARRAY && (op == OP_AND || op == OP_ANDNOT)) {
+        container_filter(a, b, op == OP_AND, out);
+    } else if (b->type == ROARING_ARRAY && op == OP_AND) {
+        container_filter(b, a, 1, out);
+    } else {
+        uint64_t sa[ROARING_WORDS], sb[ROARING_WORDS], res[ROARING_WORDS];
+        const uint32_t card = words_op(op, container_bits(a, sa), container_bits(b, sb), res);
+        container_from_words(out, res, card);
+    }
+}
+
+// Runs of consecutive values in a container
+static uint32_t container_runs(const RoaringContainer *c)
+{
+    uint32_t runs = 0;
+    switch (c->type) {
+    case ROARING_RUN:
+        return c->n;
+    case ROARING_BITMAP: {
+        uint64_t carry = 0;
+        // A run starts on every set bit whose predecessor is clear
+        for (uint32_t i = 0; i < ROARING_WORDS; ++i) {
+            runs += popcount64(c->words[i] & ~(c->words[i] << 1 | carry));
+            carry = c->words[i] >> 63;
+        }
+        return runs;
+    }
+    default:
+        for (uint32_t i = 0; i < c->n; ++i) {
+            runs += i == 0 || c->values[i] != c->values[i-1] + 1;
+        }
+        return runs;
+    }
+}
+
+static void container_to_runs(RoaringContainer *c, uint32_t runs)
+{
+    uint64_t scratch[ROARING_WORDS];
+    const uint32_t card = c->cardinality;
+    memcpy(scratch, container_bits(c, scratch), sizeof(scratch));
+    container_clear(c);
+
+    c->type = ROARING_RUN;
+    c->cardinality = card;
+    container_reserve(c, 2 * runs);
+    for (uint32_t pos = words_next(scratch, 0, 0); pos < CHUNK;
+         pos = words_next(scratch, pos, 0)) {
+        const uint32_t end = words_next(scratch, pos, ~(uint64_t) 0);
+        c->values[2 * c->n] = (uint16_t) pos;
+        c->values[2 * c->n + 1] = (uint16_t) (end - pos - 1);
+        c->n++;
+        pos = end;
+    }
+}
+
+
+// -- Bitmap ------------------------------------------------------------------
+// New empty container for key at index i
+static RoaringContainer* roaring_insert(RoaringBitmap *r, size_t i, uint16_t key)
+{
+    if (r->n == r->capacity) {
+        size_t capacity = r->capacity ? r->capacity * 2 : 4;
+        RoaringContainer *containers = realloc(r->containers, sizeof(RoaringContainer) * capacity);
+        if (containers == NULL) {
+            printf("Couldn't allocate memory for vector.\n");
+            exit(EXIT_FAILURE);
+        }
+        r->containers = containers;
+        r->capacity = capacity;
+    }
+    memmove(r->containers + i + 1, r->containers + i, sizeof(RoaringContainer) * (r->n - i));
+    r->n++;
+
+    RoaringContainer *c = &r->containers[i];
+    memset(c, 0, sizeof(RoaringContainer));
+    c->key = key;
+    c->type = ROARING_ARRAY;
+    return c;
+}
+
+// First container whose key is not below key
+static size_t roaring_lower(const RoaringBitmap *r, uint16_t key)
+{
+    if (r->n == 0) return 0;
+    const RoaringContainer *base = r->containers;
+    for (size_t n = r->n; n > 1; ) {
+        const size_t half = n / 2;
+        base = base[half].key < key ? base + half : base;
+        n -= half;
+    }
+    return (size_t) (base - r->containers) + (base->key < key);
+}
+
+RoaringBitmap* RoaringBitmap_init(void)
+{
+    RoaringBitmap *r = roaring_alloc(sizeof(RoaringBitmap));
+    r->n = 0;
+    r->capacity = 0;
+    r->containers = NULL;
+    return r;
+}
+
+RoaringBitmap* RoaringBitmap_from_BitArray(const BitArray *bitarr)
+{
+    if (bitarr->element_size != 1) {
+        fprintf(stderr, "%s:%d Roaring bitmap needs a 1 bit BitArray\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    RoaringBitmap *r = RoaringBitmap_init();
+    uint64_t words[ROARING_WORDS];
+    const size_t n = bitarr->n;
+    for (size_t base = 0; base < n; base += CHUNK) {
+        uint32_t card = 0;
+        for (size_t i = 0; i < ROARING_WORDS; ++i) {
+            const size_t bit = base + i * 64;
+            uint64_t w = 0;
+            if (bit < n) {
+                w = bitarr->v[bit / 32];
+                if (bit + 32 < n) w |= (uint64_t) bitarr->v[bit / 32 + 1] << 32;
+                if (n - bit < 64) w &= ((uint64_t) 1 << (n - bit)) - 1;
+            }
+            words[i] = w;
+            card += popcount64(w);
+        }
+        if (card) {
+            container_from_words(roaring_insert(r, r->n, (uint16_t) (base / CHUNK)), words, card);
+        }
+    }
+    return r;
+}
+
+void RoaringBitmap_free(RoaringBitmap *r)
+{
+    for (size_t i = 0; i < r->n; ++i) container_clear(&r->containers[i]);
+    free(r->containers);
+    free(r);
+}
+
+void RoaringBitmap_add(RoaringBitmap *r, uint32_t x)
+{
+    const uint16_t key = (uint16_t) (x >> 16);
+    size_t i = roaring_lower(r, key);
+    RoaringContainer *c = i < r->n && r->containers[i].key == key ?
+      &r->containers[i] : roaring_insert(r, i, key);
+    container_add(c, (uint16_t) x);
+}
+
+int RoaringBitmap_contains(const RoaringBitmap *r, uint32_t x)
+{
+    const uint16_t key = (uint16_t) (x >> 16);
+    size_t i = roaring_lower(r, key);
+    return i < r->n && r->containers[i].key == key &&
+      container_contains(&r->containers[i], (uint16_t) x);
+}
+
+uint64_t RoaringBitmap_cardinality(const RoaringBitmap *r)
+{
+    uint64_t card = 0;
+    for (size_t i = 0; i < r->n; ++i) card += r->containers[i].cardinality;
+    return card;
+}
+
+/*
+ * Containers are matched by key as in a merge. A container present on one
+ * side only is copied when the operation keeps it.
+ */
+static RoaringBitmap* roaring_op(ROARING_OP op, const RoaringBitmap *a,
+  const RoaringBitmap *b)
+{
+    RoaringBitmap *r = RoaringBitmap_init();
+    size_t i = 0, j = 0;
+
+    while (i < a->n || j < b->n) {
+        const RoaringContainer *ca = i < a->n ? &a->containers[i] : NULL,
+                               *cb = j < b->n ? &b->containers[j] : NULL;
+        if (cb == NULL || (ca != NULL && ca->key < cb->key)) {
+            if (op != OP_AND) container_copy(roaring_insert(r, r->n, ca->key), ca);
+            i++;
+        } else if (ca == NULL || cb->key < ca->key) {
+            if (op == OP_OR || op == OP_XOR) container_copy(roaring_insert(r, r->n, cb->key), cb);
+            j++;
+        } else {
+            RoaringContainer *c = roaring_insert(r, r->n, ca->key);
+            container_op(op, ca, cb, c);
+            if (c->cardinality == 0) {
+                container_clear(c);
+                r->n--;
+            }
+            i++;
+            j++;
+        }
+    }
+    return r;
+}
+
+RoaringBitmap* RoaringBitmap_and(const RoaringBitmap *a, const RoaringBitmap *b)
+{
+    return roaring_op(OP_AND, a, b);
+}
+
+RoaringBitmap* RoaringBitmap_or(const RoaringBitmap *a, const RoaringBitmap *b)
+{
+    return roaring_op(OP_OR, a, b);
+}
+
+RoaringBitmap* RoaringBitmap_xor(const RoaringBitmap *a, const RoaringBitmap *b)
+{
+    return roaring_op(OP_XOR, a, b);
+}
+
+RoaringBitmap* RoaringBitmap_andnot(const RoaringBitmap *a, const RoaringBitmap *b)
+{
+    return roaring_op(OP_ANDNOT, a, b);
+}
+
+void RoaringBitmap_optimize(RoaringBitmap *r)
+{
+    for (size_t i = 0; i < r->n; ++i) {
+        RoaringContainer *c = &r->containers[i];
+        if (c->type == ROARING_RUN) continue;
+        const uint32_t runs = container_runs(c);
+        const size_t bytes = c->type == ROARING_BITMAP ?
+          sizeof(uint64_t) * ROARING_WORDS : sizeof(uint16_t) * c->cardinality;
+        if (sizeof(uint16_t) * 2 * runs < bytes) container_to_runs(c, runs);
+    }
+}
+
+size_t RoaringBitmap_size(const RoaringBitmap *r)
+{
+    size_t bytes = sizeof(RoaringBitmap) + sizeof(RoaringContainer) * r->capacity;
+    for (size_t i = 0; i < r->n; ++i) {
+        const RoaringContainer *c = &r->containers[i];
+        bytes += sizeof(uint16_t) * c->capacity;
+        if (c->words) bytes += sizeof(uint64_t) * ROARING_WORDS;
+    }
+    return bytes;
+}
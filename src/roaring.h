@@ -0,0 +1,178 @@
+/**
+ * @file
+ * @brief Compressed bitmap of 32 bit integers with Roaring containers
+ *
+ * Chambi, Lemire, Kaser and Godin, "Better bitmap performance with Roaring
+ * bitmaps". The key space is cut into chunks of 2^16 values sharing their
+ * high 16 bits. Each chunk holding at least one value gets a container for
+ * its low 16 bits, kept sorted by chunk:
+ *
+ *  - array containers list up to ROARING_ARRAY_MAX sorted values, 2 bytes
+ *    per value.
+ *  - bitmap containers hold the 2^16 bits of the chunk in ROARING_WORDS 64
+ *    bit words, 8 KiB whatever the number of values.
+ *  - run containers list (start, length - 1) pairs of consecutive values,
+ *    4 bytes per run. They are only made by RoaringBitmap_optimize.
+ *
+ * An array container turns into a bitmap once it outgrows ROARING_ARRAY_MAX,
+ * where both take the same space, and set operations give back arrays when
+ * their result is small enough. Operations on two bitmap containers (or a
+ * run container, expanded to a bitmap) combine whole words and count the
+ * result with AVX2 when the CPU supports it.
+ */
+
+#ifndef ROARING_H_
+#define ROARING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bitarr.h"
+
+// Largest array container
+#define ROARING_ARRAY_MAX 4096
+// Words of a bitmap container
+#define ROARING_WORDS 1024
+
+typedef enum {
+  ROARING_ARRAY,
+  ROARING_BITMAP,
+  ROARING_RUN
+} ROARING_TYPE;
+
+/**
+ * @struct RoaringContainer
+ *
+ * @var RoaringContainer.key
+ *  High 16 bits shared by the values
+ * @var RoaringContainer.type
+ *  ROARING_TYPE of the container
+ * @var RoaringContainer.cardinality
+ *  Number of values, at most 2^16
+ * @var RoaringContainer.n
+ *  Values of an array container, runs of a run container
+ * @var RoaringContainer.capacity
+ *  Entries allocated in values
+ * @var RoaringContainer.values
+ *  Sorted values of an array container, or start and length - 1 of every
+ *  run of a run container
+ * @var RoaringContainer.words
+ *  Bits of a bitmap container
+ */
+typedef struct {
+  uint16_t key;
+  uint8_t type;
+  uint32_t cardinality;
+  uint32_t n;
+  uint32_t capacity;
+  uint16_t *values;
+  uint64_t *words;
+} RoaringContainer;
+
+/**
+ * @struct RoaringBitmap
+ *
+ * @var RoaringBitmap.n
+ *  Number of containers
+ * @var RoaringBitmap.capacity
+ *  Containers allocated
+ * @var RoaringBitmap.containers
+ *  Containers sorted by key
+ */
+typedef struct {
+  size_t n;
+  size_t capacity;
+  RoaringContainer *containers;
+} RoaringBitmap;
+
+
+/**
+ * @brief Create an empty bitmap
+ *
+ * @return  Pointer to RoaringBitmap
+ */
+RoaringBitmap* RoaringBitmap_init(void);
+
+/**
+ * @brief Bitmap of the set positions of a 1 bit BitArray
+ *
+ * Chunks are converted 2^16 bits at a time, straight from the words.
+ *
+ * @param bitarr    BitArray with element_size 1
+ * @return          Pointer to RoaringBitmap
+ */
+RoaringBitmap* RoaringBitmap_from_BitArray(const BitArray *bitarr);
+
+/**
+ * @brief Free the bitmap and its containers
+ *
+ * @param r
+ */
+void RoaringBitmap_free(RoaringBitmap *r);
+
+/**
+ * @brief Add x to the set
+ *
+ * @param r
+ * @param x
+ */
+void RoaringBitmap_add(RoaringBitmap *r, uint32_t x);
+
+/**
+ * @brief Whether x is in the set
+ *
+ * @param r
+ * @param x
+ * @return  1 if it is, 0 otherwise
+ */
+int RoaringBitmap_contains(const RoaringBitmap *r, uint32_t x);
+
+/**
+ * @brief Number of values in the set
+ *
+ * @param r
+ */
+uint64_t RoaringBitmap_cardinality(const RoaringBitmap *r);
+
+/**
+ * @brief Values in both a and b
+ *
+ * @return  New bitmap, a and b are left alone
+ */
+RoaringBitmap* RoaringBitmap_and(const RoaringBitmap *a, const RoaringBitmap *b);
+
+/**
+ * @brief Values in a or b
+ *
+ * @return  New bitmap, a and b are left alone
+ */
+RoaringBitmap* RoaringBitmap_or(const RoaringBitmap *a, const RoaringBitmap *b);
+
+/**
+ * @brief Values in exactly one of a and b
+ *
+ * @return  New bitmap, a and b are left alone
+ */
+RoaringBitmap* RoaringBitmap_xor(const RoaringBitmap *a, const RoaringBitmap *b);
+
+/**
+ * @brief Values in a but not in b
+ *
+ * @return  New bitmap, a and b are left alone
+ */
+RoaringBitmap* RoaringBitmap_andnot(const RoaringBitmap *a, const RoaringBitmap *b);
+
+/**
+ * @brief Turn containers into run containers where that is smaller
+ *
+ * @param r
+ */
+void RoaringBitmap_optimize(RoaringBitmap *r);
+
+/**
+ * @brief Bytes used by the bitmap
+ *
+ * @param r
+ */
+size_t RoaringBitmap_size(const RoaringBitmap *r);
+
+#endif // !ROARING_H_
@@ -0,0 +1,213 @@
+/**
+ * @file
+ * @brief Wavelet matrix over a sequence of fixed width symbols
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "wavelet_matrix.h"
+
+WaveletMatrix* WaveletMatrix_init(const uint32_t A[], uint32_t n,
+  uint8_t element_size)
+{
+    if (element_size < 1 || element_size > 32) {
+        fprintf(stderr, "%s:%d Element size out of range\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    WaveletMatrix *wm = malloc(sizeof(WaveletMatrix) + sizeof(WaveletLevel) * element_size);
+    // Symbols in the order of the current level, and of the next
+    uint32_t *cur = malloc(sizeof(uint32_t) * n + 1),
+             *next = malloc(sizeof(uint32_t) * n + 1);
+    if (wm == NULL || cur == NULL || next == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    wm->n = n;
+    wm->n_levels = element_size;
+    for (uint32_t i = 0; i < n; ++i) cur[i] = A[i];
+
+    for (uint8_t l = 0; l < element_size; ++l) {
+        const unsigned b = element_size - 1u - l;
+        BitArrayBuilder builder;
+        BitArrayBuilder_begin(&builder, n, 1, sizeof(uint32_t));
+
+        // Stable partition on bit b, zeros to the front and ones to the back
+        size_t zeros = 0;
+        for (uint32_t i = 0; i < n; ++i) zeros += !(cur[i] >> b & 1);
+        size_t z = 0, o = zeros;
+        for (uint32_t i = 0; i < n; ++i) {
+            const unsigned bit = cur[i] >> b & 1;
+            BitArrayBuilder_push(&builder, bit);
+            next[bit ? o++ : z++] = cur[i];
+        }
+
+        WaveletLevel *level = &wm->levels[l];
+        level->bits = BitArrayBuilder_finish(&builder);
+        level->rs = RankSelectBitVector_from_BitArray(level->bits);
+        level->zeros = zeros;
+
+        uint32_t *t = cur;
+        cur = next;
+        next = t;
+    }
+
+    free(cur);
+    free(next);
+    return wm;
+}
+
+WaveletMatrix* WaveletMatrix_from_BitArray(BitArray *bitarr)
+{
+    uint32_t *A = malloc(sizeof(uint32_t) * bitarr->n + 1);
+    if (A == NULL) {
+        printf("Couldn't allocate memory for vector.\n");
+        exit(EXIT_FAILURE);
+    }
+    BitArray_unpack(bitarr, 0, bitarr->n, A);
+    WaveletMatrix *wm = WaveletMatrix_init(A, bitarr->n, (uint8_t) bitarr->element_size);
+    free(A);
+    return wm;
+}
+
+void WaveletMatrix_free(WaveletMatrix *wm)
+{
+    for (uint8_t l = 0; l < wm->n_levels; ++l) {
+        RankSelectBitVector_free(wm->levels[l].rs);
+        BitArray_free(wm->levels[l].bits);
+    }
+    free(wm);
+}
+
+
+// -- Queries -----------------------------------------------------------------
+/*
+ * A position i of level l moves to rank0(i) on level l + 1 when its bit is
+ * 0, and to zeros + rank1(i) when it is 1. Ranges [s, e) of equal prefixes
+ * move the same way.
+ */
+static inline size_t wm_down(const WaveletLevel *level, size_t i, unsigned bit)
+{
+    const size_t ones = RankSelectBitVector_rank1(level->rs, i);
+    return bit ? level->zeros + ones : i - ones;
+}
+
+// Bit of c read on level l
+static inline unsigned wm_bit(const WaveletMatrix *wm, uint32_t c, uint8_t l)
+{
+    return c >> (wm->n_levels - 1u - l) & 1;
+}
+
+// c fits in n_levels bits
+static inline int wm_symbol(const WaveletMatrix *wm, uint32_t c)
+{
+    return wm->n_levels == 32 || c >> wm->n_levels == 0;
+}
+
+uint32_t WaveletMatrix_access(const WaveletMatrix *wm, size_t i)
+{
+    if (i >= wm->n) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    uint32_t c = 0;
+    for (uint8_t l = 0; l < wm->n_levels; ++l) {
+        const unsigned bit = BitArray_read_unchecked(wm->levels[l].bits, i);
+        c = c << 1 | bit;
+        i = wm_down(&wm->levels[l], i, bit);
+    }
+    return c;
+}
+
+size_t WaveletMatrix_rank(const WaveletMatrix *wm, uint32_t c, size_t i)
+{
+    if (i > wm->n) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+    if (!wm_symbol(wm, c)) return 0;
+
+    // Follow both the start of the block of c and i
+    size_t s = 0;
+    for (uint8_t l = 0; l < wm->n_levels; ++l) {
+        const unsigned bit = wm_bit(wm, c, l);
+        s = wm_down(&wm->levels[l], s, bit);
+        i = wm_down(&wm->levels[l], i, bit);
+    }
+    return i - s;
+}
+
+size_t WaveletMatrix_select(const WaveletMatrix *wm, uint32_t c, size_t k)
+{
+    if (k == 0 || WaveletMatrix_rank(wm, c, wm->n) < k) return wm->n;
+
+    // Block of c on the last level, then back up one level at a time
+    size_t pos = 0;
+    for (uint8_t l = 0; l < wm->n_levels; ++l) {
+        pos = wm_down(&wm->levels[l], pos, wm_bit(wm, c, l));
+    }
+    pos += k - 1;
+
+    for (uint8_t l = wm->n_levels; l-- > 0;) {
+        const WaveletLevel *level = &wm->levels[l];
+        if (wm_bit(wm, c, l)) pos = RankSelectBitVector_select1(level->rs, pos - level->zeros + 1);
+        else pos = RankSelectBitVector_select0(level->rs, pos + 1);
+    }
+    return pos;
+}
+
+// Symbols of S[s, e) smaller than x
+static size_t wm_count_less(const WaveletMatrix *wm, size_t s, size_t e, uint64_t x)
+{
+    if (x >> wm->n_levels) return e - s;
+
+    size_t count = 0;
+    for (uint8_t l = 0; l < wm->n_levels && s < e; ++l) {
+        const WaveletLevel *level = &wm->levels[l];
+        const unsigned bit = wm_bit(wm, (uint32_t) x, l);
+        // With a 1 in x, every symbol taking the 0 branch here is smaller
+        if (bit) count += wm_down(level, e, 0) - wm_down(level, s, 0);
+        s = wm_down(level, s, bit);
+        e = wm_down(level, e, bit);
+    }
+    return count;
+}
+
+size_t WaveletMatrix_range_count(const WaveletMatrix *wm, size_t s, size_t e,
+  uint32_t lo, uint32_t hi)
+{
+    if (s > e || e > wm->n) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+    if (lo > hi) return 0;
+    return wm_count_less(wm, s, e, (uint64_t) hi + 1) - wm_count_less(wm, s, e, lo);
+}
+
+uint32_t WaveletMatrix_range_quantile(const WaveletMatrix *wm, size_t s,
+  size_t e, size_t k)
+{
+    if (s >= e || e > wm->n || k >= e - s) {
+        fprintf(stderr, "%s:%d Out of bounds index\n", __FILE__, __LINE__);
+        exit(OUT_OF_BOUNDS);
+    }
+
+    uint32_t c = 0;
+    for (uint8_t l = 0; l < wm->n_levels; ++l) {
+        const WaveletLevel *level = &wm->levels[l];
+        const size_t s0 = wm_down(level, s, 0), e0 = wm_down(level, e, 0);
+        // The k-th smallest is among the zeros if there are more than k
+        if (k < e0 - s0) {
+            c <<= 1;
+            s = s0;
+            e = e0;
+        } else {
+            k -= e0 - s0;
+            c = c << 1 | 1;
+            s = level->zeros + (s - s0);
+            e = level->zeros + (e - e0);
+        }
+    }
+    return c;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file
+ * @brief Wavelet matrix over a sequence of fixed width symbols
+ *
+ * Claude, Navarro and Ordóñez, "The wavelet matrix". A sequence of n symbols
+ * of w bits is stored as w bit vectors of n bits, one per bit of the
+ * symbols from the most significant down. Level l holds bit w-1-l of every
+ * symbol, after the symbols were stably sorted by their previous bit: the
+ * zeros of level l - 1 first, then its ones. Each level carries a rank/select
+ * index and the number of zeros it contains, which is where its ones
+ * continue on the next level.
+ *
+ * Every query walks the w levels once, so it costs O(w) = O(log sigma) rank
+ * or select operations and never decodes the sequence:
+ *
+ *   access(i)                   symbol at i
+ *   rank(c, i)                  occurrences of c in S[0, i)
+ *   select(c, k)                position of the k-th c, 1 <= k
+ *   range_count(s, e, lo, hi)   symbols of S[s, e) with lo <= c <= hi
+ *   range_quantile(s, e, k)     k-th smallest symbol of S[s, e), from 0
+ */
+
+#ifndef WAVELET_MATRIX_H_
+#define WAVELET_MATRIX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bitarr.h"
+#include "rank_select.h"
+
+/**
+ * @struct WaveletLevel
+ *
+ * @var WaveletLevel.bits
+ *  One bit of every symbol, in the order of the level
+ * @var WaveletLevel.rs
+ *  Rank/select index over bits
+ * @var WaveletLevel.zeros
+ *  Number of zeros in bits
+ */
+typedef struct {
+  BitArray *bits;
+  RankSelectBitVector *rs;
+  size_t zeros;
+} WaveletLevel;
+
+/**
+ * @struct WaveletMatrix
+ *
+ * @var WaveletMatrix.n
+ *  Number of symbols
+ * @var WaveletMatrix.n_levels
+ *  Bits per symbol
+ * @var WaveletMatrix.levels
+ *  Levels, most significant bit first
+ */
+typedef struct {
+  size_t n;
+  uint8_t n_levels;
+  WaveletLevel levels[];
+} WaveletMatrix;
+
+
+/**
+ * @brief Build a wavelet matrix over n symbols of element_size bits
+ *
+ * Each level is built in linear time by a stable partition of the symbols.
+ *
+ * @param A             Symbols, bits above element_size are ignored
+ * @param n             Length of A
+ * @param element_size  Bits per symbol (1-32)
+ * @return              Pointer to WaveletMatrix
+ */
+WaveletMatrix* WaveletMatrix_init(const uint32_t A[], uint32_t n,
+  uint8_t element_size);
+
+/**
+ * @brief Build a wavelet matrix over the values of a BitArray
+ *
+ * @param bitarr    Symbols, one per element
+ * @return          Pointer to WaveletMatrix
+ */
+WaveletMatrix* WaveletMatrix_from_BitArray(BitArray *bitarr);
+
+/**
+ * @brief Free the matrix and its levels
+ *
+ * @param wm
+ */
+void WaveletMatrix_free(WaveletMatrix *wm);
+
+/**
+ * @brief Symbol at index i
+ *
+ * @param wm
+ * @param i     0 <= i < n
+ */
+uint32_t WaveletMatrix_access(const WaveletMatrix *wm, size_t i);
+
+/**
+ * @brief Occurrences of c in S[0, i)
+ *
+ * @param wm
+ * @param c     Symbol
+ * @param i     0 <= i <= n
+ */
+size_t WaveletMatrix_rank(const WaveletMatrix *wm, uint32_t c, size_t i);
+
+/**
+ * @brief Position of the k-th occurrence of c
+ *
+ * @param wm
+ * @param c     Symbol
+ * @param k     1 <= k
+ * @return      Position, n when c occurs fewer than k times
+ */
+size_t WaveletMatrix_select(const WaveletMatrix *wm, uint32_t c, size_t k);
+
+/**
+ * @brief Number of symbols c of S[s, e) with lo <= c <= hi
+ *
+ * @param wm
+ * @param s     Start of the range
+ * @param e     End of the range, exclusive, s <= e <= n
+ * @param lo    Smallest symbol counted
+ * @param hi    Largest symbol counted
+ */
+size_t WaveletMatrix_range_count(const WaveletMatrix *wm, size_t s, size_t e,
+  uint32_t lo, uint32_t hi);
+
+/**
+ * @brief k-th smallest symbol of S[s, e)
+ *
+ * k = 0 gives the minimum, k = (e - s) / 2 the median.
+ *
+ * @param wm
+ * @param s     Start of the range
+ * @param e     End of the range, exclusive, s < e <= n
+ * @param k     0 <= k < e - s
+ */
+uint32_t WaveletMatrix_range_quantile(const WaveletMatrix *wm, size_t s,
+  size_t e, size_t k);
+
+#endif // !WAVELET_MATRIX_H_
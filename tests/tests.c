@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include "tests.h"
 #include "assert.h"
 #include <stdint.h>
@@ -7,6 +8,127 @@
 #include "../src/bitarr_io.h"
 #include "../src/encoding.h"
 #include "../src/bitarr_vl.h"
+#include "../src/bitarr64.h"
+#include "../src/bitpack.h"
+#include "../src/crc32c.h"
+#include "../src/rank_select.h"
+#include "../src/dac.h"
+#include "../src/elias_fano.h"
+#include "../src/pfor.h"
+#include "../src/wavelet_matrix.h"
+#include "../src/roaring.h"
+#include "../src/parallel.h"
+#include "../src/bitarr_static.h"
+#include "../src/bitarr_scan.h"
+#include "../src/bitarr_logic.h"
+#include "../src/bitarr_gather.h"
+#include "../src/bitarr_dyn.h"
+#include "../src/alloc.h"
+#include "../src/cpu.h"
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+// Deterministic pseudo random values for larger tests
+static uint32_t lcg_next(uint64_t *state)
+{
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t) (*state >> 32);
+}
+
+BITARR_DEFINE(u1, 1)
+BITARR_DEFINE(u3, 3)
+BITARR_DEFINE(u5, 5)
+BITARR_DEFINE(u12, 12)
+BITARR_DEFINE(u32, 32)
+
+// Runs fn in a child process, true when the child exits with code
+static int exits_with(void (*fn)(void), int code)
+{
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0) {
+        freopen("/dev/null", "w", stderr);
+        fn();
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == code;
+}
+
+// Concurrent updates of one BitArray, see "Atomic writes"
+typedef struct {
+    BitArray *arr;
+    size_t n_tasks;
+    size_t rounds;
+} AtomicJob;
+
+// Every task adds task + 1 to every element, rounds times
+static void atomic_add_task(void *ctx, size_t task)
+{
+    AtomicJob *job = ctx;
+    for (size_t r = 0; r < job->rounds; ++r) {
+        for (size_t i = 0; i < job->arr->n; ++i) {
+            BitArray_fetch_add_atomic(job->arr, i, (unsigned int) task + 1);
+        }
+    }
+}
+
+// Task t owns the indexes equal to t modulo n_tasks, so neighbours differ
+static void atomic_write_task(void *ctx, size_t task)
+{
+    AtomicJob *job = ctx;
+    for (size_t r = 0; r < job->rounds; ++r) {
+        for (size_t i = task; i < job->arr->n; i += job->n_tasks) {
+            BitArray_write_atomic(job->arr, i, (unsigned int) (i * 2654435761u + r));
+        }
+    }
+}
+
+// A large value early on, see "Elias-Fano"
+static void elias_fano_unsorted(void)
+{
+    const uint32_t A[] = { 0, 1000000, 6 };
+    EliasFano_init(A, 3);
+}
+
+// Written by "Memory map from disk" with the payload over the header
+static const char bit_arr_corrupt_fp[] = "./data/bitarr_corrupt_v2.bit";
+
+static void bit_arr_mmap_corrupt(void)
+{
+    BitArray_mmap(bit_arr_corrupt_fp);
+}
+
+// Old values returned by fetch_add on one element, see "Atomic writes"
+typedef struct {
+  BitArray *arr;
+  size_t i;
+  size_t rounds;
+  uint32_t *seen;
+} FetchAddJob;
+
+// Task t adds 1 to element i rounds times, neighbours are updated too
+static void fetch_add_task(void *ctx, size_t task)
+{
+    FetchAddJob *job = ctx;
+    for (size_t r = 0; r < job->rounds; ++r) {
+        job->seen[task * job->rounds + r] = BitArray_fetch_add_atomic(job->arr, job->i, 1);
+        BitArray_fetch_add_atomic(job->arr, r % 2 ? job->i + 1 : job->i - 1, 1);
+    }
+}
+
+// Every value below n is in r exactly when ref has it, see "Roaring bitmap"
+static void roaring_check(const RoaringBitmap *r, const uint8_t *ref, uint32_t n)
+{
+    uint64_t card = 0;
+    for (uint32_t x = 0; x < n; ++x) {
+        assert(RoaringBitmap_contains(r, x) == ref[x]);
+        card += ref[x];
+    }
+    assert(RoaringBitmap_cardinality(r) == card);
+}
 
 
 
@@ -33,7 +155,11 @@ unsigned int B_sig_ordered[64] = {
 unsigned int correct_W[2] = { 3943389780, 177586} ;
 BitArray* bit_arr = BitArray_init(A, (sizeof(A)/sizeof(A[0])), 5, sizeof(uint32_t));
 
+// Version 1 file kept as a fixture, version 2 file written by the tests
 static char bit_arr_fp[] = "./data/bitarr_test.bit";
+static char bit_arr_v2_fp[] = "./data/bitarr_test_v2.bit";
+static char bit_arr_stream_fp[] = "./data/bitarr_stream_v2.bit";
+static char vl_arr_v2_fp[] = "./data/vl_test_v2.bit";
 
 // ----------------------------------------------------------------------------
 
@@ -113,7 +239,7 @@ TEST("bits read range")
 
 TEST("Write to disk")
 {
-    FILE *fp = fopen(bit_arr_fp, "wb");
+    FILE *fp = fopen(bit_arr_v2_fp, "wb");
     BitArray_save(bit_arr, fp);
     fclose(fp);
     printf("✔ BitArray disk write\n");
@@ -121,22 +247,895 @@ TEST("Write to disk")
 
 TEST("Read from disk")
 {
-    FILE *fp = fopen(bit_arr_fp, "rb");
-    BitArray* bit_arr_read = BitArray_open(fp);
-    fclose(fp);
+    const char *paths[] = { bit_arr_fp, bit_arr_v2_fp };
 
-    unsigned int num;
-    for (unsigned int i = 0; i < 10; ++i) {
-        num = BitArray_read(bit_arr_read, i);
-        assert((unsigned) num == A[i]);
-    }
+    for (size_t p = 0; p < 2; ++p) {
+        FILE *fp = fopen(paths[p], "rb");
+        BitArray* bit_arr_read = BitArray_open(fp);
+        fclose(fp);
 
-    BitArray_free(bit_arr_read);
+        unsigned int num;
+        for (unsigned int i = 0; i < 10; ++i) {
+            num = BitArray_read(bit_arr_read, i);
+            assert((unsigned) num == A[i]);
+        }
+
+        BitArray_free(bit_arr_read);
+    }
     printf("✔ BitArray disk read\n");
 }
 
+TEST("Memory map from disk")
+{
+    const char *paths[] = { bit_arr_fp, bit_arr_v2_fp };
+
+    for (size_t p = 0; p < 2; ++p) {
+        BitArray* bit_arr_map = BitArray_mmap(paths[p]);
+
+        assert(bit_arr_map->n == 10);
+        assert((uintptr_t) bit_arr_map->v % 64 == 0 || p == 0);
+        for (unsigned int i = 0; i < 10; ++i) {
+            assert(BitArray_read(bit_arr_map, i) == A[i]);
+        }
+        for (size_t i = 0; i < 2; ++i) assert(bit_arr_map->v[i] == correct_W[i]);
+
+        BitArray_munmap(bit_arr_map);
+    }
+
+    // Payload offset inside the header, no checksums to catch it
+    FILE *fp = fopen(bit_arr_v2_fp, "rb");
+    BitFileHeader header;
+    unsigned char rest[64];
+    assert(fread(&header, sizeof(header), 1, fp) == 1);
+    const size_t rest_len = fread(rest, 1, sizeof(rest), fp);
+    fclose(fp);
+    header.payload_offset = 0;
+    header.block_size = 0;
+    fp = fopen(bit_arr_corrupt_fp, "wb");
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(rest, 1, rest_len, fp);
+    fclose(fp);
+    assert(exits_with(bit_arr_mmap_corrupt, FILE_ERROR));
+    remove(bit_arr_corrupt_fp);
+
+    printf("✔ BitArray memory map\n");
+}
+
 BitArray_free(bit_arr);
 
+TEST("CRC32C")
+{
+    const char check[] = "123456789";
+    const unsigned int simd[] = { ~0u, 0 };
+
+    for (size_t s = 0; s < 2; ++s) {
+        cpu_restrict(simd[s]);
+        assert(crc32c(0, check, 9) == 0xE3069283u);
+        // Extending in pieces gives the same checksum
+        assert(crc32c(crc32c(0, check, 4), check + 4, 5) == 0xE3069283u);
+    }
+    cpu_restrict(~0u);
+    printf("✔ CRC32C\n");
+}
+
+TEST("Streaming writer")
+{
+    const uint32_t n = 100000;
+    const uint8_t w = 13;
+    uint32_t *in = malloc(sizeof(uint32_t) * n);
+    uint64_t seed = 3;
+    for (uint32_t i = 0; i < n; ++i) in[i] = lcg_next(&seed) & 0x1FFF;
+
+    // Odd chunk sizes so groups straddle checksum blocks
+    FILE *fp = fopen(bit_arr_stream_fp, "wb");
+    BitArrayWriter writer;
+    BitArrayWriter_begin(&writer, fp, n, w);
+    for (uint32_t i = 0; i < n; i += 777) {
+        BitArrayWriter_push_many(&writer, in + i, n - i < 777 ? n - i : 777);
+    }
+    BitArrayWriter_finish(&writer);
+    fclose(fp);
+
+    BitArray *ref = BitArray_init(in, n, w, sizeof(uint32_t));
+    fp = fopen(bit_arr_stream_fp, "rb");
+    BitArray *read = BitArray_open(fp);
+    fclose(fp);
+    BitArray *mapped = BitArray_mmap(bit_arr_stream_fp);
+
+    assert(read->n == n && mapped->n == n);
+    assert(memcmp(read->v, ref->v, BitArray_n_words(ref) * sizeof(uint32_t)) == 0);
+    assert(memcmp(mapped->v, ref->v, BitArray_n_words(ref) * sizeof(uint32_t)) == 0);
+    assert(BitArray_mmap_verify(mapped) == BITARR_SUCCESS);
+    BitArray_munmap(mapped);
+
+    // Flip one payload bit in the last block
+    fp = fopen(bit_arr_stream_fp, "r+b");
+    fseek(fp, (long) (sizeof(BitFileHeader) + 2 * BIT_FILE_BLOCK + 5), SEEK_SET);
+    int c = fgetc(fp);
+    fseek(fp, -1, SEEK_CUR);
+    fputc(c ^ 0x10, fp);
+    fclose(fp);
+    mapped = BitArray_mmap(bit_arr_stream_fp);
+    assert(BitArray_mmap_verify(mapped) == CHECKSUM_ERROR);
+    BitArray_munmap(mapped);
+
+    BitArray_free(ref);
+    BitArray_free(read);
+    free(in);
+    printf("✔ BitArray streaming writer\n");
+}
+
+TEST("BitArray unpack & pack")
+{
+    const size_t n = 1000;
+    // (start, count) pairs covering head, block and tail paths
+    const size_t ranges[][2] = {
+        {0, 1000}, {0, 32}, {3, 500}, {8, 17}, {31, 66}, {64, 936}, {999, 1}
+    };
+    const unsigned int simd[] = { ~0u, 0 };
+    uint32_t in[1000], out[1000];
+    uint64_t seed = 42;
+
+    for (size_t s = 0; s < sizeof(simd)/sizeof(simd[0]); ++s) {
+        cpu_restrict(simd[s]);
+        for (uint8_t w = 1; w <= 32; ++w) {
+            BitArray *ref = BitArray_calloc((uint32_t) n, w, sizeof(uint32_t));
+            BitArray *packed = BitArray_calloc((uint32_t) n, w, sizeof(uint32_t));
+            uint32_t mask = 0xFFFFFFFFu >> (32 - w);
+
+            for (size_t i = 0; i < n; ++i) {
+                in[i] = lcg_next(&seed) & mask;
+                bit_write_range(ref->v, ref->width, (unsigned) (i*w),
+                  (unsigned) ((i+1)*w-1), in[i]);
+            }
+
+            for (size_t r = 0; r < sizeof(ranges)/sizeof(ranges[0]); ++r) {
+                size_t start = ranges[r][0], count = ranges[r][1];
+                BitArray_unpack(ref, start, count, out);
+                for (size_t i = 0; i < count; ++i) {
+                    assert(out[i] == bit_read_range(ref->v, ref->width,
+                      (unsigned) ((start+i)*w), (unsigned) ((start+i+1)*w-1)));
+                }
+            }
+
+            // Packing in pieces must leave neighbouring values untouched
+            BitArray_pack(packed, 31, 66, in + 31);
+            BitArray_pack(packed, 0, 31, in);
+            BitArray_pack(packed, 97, n - 97, in + 97);
+            for (size_t i = 0; i < (n*w + 31) / 32; ++i) {
+                assert(packed->v[i] == ref->v[i]);
+            }
+
+            BitArray_free(ref);
+            BitArray_free(packed);
+        }
+    }
+    cpu_restrict(~0u);
+    printf("✔ BitArray unpack/pack\n");
+}
+
+TEST("Scans")
+{
+    enum { N = 1003 };
+    const unsigned int simd[] = { ~0u, 0 };
+    static uint32_t in[N], bitmap[(N + 31) / 32];
+    uint64_t seed = 31;
+
+    for (size_t s = 0; s < sizeof(simd)/sizeof(simd[0]); ++s) {
+        cpu_restrict(simd[s]);
+        for (uint8_t w = 1; w <= 32; ++w) {
+            const uint32_t mask = 0xFFFFFFFFu >> (32 - w);
+            // Half the values small, so that equality has matches
+            for (size_t i = 0; i < N; ++i) {
+                uint32_t r = lcg_next(&seed);
+                in[i] = (i % 2 ? r % 7 : r) & mask;
+            }
+            BitArray *arr = BitArray_init(in, N, w, sizeof(uint32_t));
+
+            // Operands inside and outside of the value range
+            const uint32_t ops[][2] = {
+                {0, 0}, {3, 5}, {1, mask}, {0, mask / 2}, {mask / 3, mask},
+                {mask, mask}, {5, 3}, {mask, UINT32_MAX}
+            };
+            for (size_t q = 0; q < sizeof(ops)/sizeof(ops[0]); ++q) {
+                const uint32_t a = ops[q][0], b = ops[q][1];
+                for (int op = SCAN_EQ; op <= SCAN_BETWEEN; ++op) {
+                    size_t expected = 0;
+                    size_t matches = BitArray_filter(arr, (SCAN_OP) op, a, b, bitmap);
+                    for (size_t i = 0; i < N; ++i) {
+                        int hit = op == SCAN_EQ ? in[i] == a :
+                                  op == SCAN_LT ? in[i] < a :
+                                  a <= in[i] && in[i] <= b;
+                        expected += (size_t) hit;
+                        assert((int) (bitmap[i / 32] >> (i % 32) & 1) == hit);
+                    }
+                    assert(matches == expected);
+                    assert(BitArray_count(arr, (SCAN_OP) op, a, b) == expected);
+                    // Bits past n stay clear
+                    assert(bitmap[N / 32] >> (N % 32) == 0);
+                }
+            }
+
+            uint64_t sum = 0;
+            uint32_t mn = UINT32_MAX, mx = 0;
+            for (size_t i = 0; i < N; ++i) {
+                sum += in[i];
+                if (in[i] < mn) mn = in[i];
+                if (in[i] > mx) mx = in[i];
+            }
+            assert(BitArray_sum(arr) == sum);
+            assert(BitArray_min(arr) == mn);
+            assert(BitArray_max(arr) == mx);
+            BitArray_free(arr);
+
+            // Fewer values than a single group
+            arr = BitArray_init(in + 1, 3, w, sizeof(uint32_t));
+            assert(BitArray_sum(arr) == (uint64_t) in[1] + in[2] + in[3]);
+            assert(BitArray_max(arr) >= in[2] && BitArray_min(arr) <= in[2]);
+            BitArray_free(arr);
+        }
+    }
+    cpu_restrict(~0u);
+    printf("✔ Scans\n");
+}
+
+TEST("Bitwise operations")
+{
+    // Long enough for the unrolled vector loops, with a partial last word
+    enum { N = 20011 };
+    const uint8_t sizes[] = { 1, 5 };
+    const unsigned int masks[] = { ~0u, CPU_AVX2 | CPU_POPCNT, CPU_POPCNT, 0 };
+    static size_t prefix[N + 1];
+    uint64_t seed = 61;
+
+    for (size_t m = 0; m < sizeof(masks)/sizeof(masks[0]); ++m) {
+        cpu_restrict(masks[m]);
+        for (size_t z = 0; z < sizeof(sizes)/sizeof(sizes[0]); ++z) {
+            const uint8_t w = sizes[z];
+            const unsigned int full = (1u << w) - 1;
+            BitArray *a = BitArray_calloc(N, w, sizeof(uint32_t)),
+                     *b = BitArray_calloc(N, w, sizeof(uint32_t));
+            for (unsigned int i = 0; i < N; ++i) {
+                BitArray_write(a, i, lcg_next(&seed) & full);
+                BitArray_write(b, i, lcg_next(&seed) & full);
+            }
+
+            BitArray *and = BitArray_and(a, b), *or = BitArray_or(a, b),
+                     *xor = BitArray_xor(a, b), *not = BitArray_not(a);
+            for (unsigned int i = 0; i < N; ++i) {
+                const unsigned int x = BitArray_read(a, i), y = BitArray_read(b, i);
+                assert(BitArray_read(and, i) == (x & y));
+                assert(BitArray_read(or, i) == (x | y));
+                assert(BitArray_read(xor, i) == (x ^ y));
+                assert(BitArray_read(not, i) == (~x & full));
+            }
+            // Padding past the last value stays clear
+            assert(not->v[(N * w - 1) / 32] >> (N * w % 32) == 0);
+
+            BitArray *c = BitArray_calloc(N, w, sizeof(uint32_t));
+            memcpy(c->v, a->v, sizeof(uint32_t) * BitArray_n_words(a));
+            BitArray_and_inplace(c, b);
+            assert(memcmp(c->v, and->v, sizeof(uint32_t) * BitArray_n_words(a)) == 0);
+            BitArray_xor_inplace(c, xor);
+            BitArray_or_inplace(c, b);
+            assert(memcmp(c->v, or->v, sizeof(uint32_t) * BitArray_n_words(a)) == 0);
+            BitArray_not_inplace(c);
+            BitArray_not_inplace(c);
+            assert(memcmp(c->v, or->v, sizeof(uint32_t) * BitArray_n_words(a)) == 0);
+
+            // Counts between arbitrary values against prefix sums
+            prefix[0] = 0;
+            for (unsigned int i = 0; i < N; ++i) {
+                prefix[i + 1] = prefix[i] + (size_t) __builtin_popcount(BitArray_read(a, i));
+            }
+            assert(BitArray_popcount(a) == prefix[N]);
+            assert(BitArray_popcount(not) == (size_t) N * w - prefix[N]);
+            for (size_t s = 0; s < 70; ++s) {
+                for (size_t e = s; e < 140; ++e) assert(BitArray_popcount_range(a, s, e) == prefix[e] - prefix[s]);
+                assert(BitArray_popcount_range(a, s, N - s) == prefix[N - s] - prefix[s]);
+            }
+            for (size_t q = 0; q < 500; ++q) {
+                size_t s = lcg_next(&seed) % (N + 1), e = lcg_next(&seed) % (N + 1);
+                if (s > e) { size_t t = s; s = e; e = t; }
+                assert(BitArray_popcount_range(a, s, e) == prefix[e] - prefix[s]);
+            }
+
+            BitArray_free(a);
+            BitArray_free(b);
+            BitArray_free(c);
+            BitArray_free(and);
+            BitArray_free(or);
+            BitArray_free(xor);
+            BitArray_free(not);
+        }
+    }
+    cpu_restrict(~0u);
+    printf("✔ Bitwise operations\n");
+}
+
+TEST("Dynamic BitArray")
+{
+    enum { N = 5000 };
+    static uint32_t V[N];
+    uint64_t seed = 37;
+
+    // Slowly growing values widen the array one bit at a time
+    DynBitArray *dyn = DynBitArray_init(1);
+    for (size_t i = 0; i < N; ++i) {
+        V[i] = (uint32_t) (lcg_next(&seed) % (i + 1)) * (uint32_t) (i / 1000 + 1);
+        DynBitArray_push_back(dyn, V[i]);
+        assert(dyn->arr.n == i + 1 && dyn->capacity >= dyn->arr.n);
+    }
+    for (size_t i = 0; i < N; ++i) assert(BitArray_read(&dyn->arr, (unsigned int) i) == V[i]);
+
+    // Chunks with an occasional value needing all 32 bits
+    size_t n = N;
+    for (size_t chunk = 1; n + chunk <= 2 * N; chunk = chunk * 3 + 1) {
+        uint32_t *C = malloc(sizeof(uint32_t) * chunk);
+        for (size_t i = 0; i < chunk; ++i) C[i] = lcg_next(&seed) >> (chunk < 100 ? 20 : 0);
+        DynBitArray_append_many(dyn, C, chunk);
+        for (size_t i = 0; i < chunk; ++i) {
+            assert(BitArray_read(&dyn->arr, (unsigned int) (n + i)) == C[i]);
+        }
+        n += chunk;
+        free(C);
+    }
+    assert(dyn->arr.element_size == 32 && dyn->arr.n == n);
+    for (size_t i = 0; i < N; ++i) assert(BitArray_read(&dyn->arr, (unsigned int) i) == V[i]);
+
+    // A copy compares equal word for word, padding included
+    BitArray *copy = DynBitArray_to_BitArray(dyn);
+    assert(copy->n == n && memcmp(copy->v, dyn->arr.v, sizeof(uint32_t) * BitArray_n_words(copy)) == 0);
+    BitArray_free(copy);
+    DynBitArray_free(dyn);
+
+    // Widening keeps the bits past the last value clear
+    dyn = DynBitArray_init(3);
+    for (uint32_t i = 0; i < 77; ++i) DynBitArray_push_back(dyn, i % 8);
+    DynBitArray_widen(dyn, 11);
+    for (uint32_t i = 0; i < 77; ++i) assert(BitArray_read(&dyn->arr, i) == i % 8);
+    for (size_t j = (77 * 11 + 31) / 32; j < dyn->n_words; ++j) assert(dyn->arr.v[j] == 0);
+    assert(dyn->arr.v[77 * 11 / 32] >> (77 * 11 % 32) == 0);
+    DynBitArray_free(dyn);
+
+    printf("✔ Dynamic BitArray\n");
+}
+
+TEST("Allocators")
+{
+    enum { N_ARRAYS = 100, N = 50 };
+    unsigned int V[N];
+    uint64_t seed = 41;
+    for (size_t i = 0; i < N; ++i) V[i] = lcg_next(&seed) % 1000;
+
+    // Heap arrays keep their payload aligned as well
+    BitArray *heap = BitArray_init(V, N, 10, sizeof(uint32_t));
+    assert((uintptr_t) heap->v % BIT_ALIGN == 0);
+    VLBitArray *vl_heap = VLBitArray_init_codec(V, N, 8, sizeof(uint32_t), VL_DELTA, 0);
+    assert(vl_heap->W_inline && (uintptr_t) vl_heap->W % BIT_ALIGN == 0);
+
+    // Exactly sized arena, started off alignment on purpose
+    const size_t each = BitArray_alloc_size(N, 10, sizeof(uint32_t));
+    uint8_t *buffer = malloc(each * N_ARRAYS + 2 * BIT_ALIGN);
+    BitArena arena;
+    BitArena_init(&arena, buffer + 3, each * N_ARRAYS + 2 * BIT_ALIGN - 3);
+    BitAllocator allocator = BitArena_allocator(&arena);
+
+    BitArray *arrays[N_ARRAYS];
+    for (size_t a = 0; a < N_ARRAYS; ++a) {
+        arrays[a] = BitArray_init_with(V, N, 10, sizeof(uint32_t), &allocator);
+        assert((uintptr_t) arrays[a]->v % BIT_ALIGN == 0);
+        assert((uint8_t *) arrays[a] >= buffer && (uint8_t *) arrays[a] + each <= buffer + 3 + arena.size);
+    }
+    assert(arena.used <= each * N_ARRAYS + BIT_ALIGN);
+    for (size_t a = 0; a < N_ARRAYS; ++a) {
+        assert(memcmp(arrays[a]->v, heap->v, sizeof(uint32_t) * BitArray_n_words(heap)) == 0);
+        BitArray_free_with(arrays[a], &allocator);
+    }
+    assert(BitArena_alloc(&arena, arena.size, 1) == NULL);
+
+    // A VLBitArray in a single block of the arena
+    BitArena_reset(&arena);
+    VLBitArray *vl = VLBitArray_init_with(V, N, 8, sizeof(uint32_t), VL_DELTA, 0, &allocator);
+    assert((uint8_t *) vl->W > (uint8_t *) vl && (uint8_t *) vl->W < buffer + 3 + arena.used);
+    assert((uintptr_t) vl->W % BIT_ALIGN == 0);
+    assert(vl->logical_size == vl_heap->logical_size);
+    assert(memcmp(vl->W, vl_heap->W, sizeof(uint32_t) * vl->physical_size) == 0);
+    for (size_t i = 0; i < N; ++i) assert(VLBitArray_read(vl, i) == V[i]);
+    VLBitArray_free_with(vl, &allocator);
+
+    free(buffer);
+    BitArray_free(heap);
+    VLBitArray_free(vl_heap);
+    printf("✔ Allocators\n");
+}
+
+TEST("BitArray builder")
+{
+    const uint32_t n = 1000;
+    uint32_t in[1000];
+    uint64_t seed = 7;
+
+    for (uint8_t w = 1; w <= 32; ++w) {
+        BitArray *ref = BitArray_calloc(n, w, sizeof(uint32_t));
+        BitArrayBuilder builder;
+        BitArrayBuilder_begin(&builder, n, w, sizeof(uint32_t));
+
+        for (size_t i = 0; i < n; ++i) {
+            in[i] = lcg_next(&seed) & (0xFFFFFFFFu >> (32 - w));
+            BitArray_write(ref, (unsigned) i, in[i]);
+        }
+
+        // Mix of single values and chunks on and off block boundaries
+        BitArrayBuilder_push(&builder, in[0]);
+        BitArrayBuilder_push_many(&builder, in + 1, 40);
+        BitArrayBuilder_push_many(&builder, in + 41, 0);
+        BitArrayBuilder_push_many(&builder, in + 41, 87);
+        for (size_t i = 128; i < 200; ++i) BitArrayBuilder_push(&builder, in[i]);
+        BitArrayBuilder_push_many(&builder, in + 200, n - 200);
+        BitArray *built = BitArrayBuilder_finish(&builder);
+
+        for (size_t i = 0; i < (n*w + 31) / 32; ++i) assert(built->v[i] == ref->v[i]);
+
+        BitArray_free(ref);
+        BitArray_free(built);
+    }
+    printf("✔ BitArray builder\n");
+}
+
+TEST("BitArray64")
+{
+    const uint64_t n = 1000;
+    uint64_t in[1000];
+    uint64_t seed = 11;
+
+    for (uint8_t w = 1; w <= 64; ++w) {
+        const uint64_t mask = ~(uint64_t) 0 >> (64 - w);
+        for (size_t i = 0; i < n; ++i) {
+            in[i] = ((uint64_t) lcg_next(&seed) << 32 | lcg_next(&seed)) & mask;
+        }
+
+        BitArray64 *arr = BitArray64_init(in, n, w);
+        for (uint64_t i = 0; i < n; ++i) assert(BitArray64_read(arr, i) == in[i]);
+
+        // Overwrite every third element, neighbours must be preserved
+        for (uint64_t i = 0; i < n; i += 3) {
+            in[i] = ~in[i] & mask;
+            BitArray64_write(arr, i, in[i]);
+        }
+        for (uint64_t i = 0; i < n; ++i) assert(BitArray64_read(arr, i) == in[i]);
+
+        // Same bits as the 32 bit word backend
+        if (w <= 32) {
+            BitArray *arr32 = BitArray_calloc((uint32_t) n, w, sizeof(uint32_t));
+            for (unsigned int i = 0; i < n; ++i) BitArray_write(arr32, i, (unsigned int) in[i]);
+            assert(memcmp(arr32->v, arr->v,
+              BitArray_n_words(arr32) * sizeof(uint32_t)) == 0);
+            BitArray_free(arr32);
+        }
+
+        BitArray64_free(arr);
+    }
+    printf("✔ BitArray64\n");
+}
+
+TEST("Checked and unchecked access")
+{
+    uint64_t seed = 37;
+    for (uint8_t es = 1; es <= 32; ++es) {
+        const uint32_t n = 300;
+        BitArray *a = BitArray_calloc(n, es, sizeof(uint32_t));
+        BitArray *b = BitArray_calloc(n, es, sizeof(uint32_t));
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t x = lcg_next(&seed);
+            BitArray_write_unchecked(a, i, x);
+            assert(BitArray_write_checked(b, i, x) == BITARR_SUCCESS);
+        }
+        assert(memcmp(a->v, b->v, sizeof(uint32_t) * BitArray_n_words(a)) == 0);
+
+        unsigned int x = 12345;
+        for (uint32_t i = 0; i < n; ++i) {
+            assert(BitArray_read_checked(a, i, &x) == BITARR_SUCCESS);
+            assert(x == BitArray_read_unchecked(a, i));
+            assert(x == bit_read_range(a->v, 32, i * es, (i + 1) * es - 1));
+        }
+        x = 12345;
+        assert(BitArray_read_checked(a, n, &x) == OUT_OF_BOUNDS && x == 12345);
+        assert(BitArray_write_checked(a, n, 1) == OUT_OF_BOUNDS);
+        BitArray_free(a);
+        BitArray_free(b);
+    }
+
+    unsigned int V[100];
+    for (size_t i = 0; i < 100; ++i) V[i] = lcg_next(&seed) % 1000;
+    VLBitArray *vlb = VLBitArray_init(V, 100, 8, sizeof(uint32_t));
+    uint32_t y = 7;
+    for (size_t i = 0; i < 100; ++i) {
+        assert(VLBitArray_read_checked(vlb, i, &y) == BITARR_SUCCESS && y == V[i]);
+        assert(VLBitArray_read_unchecked(vlb, i) == V[i]);
+    }
+    assert(VLBitArray_read_checked(vlb, 100, &y) == OUT_OF_BOUNDS && y == V[99]);
+    VLBitArray_free(vlb);
+
+    printf("✔ Checked and unchecked access\n");
+}
+
+// Checks one BITARR_DEFINE instance against the generic BitArray functions
+#define STATIC_ACCESSOR_CHECK(name, W)                                        \
+    do {                                                                      \
+        const uint32_t n = 1000;                                              \
+        BitArray *a = bitarr_##name##_calloc(n);                              \
+        assert(a->element_size == (W));                                       \
+        for (uint32_t i = 0; i < n; ++i) {                                    \
+            bitarr_##name##_set(a, i, lcg_next(&seed));                       \
+        }                                                                     \
+        /* Overwrite every third, neighbours must survive */                \
+        for (uint32_t i = 0; i < n; i += 3) bitarr_##name##_set(a, i, ~i);    \
+        for (uint32_t i = 0; i < n; ++i) {                                    \
+            assert(bitarr_##name##_get(a, i) == BitArray_read(a, i));         \
+            if (i % 3 == 0) assert(BitArray_read(a, i) == (~i & (0xFFFFFFFFu >> (32 - (W))))); \
+        }                                                                     \
+        bitarr_##name##_unpack(a, 7, 500, out);                               \
+        for (uint32_t i = 0; i < 500; ++i) assert(out[i] == BitArray_read(a, 7 + i)); \
+        bitarr_##name##_unpack(a, 990, 10, out);                              \
+        for (uint32_t i = 0; i < 10; ++i) assert(out[i] == BitArray_read(a, 990 + i)); \
+        bitarr_##name##_pack(a, 3, 5, out);                                   \
+        for (uint32_t i = 0; i < 5; ++i) assert(BitArray_read(a, 3 + i) == out[i]); \
+        BitArray_free(a);                                                     \
+    } while (0)
+
+TEST("Static accessors")
+{
+    uint64_t seed = 31;
+    uint32_t out[500];
+    STATIC_ACCESSOR_CHECK(u1, 1);
+    STATIC_ACCESSOR_CHECK(u3, 3);
+    STATIC_ACCESSOR_CHECK(u5, 5);
+    STATIC_ACCESSOR_CHECK(u12, 12);
+    STATIC_ACCESSOR_CHECK(u32, 32);
+    printf("✔ Static accessors\n");
+}
+
+TEST("Rank/select")
+{
+    const size_t sizes[] = { 1, 63, 64, 511, 512, 513, 5000, 100003 };
+    // Percentage of ones, 0 and 100 exercise empty and full superblocks
+    const uint32_t density[] = { 0, 1, 50, 99, 100 };
+    uint64_t seed = 5;
+
+    for (size_t si = 0; si < sizeof(sizes)/sizeof(sizes[0]); ++si) {
+        for (size_t di = 0; di < sizeof(density)/sizeof(density[0]); ++di) {
+            const size_t n = sizes[si];
+            BitArray *bits = BitArray_calloc((uint32_t) n, 1, sizeof(uint32_t));
+            for (size_t i = 0; i < n; ++i) {
+                if (lcg_next(&seed) % 100 < density[di]) bit_set(bits->v, 32, i);
+            }
+
+            RankSelectBitVector *rs = RankSelectBitVector_from_BitArray(bits);
+            size_t ones = 0;
+            for (size_t i = 0; i <= n; ++i) {
+                assert(RankSelectBitVector_rank1(rs, i) == ones);
+                assert(RankSelectBitVector_rank0(rs, i) == i - ones);
+                if (i < n && bit_read(bits->v, 32, i)) {
+                    ones++;
+                    assert(RankSelectBitVector_select1(rs, ones) == i);
+                } else if (i < n) {
+                    assert(RankSelectBitVector_select0(rs, i + 1 - ones) == i);
+                }
+            }
+            assert(rs->ones == ones);
+
+            RankSelectBitVector_free(rs);
+            BitArray_free(bits);
+        }
+    }
+    printf("✔ Rank/select\n");
+}
+
+TEST("DAC")
+{
+    enum { N = 20000 };
+    static uint32_t V[N];
+    uint64_t seed = 17;
+
+    // Skewed values, mostly a single chunk, with a few at full width
+    for (size_t i = 0; i < N; ++i) {
+        uint32_t r = lcg_next(&seed);
+        V[i] = r >> (r % 32);
+    }
+    V[N - 1] = UINT32_MAX;
+
+    const uint8_t chunk_sizes[] = { 1, 4, 8, 13, 32 };
+    for (size_t ci = 0; ci < sizeof(chunk_sizes)/sizeof(chunk_sizes[0]); ++ci) {
+        DACArray *dac = DACArray_init(V, N, chunk_sizes[ci]);
+        assert(dac->n_levels == (32u + chunk_sizes[ci] - 1) / chunk_sizes[ci]);
+        for (size_t i = 0; i < N; ++i) assert(DACArray_read(dac, i) == V[i]);
+        if (chunk_sizes[ci] == 8) assert(DACArray_size(dac) < sizeof(V));
+        DACArray_free(dac);
+    }
+
+    // Only zeros, a single level
+    for (size_t i = 0; i < N; ++i) V[i] = 0;
+    DACArray *dac = DACArray_init(V, N, 4);
+    assert(dac->n_levels == 1 && DACArray_read(dac, N / 2) == 0);
+    DACArray_free(dac);
+
+    printf("✔ DAC\n");
+}
+
+TEST("Elias-Fano")
+{
+    enum { N = 5000 };
+    static uint32_t V[N];
+    // Dense with duplicates, sparse, and sparse up to the largest value
+    const uint32_t gaps[] = { 2, 1000, 800000 };
+    uint64_t seed = 19;
+
+    for (size_t gi = 0; gi < sizeof(gaps)/sizeof(gaps[0]); ++gi) {
+        uint32_t x = 3;
+        for (size_t i = 0; i < N; ++i) {
+            x += lcg_next(&seed) % gaps[gi];
+            V[i] = x;
+        }
+        if (gi == 2) V[N - 1] = UINT32_MAX;
+
+        for (size_t n = 0; n <= N; n += N / 4) {
+            EliasFano *ef = EliasFano_init(V, (uint32_t) n);
+            for (size_t i = 0; i < n; ++i) assert(EliasFano_access(ef, i) == V[i]);
+
+            const size_t starts[] = { 0, 1, 31, 32, n / 2, n };
+            for (size_t si = 0; si < sizeof(starts)/sizeof(starts[0]); ++si) {
+                if (starts[si] > n) continue;
+                EliasFanoIter it;
+                EliasFano_iter(&it, ef, starts[si]);
+                for (size_t i = starts[si]; i < n; ++i) assert(EliasFano_iter_next(&it) == V[i]);
+            }
+
+            // Queries on, between, below and above the values
+            for (size_t q = 0; q < 2000; ++q) {
+                const uint32_t edges[] = { 0, 3, UINT32_MAX, V[n ? n - 1 : 0] };
+                uint32_t y = lcg_next(&seed);
+                if (q < 4) y = edges[q];
+                else if (n && q % 2) y = V[y % n] + (uint32_t) (q % 3) - 1;
+                size_t lo = 0;
+                while (lo < n && V[lo] < y) lo++;
+                assert(EliasFano_next_geq(ef, y) == lo);
+                size_t hi = n;
+                while (hi > 0 && V[hi - 1] > y) hi--;
+                assert(EliasFano_prev_leq(ef, y) == (hi ? hi - 1 : n));
+            }
+            EliasFano_free(ef);
+        }
+    }
+
+    // About 2 + log2(u / n) bits per value
+    for (size_t i = 0; i < N; ++i) V[i] = (uint32_t) (i + 1) * 64;
+    EliasFano *ef = EliasFano_init(V, N);
+    assert(ef->low_bits == 6);
+    assert(EliasFano_size(ef) * 8 < N * (2 + 6) * 5 / 4);
+    EliasFano_free(ef);
+
+    // A single value at the top of the range
+    V[0] = UINT32_MAX;
+    ef = EliasFano_init(V, 1);
+    assert(ef->low_bits == 31 && EliasFano_access(ef, 0) == UINT32_MAX);
+    assert(EliasFano_next_geq(ef, 5) == 0 && EliasFano_next_geq(ef, UINT32_MAX) == 0);
+    assert(EliasFano_prev_leq(ef, UINT32_MAX - 1) == 1);
+    EliasFano_free(ef);
+
+    assert(exits_with(elias_fano_unsorted, OUT_OF_BOUNDS));
+    printf("✔ Elias-Fano\n");
+}
+
+TEST("Wavelet matrix")
+{
+    enum { N = 3000, W = 6 };
+    static uint32_t V[N];
+    uint64_t seed = 29;
+
+    // Skewed symbols so some are frequent and some never occur
+    for (size_t i = 0; i < N; ++i) {
+        uint32_t r = lcg_next(&seed);
+        V[i] = (r % 64) & (r >> 8 | 0x0F);
+    }
+    BitArray *bitarr = BitArray_calloc(N, W, sizeof(uint32_t));
+    BitArray_pack(bitarr, 0, N, V);
+    WaveletMatrix *wm = WaveletMatrix_from_BitArray(bitarr);
+    assert(wm->n == N && wm->n_levels == W);
+
+    size_t counts[1 << W] = {0};
+    for (size_t i = 0; i < N; ++i) {
+        assert(WaveletMatrix_access(wm, i) == V[i]);
+        assert(WaveletMatrix_rank(wm, V[i], i) == counts[V[i]]);
+        counts[V[i]]++;
+        assert(WaveletMatrix_select(wm, V[i], counts[V[i]]) == i);
+    }
+    for (uint32_t c = 0; c < (1 << W); ++c) {
+        assert(WaveletMatrix_rank(wm, c, N) == counts[c]);
+        assert(WaveletMatrix_select(wm, c, counts[c] + 1) == N);
+    }
+    assert(WaveletMatrix_rank(wm, 1 << W, N) == 0);
+
+    for (size_t q = 0; q < 200; ++q) {
+        size_t s = lcg_next(&seed) % N, e = lcg_next(&seed) % N;
+        if (s > e) { size_t t = s; s = e; e = t; }
+        uint32_t lo = lcg_next(&seed) % 64, hi = lcg_next(&seed) % 64;
+
+        size_t in_range = 0, hist[1 << W] = {0};
+        for (size_t i = s; i < e; ++i) {
+            in_range += lo <= V[i] && V[i] <= hi;
+            hist[V[i]]++;
+        }
+        assert(WaveletMatrix_range_count(wm, s, e, lo, hi) == in_range);
+        assert(WaveletMatrix_range_count(wm, s, e, 0, UINT32_MAX) == e - s);
+
+        // Quantiles in order walk the sorted range
+        size_t k = 0;
+        for (uint32_t c = 0; c < (1 << W); ++c) {
+            for (size_t j = 0; j < hist[c]; ++j, ++k) {
+                assert(WaveletMatrix_range_quantile(wm, s, e, k) == c);
+            }
+        }
+    }
+
+    WaveletMatrix_free(wm);
+    BitArray_free(bitarr);
+
+    // Full width symbols
+    for (size_t i = 0; i < N; ++i) V[i] = lcg_next(&seed) >> 1 | (uint32_t) (i & 1) << 31;
+    wm = WaveletMatrix_init(V, N, 32);
+    for (size_t i = 0; i < N; i += 7) {
+        assert(WaveletMatrix_access(wm, i) == V[i]);
+        assert(WaveletMatrix_select(wm, V[i], 1) <= i);
+    }
+    assert(WaveletMatrix_range_count(wm, 0, N, 1u << 31, UINT32_MAX) == N / 2);
+    WaveletMatrix_free(wm);
+
+    printf("✔ Wavelet matrix\n");
+}
+
+TEST("Roaring bitmap")
+{
+    // Sparse, dense, clustered and empty chunks, the last one partial
+    enum { N = 4 * 65536 + 1007 };
+    static uint8_t in_a[N], in_b[N], expect[N];
+    uint64_t seed = 53;
+    for (uint32_t x = 0; x < N; ++x) {
+        uint32_t r = lcg_next(&seed) % 1000;
+        switch (x >> 16) {
+        case 0: in_a[x] = r < 15; in_b[x] = r < 20; break;
+        case 1: in_a[x] = r < 500; in_b[x] = r < 750; break;
+        case 2: in_a[x] = x % 1000 < 200; in_b[x] = r < 2; break;
+        case 3: in_a[x] = 0; in_b[x] = r < 900; break;
+        default: in_a[x] = r < 10; in_b[x] = 0; break;
+        }
+    }
+
+    RoaringBitmap *a = RoaringBitmap_init();
+    for (uint32_t x = 0; x < N; ++x) if (in_a[x]) RoaringBitmap_add(a, x);
+    RoaringBitmap_add(a, 17);
+    in_a[17] = 1;
+    BitArray *bits = BitArray_calloc(N, 1, sizeof(uint32_t));
+    for (uint32_t x = 0; x < N; ++x) BitArray_write(bits, x, in_b[x]);
+    RoaringBitmap *b = RoaringBitmap_from_BitArray(bits);
+    BitArray_free(bits);
+
+    roaring_check(a, in_a, N);
+    roaring_check(b, in_b, N);
+    assert(a->n == 4 && b->n == 4);
+    assert(a->containers[0].type == ROARING_ARRAY && a->containers[1].type == ROARING_BITMAP);
+    assert(!RoaringBitmap_contains(a, UINT32_MAX) && !RoaringBitmap_contains(b, N));
+
+    for (int pass = 0; pass < 3; ++pass) {
+        // Clustered chunk as runs, then the portable kernel
+        if (pass == 1) {
+            size_t before = RoaringBitmap_size(a);
+            RoaringBitmap_optimize(a);
+            assert(a->containers[2].type == ROARING_RUN && a->containers[0].type == ROARING_ARRAY);
+            assert(RoaringBitmap_size(a) < before);
+            roaring_check(a, in_a, N);
+        }
+        if (pass == 2) cpu_restrict(0);
+
+        RoaringBitmap *r = RoaringBitmap_and(a, b);
+        for (uint32_t x = 0; x < N; ++x) expect[x] = in_a[x] & in_b[x];
+        roaring_check(r, expect, N);
+        RoaringBitmap_free(r);
+
+        r = RoaringBitmap_or(a, b);
+        for (uint32_t x = 0; x < N; ++x) expect[x] = in_a[x] | in_b[x];
+        roaring_check(r, expect, N);
+        RoaringBitmap_free(r);
+
+        r = RoaringBitmap_xor(a, b);
+        for (uint32_t x = 0; x < N; ++x) expect[x] = in_a[x] ^ in_b[x];
+        roaring_check(r, expect, N);
+        RoaringBitmap_free(r);
+
+        r = RoaringBitmap_andnot(a, b);
+        for (uint32_t x = 0; x < N; ++x) expect[x] = in_a[x] & !in_b[x];
+        roaring_check(r, expect, N);
+        RoaringBitmap_free(r);
+
+        r = RoaringBitmap_andnot(b, a);
+        for (uint32_t x = 0; x < N; ++x) expect[x] = in_b[x] & !in_a[x];
+        roaring_check(r, expect, N);
+        RoaringBitmap_free(r);
+    }
+    cpu_restrict(~0u);
+
+    // Adding inside a run keeps it, outside turns it back into values
+    RoaringBitmap_add(a, 2 * 65536 + 100);
+    assert(a->containers[2].type == ROARING_RUN);
+    RoaringBitmap_add(a, 2 * 65536 + 500);
+    in_a[2 * 65536 + 500] = 1;
+    assert(a->containers[2].type != ROARING_RUN);
+    roaring_check(a, in_a, N);
+
+    // Full chunk collapses to a single run
+    RoaringBitmap_free(b);
+    b = RoaringBitmap_init();
+    for (uint32_t x = 0; x < 65536; ++x) RoaringBitmap_add(b, 7 * 65536 + x);
+    RoaringBitmap_optimize(b);
+    assert(b->containers[0].type == ROARING_RUN && b->containers[0].n == 1);
+    assert(RoaringBitmap_cardinality(b) == 65536 && RoaringBitmap_contains(b, 8 * 65536 - 1));
+    RoaringBitmap *r = RoaringBitmap_and(a, b);
+    assert(r->n == 0 && RoaringBitmap_cardinality(r) == 0);
+    RoaringBitmap_free(r);
+
+    // Arrays in the same chunk with nothing in common
+    RoaringBitmap *odd = RoaringBitmap_init(), *even = RoaringBitmap_init();
+    for (uint32_t x = 0; x < 100; ++x) RoaringBitmap_add(x % 2 ? odd : even, x);
+    r = RoaringBitmap_and(odd, even);
+    assert(RoaringBitmap_cardinality(r) == 0 && !RoaringBitmap_contains(r, 1));
+    RoaringBitmap_free(r);
+    RoaringBitmap_free(odd);
+    RoaringBitmap_free(even);
+
+    RoaringBitmap_free(a);
+    RoaringBitmap_free(b);
+    printf("✔ Roaring bitmap\n");
+}
+
+TEST("PFOR")
+{
+    enum { N = 10000 };
+    static uint32_t V[N], out[N];
+    uint64_t seed = 23;
+
+    for (int dist = 0; dist < 4; ++dist) {
+        for (size_t i = 0; i < N; ++i) {
+            uint32_t r = lcg_next(&seed);
+            // Narrow readings around a level with rare spikes, constant,
+            // full range, and spikes in every value of some blocks
+            if (dist == 0) V[i] = 1000000 + r % 50 + (r % 97 == 0 ? r >> 8 : 0);
+            else if (dist == 1) V[i] = 42;
+            else if (dist == 2) V[i] = r;
+            else V[i] = (i / PFOR_BLOCK) % 2 ? r : r % 8;
+        }
+        V[N / 2] = dist == 0 ? UINT32_MAX : V[N / 2];
+
+        const size_t sizes[] = { 0, 1, 127, 129, N };
+        for (size_t si = 0; si < sizeof(sizes)/sizeof(sizes[0]); ++si) {
+            const size_t n = sizes[si];
+            PForArray *pfor = PForArray_init(V, n);
+
+            for (size_t i = 0; i < n; ++i) assert(PForArray_read(pfor, i) == V[i]);
+            PForArray_decode(pfor, 0, n, out);
+            for (size_t i = 0; i < n; ++i) assert(out[i] == V[i]);
+            if (n > 300) {
+                PForArray_decode(pfor, 100, 200, out);
+                for (size_t i = 0; i < 200; ++i) assert(out[i] == V[100 + i]);
+            }
+
+            if (n == N && dist == 0) assert(PForArray_size(pfor) * 3 < sizeof(V));
+            if (n == N && dist == 1) assert(PForArray_size(pfor) * 30 < sizeof(V));
+            PForArray_free(pfor);
+        }
+    }
+    printf("✔ PFOR\n");
+}
+
 TEST("Gamma encoding")
 {
     uint32_t og_int = 13;
@@ -171,6 +1170,359 @@ TEST("VL BitArray")
     printf("✔ Variable Length BitArray\n");
 }
 
+TEST("VL BitArray iterator")
+{
+    enum { N = 3000 };
+    static unsigned int V[N];
+    static uint32_t out[N];
+    uint64_t seed = 7;
+
+    // Mostly short codes, which are decoded from the table, and some long ones
+    for (size_t i = 0; i < N; ++i) {
+        uint32_t r = lcg_next(&seed);
+        V[i] = r % 8 ? r % 4 : r % 60000;
+    }
+
+    const size_t ks[] = { 1, 3, 32, 1000 };
+    for (size_t ki = 0; ki < sizeof(ks)/sizeof(ks[0]); ++ki) {
+        VLBitArray *vlb = VLBitArray_init(V, N, ks[ki], sizeof(uint32_t));
+
+        VLBitArrayIter it;
+        VLBitArray_iter(&it, vlb, 0);
+        for (size_t i = 0; i < N; ++i) assert(VLBitArray_iter_next(&it) == V[i]);
+
+        const size_t ranges[][2] = { {0, N}, {1, 7}, {5, 0}, {999, 1001}, {N - 9, 9}, {N, 0} };
+        for (size_t ri = 0; ri < sizeof(ranges)/sizeof(ranges[0]); ++ri) {
+            const size_t start = ranges[ri][0], count = ranges[ri][1];
+            VLBitArray_decode(vlb, start, count, out);
+            for (size_t i = 0; i < count; ++i) assert(out[i] == V[start + i]);
+        }
+
+        for (size_t i = 0; i < N; i += 37) assert(VLBitArray_read(vlb, i) == V[i]);
+        VLBitArray_free(vlb);
+    }
+    printf("✔ VL BitArray iterator\n");
+}
+
+TEST("VL BitArray codecs")
+{
+    enum { N = 2000 };
+    static unsigned int V[N];
+    static uint32_t out[N];
+    const VL_CODEC codecs[] = { VL_GAMMA, VL_DELTA, VL_RICE, VL_VARBYTE };
+    uint64_t seed = 11;
+
+    for (int dist = 0; dist < 3; ++dist) {
+        for (size_t i = 0; i < N; ++i) {
+            uint32_t r = lcg_next(&seed);
+            // Small values, full range values and geometric gaps
+            if (dist == 0) V[i] = r % 16;
+            else if (dist == 1) V[i] = r;
+            else V[i] = (uint32_t) __builtin_ctz(r | 1u << 20) * 100 + r % 100;
+        }
+        V[N - 1] = dist == 1 ? UINT32_MAX : V[N - 1];
+
+        size_t bits[4];
+        for (size_t ci = 0; ci < 4; ++ci) {
+            VLBitArray *vlb = VLBitArray_init_codec(V, N, 64, sizeof(uint32_t),
+              codecs[ci], VL_RICE_AUTO);
+            bits[ci] = vlb->logical_size;
+
+            VLBitArray_decode(vlb, 0, N, out);
+            for (size_t i = 0; i < N; ++i) assert(out[i] == V[i]);
+            VLBitArray_decode(vlb, 65, 300, out);
+            for (size_t i = 0; i < 300; ++i) assert(out[i] == V[65 + i]);
+
+            VLBitArrayIter it;
+            VLBitArray_iter(&it, vlb, 130);
+            for (size_t i = 130; i < N; ++i) assert(VLBitArray_iter_next(&it) == V[i]);
+            for (size_t i = 0; i < N; i += 13) assert(VLBitArray_read(vlb, i) == V[i]);
+            VLBitArray_free(vlb);
+        }
+        // Delta beats gamma on large values, tuned Rice on geometric ones
+        if (dist == 1) assert(bits[1] < bits[0]);
+        if (dist == 2) assert(bits[2] < bits[0] && bits[2] < bits[3]);
+    }
+
+    // Fixed Rice parameter
+    for (size_t i = 0; i < N; ++i) V[i] = lcg_next(&seed) % 1000;
+    VLBitArray *vlb = VLBitArray_init_codec(V, N, 10, sizeof(uint32_t), VL_RICE, 7);
+    assert(vlb->param == 7);
+    for (size_t i = 0; i < N; ++i) assert(VLBitArray_read(vlb, i) == V[i]);
+    VLBitArray_free(vlb);
+
+    // One bit codes ending on a word boundary, the last write is 0 bits long
+    for (size_t i = 0; i < 512; ++i) V[i] = 0;
+    for (size_t ci = 0; ci < 4; ++ci) {
+        vlb = VLBitArray_init_codec(V, 512, 64, sizeof(uint32_t), codecs[ci], 0);
+        for (size_t i = 0; i < 512; ++i) assert(VLBitArray_read(vlb, i) == 0);
+        VLBitArray_free(vlb);
+    }
+    vlb = VLBitArray_init(V, 32, 8, sizeof(uint32_t));
+    assert(vlb->logical_size == 32 && vlb->physical_size == 1);
+    VLBitArray_free(vlb);
+
+    printf("✔ VL BitArray codecs\n");
+}
+
+TEST("VL BitArray builder")
+{
+    // Large enough that the old stack scratch copy would not fit
+    enum { N = 1 << 21 };
+    unsigned int *V = malloc(sizeof(unsigned int) * N);
+    uint64_t seed = 13;
+    for (size_t i = 0; i < N; ++i) {
+        uint32_t r = lcg_next(&seed);
+        V[i] = r % 16 ? r % 64 : r >> 20;
+    }
+
+    const VL_CODEC codecs[] = { VL_GAMMA, VL_RICE, VL_VARBYTE };
+    const size_t sizes[] = { 0, 1, 1000, N };
+    for (size_t ci = 0; ci < 3; ++ci) {
+        for (size_t si = 0; si < 4; ++si) {
+            const size_t n = sizes[si];
+            VLBitArrayBuilder builder;
+            VLBitArrayBuilder_begin(&builder, 100, sizeof(uint32_t), codecs[ci], 5);
+            // Uneven chunks
+            for (size_t i = 0; i < n; i += 777) {
+                VLBitArrayBuilder_push_many(&builder, V + i, n - i < 777 ? n - i : 777);
+            }
+            VLBitArray *built = VLBitArrayBuilder_finish(&builder);
+            VLBitArray *vlb = VLBitArray_init_codec(V, n, 100, sizeof(uint32_t), codecs[ci], 5);
+
+            assert(built->length == n && built->logical_size == vlb->logical_size);
+            assert(built->physical_size == vlb->physical_size);
+            assert(memcmp(built->W, vlb->W, sizeof(uint32_t) * vlb->physical_size) == 0);
+            assert(memcmp(built->P, vlb->P, sizeof(size_t) * ((n + 99) / 100)) == 0);
+            if (n) assert(VLBitArray_read(built, n - 1) == V[n - 1]);
+
+            VLBitArray_free(built);
+            VLBitArray_free(vlb);
+        }
+    }
+    free(V);
+    printf("✔ VL BitArray builder\n");
+}
+
+TEST("Gather")
+{
+    enum { N = 5000, COUNT = 3000 };
+    static unsigned int V[N];
+    static size_t idx[COUNT];
+    static uint32_t out[COUNT];
+    uint64_t seed = 67;
+    for (size_t i = 0; i < N; ++i) V[i] = lcg_next(&seed) % 300;
+
+    // Uniform, clustered runs with repeats, and descending indexes
+    for (int pattern = 0; pattern < 3; ++pattern) {
+        size_t base = 0;
+        for (size_t q = 0; q < COUNT; ++q) {
+            if (pattern == 0) idx[q] = lcg_next(&seed) % N;
+            else if (pattern == 1) {
+                if (q % 8 == 0) base = lcg_next(&seed) % (N - 40);
+                idx[q] = base + lcg_next(&seed) % 40;
+            } else idx[q] = N - 1 - q;
+        }
+
+        for (unsigned int flags = 0; flags <= GATHER_SORT; flags += GATHER_SORT) {
+            const uint8_t widths[] = { 1, 9, 32 };
+            for (size_t wi = 0; wi < sizeof(widths); ++wi) {
+                BitArray *bitarr = BitArray_calloc(N, widths[wi], sizeof(uint32_t));
+                for (unsigned int i = 0; i < N; ++i) BitArray_write(bitarr, i, V[i] * 2654435761u);
+                BitArray_gather(bitarr, idx, COUNT, out, flags);
+                for (size_t q = 0; q < COUNT; ++q) {
+                    assert(out[q] == BitArray_read(bitarr, (unsigned int) idx[q]));
+                }
+                BitArray_free(bitarr);
+            }
+
+            const VL_CODEC codecs[] = { VL_GAMMA, VL_RICE, VL_VARBYTE };
+            for (size_t ci = 0; ci < sizeof(codecs)/sizeof(codecs[0]); ++ci) {
+                VLBitArray *vlb = VLBitArray_init_codec(V, N, 1 + ci * 16, sizeof(uint32_t), codecs[ci], 4);
+                VLBitArray_gather(vlb, idx, COUNT, out, flags);
+                for (size_t q = 0; q < COUNT; ++q) assert(out[q] == V[idx[q]]);
+                VLBitArray_free(vlb);
+            }
+        }
+    }
+
+    // Empty batch
+    BitArray *empty = BitArray_calloc(0, 3, sizeof(uint32_t));
+    BitArray_gather(empty, idx, 0, out, GATHER_SORT);
+    BitArray_free(empty);
+    printf("✔ Gather\n");
+}
+
+TEST("VL BitArray save and mmap")
+{
+    enum { N = 200000 };
+    unsigned int *V = malloc(sizeof(unsigned int) * N);
+    size_t idx[1000];
+    uint32_t out[1000];
+    uint64_t seed = 71;
+    for (size_t i = 0; i < N; ++i) V[i] = lcg_next(&seed) % 64;
+    for (size_t q = 0; q < 1000; ++q) idx[q] = lcg_next(&seed) % N;
+
+    const VL_CODEC codecs[] = { VL_GAMMA, VL_RICE, VL_VARBYTE };
+    const size_t ks[] = { 1, 32 }, lengths[] = { 0, 1, N };
+    for (size_t ci = 0; ci < 3; ++ci) {
+        for (size_t ki = 0; ki < 2; ++ki) {
+            for (size_t li = 0; li < 3; ++li) {
+                const size_t n = lengths[li], n_samples = (n + ks[ki] - 1) / ks[ki];
+                VLBitArray *vlb = VLBitArray_init_codec(V, n, ks[ki], sizeof(uint32_t),
+                  codecs[ci], VL_RICE_AUTO);
+                FILE *fp = fopen(vl_arr_v2_fp, "wb");
+                VLBitArray_save(vlb, fp);
+                fclose(fp);
+
+                fp = fopen(vl_arr_v2_fp, "rb");
+                VLBitArray *read = VLBitArray_open(fp);
+                fclose(fp);
+                VLBitArray *mapped = VLBitArray_mmap(vl_arr_v2_fp);
+
+                VLBitArray *copies[] = { read, mapped };
+                for (size_t c = 0; c < 2; ++c) {
+                    VLBitArray *r = copies[c];
+                    assert(r->k == vlb->k && r->length == n && r->codec == vlb->codec);
+                    assert(r->param == vlb->param && r->logical_size == vlb->logical_size);
+                    assert(r->physical_size == vlb->physical_size);
+                    assert(((uintptr_t) r->W & 63) == 0);
+                    assert(memcmp(r->P, vlb->P, sizeof(size_t) * n_samples) == 0);
+                    assert(memcmp(r->W, vlb->W, sizeof(uint32_t) * vlb->physical_size) == 0);
+                    for (size_t i = 0; i < n; i += 97) assert(VLBitArray_read(r, i) == V[i]);
+                }
+                assert(VLBitArray_mmap_verify(mapped) == BITARR_SUCCESS);
+                if (n == N) {
+                    VLBitArray_gather(mapped, idx, 1000, out, GATHER_SORT);
+                    for (size_t q = 0; q < 1000; ++q) assert(out[q] == V[idx[q]]);
+                }
+                VLBitArray_munmap(mapped);
+                VLBitArray_free(read);
+                VLBitArray_free(vlb);
+            }
+        }
+    }
+
+    // Flip one bit of W, past the first checksum block
+    FILE *fp = fopen(vl_arr_v2_fp, "r+b");
+    fseek(fp, (long) (BIT_FILE_VL_PAYLOAD + BIT_FILE_BLOCK + 5), SEEK_SET);
+    int c = fgetc(fp);
+    fseek(fp, -1, SEEK_CUR);
+    fputc(c ^ 0x10, fp);
+    fclose(fp);
+    VLBitArray *mapped = VLBitArray_mmap(vl_arr_v2_fp);
+    assert(VLBitArray_mmap_verify(mapped) == CHECKSUM_ERROR);
+    VLBitArray_munmap(mapped);
+
+    free(V);
+    printf("✔ VL BitArray save and mmap\n");
+}
+
+TEST("Atomic writes")
+{
+    const uint8_t sizes[] = { 1, 7, 13, 32 };
+    const size_t n = 2000, n_tasks = 8, rounds = 20;
+
+    for (size_t si = 0; si < sizeof(sizes)/sizeof(sizes[0]); ++si) {
+        const uint8_t w = sizes[si];
+        const uint32_t mask = 0xFFFFFFFFu >> (32 - w);
+        BitArray *arr = BitArray_calloc((uint32_t) n, w, sizeof(uint32_t));
+        AtomicJob job = { arr, n_tasks, rounds };
+
+        parallel_for(n_tasks, 4, atomic_add_task, &job);
+        const uint32_t total = (uint32_t) (rounds * n_tasks * (n_tasks + 1) / 2) & mask;
+        for (size_t i = 0; i < n; ++i) assert(BitArray_read(arr, (unsigned int) i) == total);
+
+        parallel_for(n_tasks, 4, atomic_write_task, &job);
+        for (size_t i = 0; i < n; ++i) {
+            const uint32_t x = (uint32_t) (i * 2654435761u + rounds - 1) & mask;
+            assert(BitArray_read(arr, (unsigned int) i) == x);
+        }
+        BitArray_free(arr);
+    }
+
+    // Carry across a word boundary, element 2 of width 13 spans bits 26-38
+    BitArray *arr = BitArray_calloc(5, 13, sizeof(uint32_t));
+    BitArray_write(arr, 1, 0x1FFF);
+    BitArray_write(arr, 2, 0x003F);
+    BitArray_write(arr, 3, 0x1FFF);
+    assert(BitArray_fetch_add_atomic(arr, 2, 1) == 0x003F);
+    assert(BitArray_read(arr, 2) == 0x0040);
+    assert(BitArray_fetch_add_atomic(arr, 2, 0x1FC0) == 0x0040);
+    assert(BitArray_read(arr, 2) == 0);
+    BitArray_write_atomic(arr, 2, 0x1555);
+    assert(BitArray_read(arr, 1) == 0x1FFF && BitArray_read(arr, 2) == 0x1555 &&
+      BitArray_read(arr, 3) == 0x1FFF);
+    BitArray_free(arr);
+
+    // Values returned for the straddling element are each seen exactly once
+    enum { TASKS = 4, ROUNDS = 2000 };
+    static uint32_t seen[TASKS * ROUNDS];
+    static uint8_t hits[TASKS * ROUNDS];
+    for (int run = 0; run < 20; ++run) {
+        arr = BitArray_calloc(5, 13, sizeof(uint32_t));
+        FetchAddJob job = { arr, 2, ROUNDS, seen };
+        parallel_for(TASKS, TASKS, fetch_add_task, &job);
+        assert(BitArray_read(arr, 2) == TASKS * ROUNDS);
+        memset(hits, 0, sizeof(hits));
+        for (size_t q = 0; q < TASKS * ROUNDS; ++q) {
+            assert(seen[q] < TASKS * ROUNDS && !hits[seen[q]]);
+            hits[seen[q]] = 1;
+        }
+        BitArray_free(arr);
+    }
+
+    printf("✔ Atomic writes\n");
+}
+
+TEST("Parallel construction and decode")
+{
+    // Several tasks of PARALLEL_GRAIN values, with an uneven tail
+    const size_t n = 5 * PARALLEL_GRAIN + 77;
+    unsigned int *V = malloc(sizeof(unsigned int) * n);
+    uint32_t *out = malloc(sizeof(uint32_t) * n);
+    uint64_t seed = 29;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t r = lcg_next(&seed);
+        V[i] = r % 8 ? r % 32 : r;
+    }
+
+    const unsigned int threads[] = { 1, 3, 0 };
+    for (size_t ti = 0; ti < sizeof(threads)/sizeof(threads[0]); ++ti) {
+        const uint8_t sizes[] = { 1, 7, 32 };
+        for (size_t si = 0; si < sizeof(sizes)/sizeof(sizes[0]); ++si) {
+            BitArray *serial = BitArray_init(V, (uint32_t) n, sizes[si], sizeof(uint32_t));
+            BitArray *par = BitArray_init_parallel(V, (uint32_t) n, sizes[si],
+              sizeof(uint32_t), threads[ti]);
+            assert(memcmp(serial->v, par->v, sizeof(uint32_t) * BitArray_n_words(par)) == 0);
+
+            BitArray_unpack_parallel(par, 5, n - 5, out, threads[ti]);
+            for (size_t i = 5; i < n; ++i) assert(out[i - 5] == BitArray_read(serial, (unsigned int) i));
+            BitArray_free(serial);
+            BitArray_free(par);
+        }
+
+        const VL_CODEC codecs[] = { VL_GAMMA, VL_DELTA, VL_RICE, VL_VARBYTE };
+        for (size_t ci = 0; ci < 4; ++ci) {
+            VLBitArray *serial = VLBitArray_init_codec(V, n, 33, sizeof(uint32_t),
+              codecs[ci], VL_RICE_AUTO);
+            VLBitArray *par = VLBitArray_init_parallel(V, n, 33, sizeof(uint32_t),
+              codecs[ci], VL_RICE_AUTO, threads[ti]);
+            assert(par->logical_size == serial->logical_size && par->param == serial->param);
+            assert(memcmp(serial->W, par->W, sizeof(uint32_t) * par->physical_size) == 0);
+            assert(memcmp(serial->P, par->P, sizeof(size_t) * ((n + 32) / 33)) == 0);
+
+            VLBitArray_decode_parallel(par, 3, n - 3, out, threads[ti]);
+            for (size_t i = 3; i < n; ++i) assert(out[i - 3] == V[i]);
+            VLBitArray_free(serial);
+            VLBitArray_free(par);
+        }
+    }
+    free(V);
+    free(out);
+    printf("✔ Parallel construction and decode\n");
+}
+
 
 
 